@@ -0,0 +1,82 @@
+#ifndef __COROUTINE_H
+#define __COROUTINE_H
+
+#include "thunks.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <ucontext.h>
+
+/* stackful coroutines, switched with ucontext; each runs on a stack of its
+ * own with a PROT_NONE guard page below it, so that an overflow faults
+ * rather than scribbling over whatever is mapped next, and stacks are kept
+ * in their pool once their coroutine has returned
+ *
+ * a pool isn't thread-safe, and its coroutines are only ever resumed on
+ * the thread that spawned them
+ */
+#define DEFAULT_COROUTINE_STACK_SIZE (64 * 1024)
+#define DEFAULT_COROUTINE_MAX_POOLED (64)
+
+typedef void (*coroutine_fn)(void* data);
+
+typedef struct coroutine
+{
+  ucontext_t context;
+  ucontext_t caller;      /* switched back to on yielding or returning */
+  char* stack;            /* the whole mapping, guard page first */
+  coroutine_fn fn;
+  void* data;
+  bool finished;
+  struct cnt_coropool* pool;
+  struct coroutine* next_free;  /* while pooled */
+} *coroutine_t;
+
+__THUNK_DECL coroutine_t coropool_spawn_thunk (coroutine_fn fn, void* data);
+__THUNK_DECL void coropool_free_thunk (void);
+
+typedef struct cnt_coropool
+{
+  /* coroutines still suspended are the caller's to finish first */
+  typeof (coropool_free_thunk)* free;
+  struct
+  {
+    size_t stack_size;   /* usable, rounded up to a page */
+    size_t page_size;
+    size_t max_pooled;   /* stacks beyond these are unmapped on return */
+    coroutine_t pooled;
+    size_t nr_pooled;
+    size_t nr_live;      /* spawned and yet to return */
+    size_t max_live;
+  } __int;
+  /* sets `fn` up to be called with `data` on one of the pool's stacks,
+   * from the first `resume` on
+   */
+  typeof (coropool_spawn_thunk)* spawn;
+} *coropool_t;
+
+coroutine_t coropool_spawn (coropool_t pool, coroutine_fn fn, void* data);
+void coropool_free (coropool_t pool);
+
+/* 0 for either takes its default */
+coropool_t coropool_new (size_t stack_size, size_t max_pooled);
+/* runs `coroutine` until it yields or returns; false once it has returned,
+ * and gone back to its pool
+ */
+bool coroutine_resume (coroutine_t coroutine);
+/* back to whoever resumed the running coroutine */
+void coroutine_yield (void);
+/* the coroutine running on the calling thread, NULL outside of one */
+coroutine_t coroutine_current (void);
+
+struct __g_coroutine
+{
+  typeof (coropool_new)* new_pool;
+  typeof (coroutine_resume)* resume;
+  typeof (coroutine_yield)* yield;
+  typeof (coroutine_current)* current;
+};
+
+extern struct __g_coroutine g_coroutine;
+
+#endif /* __COROUTINE_H */
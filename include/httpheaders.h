@@ -0,0 +1,177 @@
+#ifndef __HTTPHEADERS_H
+#define __HTTPHEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "httpparse.h"
+
+/* the header names known by type, each kept in its own slot of a context;
+ * any other is `HTTPHEADER_OTHER`
+ *
+ * if adding one, update the enum and `httpheader_value_names`, the
+ * lookup's table is built from them at startup
+ */
+enum httpheader_value_type
+{
+  HTTPHEADER_ACCEPT = 0,
+  HTTPHEADER_ACCEPT_ENCODING,
+  HTTPHEADER_COOKIE,
+  HTTPHEADER_CONNECTION,
+  HTTPHEADER_KEEPALIVE,
+  HTTPHEADER_USERAGENT,
+  HTTPHEADER_HOST,
+  HTTPHEADER_ACCEPT_CHARSET,
+  HTTPHEADER_ACCEPT_LANGUAGE,
+  HTTPHEADER_ACCESS_CONTROL_REQUEST_HEADERS,
+  HTTPHEADER_ACCESS_CONTROL_REQUEST_METHOD,
+  HTTPHEADER_AUTHORIZATION,
+  HTTPHEADER_CACHE_CONTROL,
+  HTTPHEADER_CONTENT_ENCODING,
+  HTTPHEADER_CONTENT_LENGTH,
+  HTTPHEADER_CONTENT_TYPE,
+  HTTPHEADER_DATE,
+  HTTPHEADER_DNT,
+  HTTPHEADER_EARLY_DATA,
+  HTTPHEADER_EXPECT,
+  HTTPHEADER_FORWARDED,
+  HTTPHEADER_FROM,
+  HTTPHEADER_IF_MATCH,
+  HTTPHEADER_IF_MODIFIED_SINCE,
+  HTTPHEADER_IF_NONE_MATCH,
+  HTTPHEADER_IF_RANGE,
+  HTTPHEADER_IF_UNMODIFIED_SINCE,
+  HTTPHEADER_MAX_FORWARDS,
+  HTTPHEADER_ORIGIN,
+  HTTPHEADER_PRAGMA,
+  HTTPHEADER_PRIORITY,
+  HTTPHEADER_PROXY_AUTHORIZATION,
+  HTTPHEADER_RANGE,
+  HTTPHEADER_REFERER,
+  HTTPHEADER_SEC_FETCH_DEST,
+  HTTPHEADER_SEC_FETCH_MODE,
+  HTTPHEADER_SEC_FETCH_SITE,
+  HTTPHEADER_SEC_FETCH_USER,
+  HTTPHEADER_SEC_WEBSOCKET_EXTENSIONS,
+  HTTPHEADER_SEC_WEBSOCKET_KEY,
+  HTTPHEADER_SEC_WEBSOCKET_PROTOCOL,
+  HTTPHEADER_SEC_WEBSOCKET_VERSION,
+  HTTPHEADER_TE,
+  HTTPHEADER_TRAILER,
+  HTTPHEADER_TRANSFER_ENCODING,
+  HTTPHEADER_UPGRADE,
+  HTTPHEADER_UPGRADE_INSECURE_REQUESTS,
+  HTTPHEADER_VIA,
+  HTTPHEADER_X_FORWARDED_FOR,
+  HTTPHEADER_X_FORWARDED_HOST,
+  HTTPHEADER_X_FORWARDED_PROTO,
+  HTTPHEADER_X_REAL_IP,
+  HTTPHEADER_X_REQUEST_ID,
+  HTTPHEADER_X_REQUESTED_WITH,
+  HTTPHEADER_OTHER,  /* also the number of those known */
+  HTTPHEADER_INVALID
+};
+
+#define header_name(ty) httpheader_value_names[(ty)]
+static const char* const httpheader_value_names[] = {
+  [HTTPHEADER_ACCEPT] = "accept",
+  [HTTPHEADER_ACCEPT_ENCODING] = "accept-encoding",
+  [HTTPHEADER_COOKIE] = "cookie",
+  [HTTPHEADER_CONNECTION] = "connection",
+  [HTTPHEADER_KEEPALIVE] = "keep-alive",
+  [HTTPHEADER_USERAGENT] = "user-agent",
+  [HTTPHEADER_HOST] = "host",
+  [HTTPHEADER_ACCEPT_CHARSET] = "accept-charset",
+  [HTTPHEADER_ACCEPT_LANGUAGE] = "accept-language",
+  [HTTPHEADER_ACCESS_CONTROL_REQUEST_HEADERS]
+    = "access-control-request-headers",
+  [HTTPHEADER_ACCESS_CONTROL_REQUEST_METHOD]
+    = "access-control-request-method",
+  [HTTPHEADER_AUTHORIZATION] = "authorization",
+  [HTTPHEADER_CACHE_CONTROL] = "cache-control",
+  [HTTPHEADER_CONTENT_ENCODING] = "content-encoding",
+  [HTTPHEADER_CONTENT_LENGTH] = "content-length",
+  [HTTPHEADER_CONTENT_TYPE] = "content-type",
+  [HTTPHEADER_DATE] = "date",
+  [HTTPHEADER_DNT] = "dnt",
+  [HTTPHEADER_EARLY_DATA] = "early-data",
+  [HTTPHEADER_EXPECT] = "expect",
+  [HTTPHEADER_FORWARDED] = "forwarded",
+  [HTTPHEADER_FROM] = "from",
+  [HTTPHEADER_IF_MATCH] = "if-match",
+  [HTTPHEADER_IF_MODIFIED_SINCE] = "if-modified-since",
+  [HTTPHEADER_IF_NONE_MATCH] = "if-none-match",
+  [HTTPHEADER_IF_RANGE] = "if-range",
+  [HTTPHEADER_IF_UNMODIFIED_SINCE] = "if-unmodified-since",
+  [HTTPHEADER_MAX_FORWARDS] = "max-forwards",
+  [HTTPHEADER_ORIGIN] = "origin",
+  [HTTPHEADER_PRAGMA] = "pragma",
+  [HTTPHEADER_PRIORITY] = "priority",
+  [HTTPHEADER_PROXY_AUTHORIZATION] = "proxy-authorization",
+  [HTTPHEADER_RANGE] = "range",
+  [HTTPHEADER_REFERER] = "referer",
+  [HTTPHEADER_SEC_FETCH_DEST] = "sec-fetch-dest",
+  [HTTPHEADER_SEC_FETCH_MODE] = "sec-fetch-mode",
+  [HTTPHEADER_SEC_FETCH_SITE] = "sec-fetch-site",
+  [HTTPHEADER_SEC_FETCH_USER] = "sec-fetch-user",
+  [HTTPHEADER_SEC_WEBSOCKET_EXTENSIONS] = "sec-websocket-extensions",
+  [HTTPHEADER_SEC_WEBSOCKET_KEY] = "sec-websocket-key",
+  [HTTPHEADER_SEC_WEBSOCKET_PROTOCOL] = "sec-websocket-protocol",
+  [HTTPHEADER_SEC_WEBSOCKET_VERSION] = "sec-websocket-version",
+  [HTTPHEADER_TE] = "te",
+  [HTTPHEADER_TRAILER] = "trailer",
+  [HTTPHEADER_TRANSFER_ENCODING] = "transfer-encoding",
+  [HTTPHEADER_UPGRADE] = "upgrade",
+  [HTTPHEADER_UPGRADE_INSECURE_REQUESTS] = "upgrade-insecure-requests",
+  [HTTPHEADER_VIA] = "via",
+  [HTTPHEADER_X_FORWARDED_FOR] = "x-forwarded-for",
+  [HTTPHEADER_X_FORWARDED_HOST] = "x-forwarded-host",
+  [HTTPHEADER_X_FORWARDED_PROTO] = "x-forwarded-proto",
+  [HTTPHEADER_X_REAL_IP] = "x-real-ip",
+  [HTTPHEADER_X_REQUEST_ID] = "x-request-id",
+  [HTTPHEADER_X_REQUESTED_WITH] = "x-requested-with"
+};
+
+/* the type of the header name of `len` `tchar`s at `name`, by any case,
+ * with one hash over them and one comparison against the name it lands on
+ */
+enum httpheader_value_type httpheader_lookup (const char* name, size_t len);
+
+/* one item of a comma-separated header value, e.g. `gzip;q=0.8` of an
+ * Accept-Encoding, its spans being into the value and stripped of
+ * whitespace
+ */
+typedef struct httplistitem
+{
+  httpspan_t token;
+  httpspan_t params;  /* whatever follows the first ';', the q-value too */
+  uint16_t q;         /* the weight in thousandths, 1000 if it's not given */
+} *httplistitem_t;
+
+/* a header value being read an item at a time, where it lies, so that
+ * nothing is parsed or allocated for it until it's read
+ */
+typedef struct httplist
+{
+  const char* value;
+  size_t length;
+  size_t position;
+} *httplist_t;
+
+/* starts reading the items of a NUL-terminated header `value` */
+void httpheader_list_begin (httplist_t list, const char* value);
+/* fills in the next item, skipping empty ones, false once there's none;
+ * commas and semicolons in quoted strings don't delimit
+ */
+bool httpheader_list_next (httplist_t list, httplistitem_t into);
+
+struct __g_httpheaders
+{
+  typeof (httpheader_lookup)* lookup;
+  typeof (httpheader_list_begin)* list_begin;
+  typeof (httpheader_list_next)* list_next;
+};
+
+extern struct __g_httpheaders g_httpheaders;
+
+#endif /* __HTTPHEADERS_H */
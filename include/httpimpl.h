@@ -7,40 +7,16 @@
 #include "restype.h"
 #include "hashmap.h"
 #include "list.h"
+#include "httpparse.h"
+#include "httpheaders.h"
 #define CRLF ("\r\n")
+#define HTTP_HEAD_TERMINATOR ("\r\n\r\n")
 
 typedef char* raw_httpheader_t;
 typedef time_t httptimeval_t;
 typedef bool httpbool_t;
 
-enum httpheader_value_type
-{
-  HTTPHEADER_ACCEPT = 0,
-  HTTPHEADER_ACCEPT_ENCODING,
-  HTTPHEADER_COOKIE,
-  HTTPHEADER_CONNECTION,
-  HTTPHEADER_KEEPALIVE,
-  HTTPHEADER_USERAGENT,
-  HTTPHEADER_HOST,
-  HTTPHEADER_OTHER,
-  HTTPHEADER_INVALID
-};
-
-#define header_name(ty) httpheader_value_names[(ty)]
-#define is_header_equal(a, ty) (!strcasecmp ((a), (header_name(ty))))
-static const char* const httpheader_value_names[] = {
-  [HTTPHEADER_ACCEPT] = "accept",
-  [HTTPHEADER_ACCEPT_ENCODING] = "accept-encoding",
-  [HTTPHEADER_COOKIE] = "cookie",
-  [HTTPHEADER_CONNECTION] = "connection",
-  [HTTPHEADER_KEEPALIVE] = "keep-alive",
-  [HTTPHEADER_USERAGENT] = "user-agent",
-  [HTTPHEADER_HOST] = "host"
-}; /* if adding additional methods, update the enum and
-    * `identify_header_type` in `src/httpimpl.c` accordingly
-    */
-
-typedef struct
+typedef struct httpheader
 {
   enum httpheader_value_type type;
   raw_httpheader_t name;
@@ -74,7 +50,6 @@ typedef struct
   {
     struct 
     {
-      list_t allowed_encodings;
       httpencoding_t chosen_encoding;
     } encoding;
     struct 
@@ -83,9 +58,10 @@ typedef struct
       httptimeval_t timeout;
       size_t max_reqs;
     } keep_alive;
-    list_t accept;
-    raw_httpheader_t user_agent;
-    raw_httpheader_t host;
+    /* the value of every known header by its type, NULL if it's absent;
+     * any other goes in `aux_headers`, made for the first of them
+     */
+    raw_httpheader_t headers[HTTPHEADER_OTHER];
     hashmap_t aux_headers;
   } connection;
   struct
@@ -103,7 +79,7 @@ update_from_header (httpcontext_t this, httpheader_t header);
 static void
 free_context (httpcontext_t ctx);
 
-typedef struct
+typedef struct httpmethodline
 {
   raw_httpheader_t verb;
   raw_httpheader_t path;
@@ -113,11 +89,15 @@ typedef struct
   } version;
 } *httpmethodline_t;
 
-static result_type_of (httpmethodline_t) 
-parse_methodline (raw_httpheader_t methodline);
+/* views over a head parsed by `g_httpparse` and terminated in place, filled
+ * into `into`; their strings live in `buf`, for as long as it's left be
+ */
+static httpmethodline_t
+parse_methodline (httphead_t head, char* buf, httpmethodline_t into);
 
-static result_type_of (httpheader_t)
-parse_headerline (raw_httpheader_t header);
+static httpheader_t
+parse_headerline (httphead_t head, char* buf, size_t index,
+  httpheader_t into);
 
 static httpcontext_t
 create_context (void);
@@ -0,0 +1,91 @@
+#ifndef __HTTPPARSE_H
+#define __HTTPPARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the request head is parsed in a single pass over the bytes as they were
+ * received, into spans of that buffer rather than copies of it; nothing is
+ * allocated, and the head's views (see `src/httpimpl.c`) point straight
+ * into the connection's receive ring
+ *
+ * parsing stops wherever the bytes run out, and picks up from there once
+ * more have arrived, so a head that trickles in is still only walked once
+ */
+#define HTTP_MAX_HEADERS (64)
+
+/* a byte range of the buffer the head was parsed from */
+typedef struct
+{
+  uint32_t offset, length;
+} httpspan_t;
+
+enum httpparse_status
+{
+  HTTPPARSE_DONE = 0,
+  HTTPPARSE_NEED_MORE,  /* the head isn't all there yet */
+  HTTPPARSE_ERROR       /* see `error` */
+};
+
+/* where parsing picks up again */
+enum httpparse_state
+{
+  HTTPPARSE_AT_METHOD = 0,
+  HTTPPARSE_AT_PATH,
+  HTTPPARSE_AT_VERSION,
+  HTTPPARSE_AT_LINE,         /* the start of a header line, or the blank one */
+  HTTPPARSE_AT_NAME,
+  HTTPPARSE_AT_VALUE_OWS,
+  HTTPPARSE_AT_VALUE,
+  HTTPPARSE_AT_VALUE_LF,
+  HTTPPARSE_AT_END_LF
+};
+
+typedef struct httphead
+{
+  size_t length;  /* through the blank line, once done */
+  httpspan_t method, path;
+  struct
+  {
+    uint8_t minor; uint8_t major;
+  } version;
+  size_t nr_headers;
+  struct
+  {
+    httpspan_t name, value;  /* the value without surrounding whitespace */
+  } headers[HTTP_MAX_HEADERS];
+  const char* error;
+  struct
+  {
+    enum httpparse_state state;
+    size_t position;    /* how much of `buf` has been parsed */
+    size_t start, end;  /* of the span being parsed */
+    size_t matched;     /* of the version */
+  } __int;
+} *httphead_t;
+
+/* readies `head` for a new request */
+void httpparse_begin (httphead_t head);
+/* parses the head at the start of `buf`, whatever follows it is left be;
+ * after HTTPPARSE_NEED_MORE, it's to be called again with the same bytes
+ * at the start of `buf` and more after them
+ */
+enum httpparse_status httpparse_head (httphead_t head, const char* buf,
+  size_t len);
+/* NUL-terminates every span of a parsed head in place, over the delimiter
+ * that follows it, for them to be used as strings; `buf` can't be parsed
+ * again afterwards
+ */
+void httpparse_terminate (httphead_t head, char* buf);
+
+struct __g_httpparse
+{
+  typeof (httpparse_begin)* begin;
+  typeof (httpparse_head)* head;
+  typeof (httpparse_terminate)* terminate;
+};
+
+extern struct __g_httpparse g_httpparse;
+
+#endif /* __HTTPPARSE_H */
@@ -0,0 +1,48 @@
+#ifndef __HTTPSCAN_H
+#define __HTTPSCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* kernels that scan a request head for where a run of bytes of one class
+ * ends, 16 or 32 bytes at a time where the CPU allows; the best the CPU
+ * supports is picked once at startup, and each kernel finishes the bytes
+ * short of a whole vector off in scalar, so none reads past `len`
+ *
+ * each returns the index of the first byte at or after `from` that ends
+ * the run, or `len` if none does
+ */
+enum httpscan_isa
+{
+  HTTPSCAN_SCALAR = 0,
+  HTTPSCAN_SSE42,  /* PCMPESTRI */
+  HTTPSCAN_AVX2,
+  HTTPSCAN_NR_ISAS
+};
+
+/* anything but a `tchar`, i.e. the end of a method or header name */
+size_t httpscan_scalar_token (const char* buf, size_t from, size_t len);
+/* a CTL or space, i.e. the end of a request target */
+size_t httpscan_scalar_target (const char* buf, size_t from, size_t len);
+/* a CTL other than HTAB, i.e. the end of a header value, its CR included */
+size_t httpscan_scalar_field (const char* buf, size_t from, size_t len);
+/* any byte of `set`, a string of at most 16 */
+size_t httpscan_scalar_any (const char* buf, size_t from, size_t len,
+  const char* set);
+
+/* picks the kernels of `isa`, false if the CPU doesn't support it */
+bool httpscan_select (enum httpscan_isa isa);
+
+struct __g_httpscan
+{
+  const char* isa;  /* the name of the kernels picked */
+  typeof (httpscan_scalar_token)* token;
+  typeof (httpscan_scalar_target)* target;
+  typeof (httpscan_scalar_field)* field;
+  typeof (httpscan_scalar_any)* any;
+  typeof (httpscan_select)* select;
+};
+
+extern struct __g_httpscan g_httpscan;
+
+#endif /* __HTTPSCAN_H */
@@ -2,30 +2,82 @@
 #define __HTTP_SERVER_H
 
 #include "common.h"
+#include "coroutine.h"
 #include "routes.h"
 #include "tcpserver.h"
 #include "thunks.h"
+#include "workpool.h"
 
-#define ALG_INCR_INITIAL_RECV (4)
-#if ALG_INCR_INITIAL_RECV <= 0
-# pragma GCC error ALG_INCR_INITIAL_RECV must be positive
-#endif
+/* a worker that crashes sooner than this after being spawned is respawned
+ * only once this has passed, so that a worker failing on startup doesn't
+ * keep the master forking
+ */
+#define HTTP_WORKER_RESPAWN_BACKOFF_MS (1000)
+/* names the socket an upgraded instance takes its listeners over on */
+#define HTTP_HANDOFF_FD_ENV "HTTP_SERVER_HANDOFF_FD"
 
 typedef void (*__int_set_route_table_fn)(route_table_t route_table);
 typedef void (*__int_hs_start_event_loop_fn)(void);
+typedef void (*__int_hs_start_workers_fn)(size_t nr_workers);
+typedef void (*__int_hs_enable_upgrades_fn)(char* const* argv);
+typedef void (*__int_hs_configure_offload_fn)(size_t nr_threads,
+  size_t max_queued);
+typedef void (*__int_hs_configure_coroutines_fn)(size_t stack_size,
+  size_t max_pooled);
 
 typedef struct __int_httpserver {
   struct {
     route_table_t route_table;
     tcpserver_t tcp_server;
+    char* const* upgrade_argv;
+    bool is_worker;
+    bool handed_over;
+    /* offloaded routes run here, started with the event loop if any are */
+    workpool_t offload;
+    struct
+    {
+      size_t nr_threads, max_queued;
+    } offload_config;
+    /* one pool per reactor, coroutine routes run on their reactor's */
+    coropool_t* coroutines;
+    size_t nr_coroutine_pools;
+    struct
+    {
+      size_t stack_size, max_pooled;
+    } coroutine_config;
   } __int;
   __int_set_route_table_fn set_route_table;
   __int_hs_start_event_loop_fn start_event_loop;
+  /* forks `nr_workers` processes that each run the event loop on the
+   * listeners bound here, and supervises them until told to stop
+   */
+  __int_hs_start_workers_fn start_workers;
+  /* on SIGUSR2, exec()s `argv` with the listeners handed over to it, and
+   * drains once it has taken them up
+   */
+  __int_hs_enable_upgrades_fn enable_upgrades;
+  /* sizes the work pool of offloaded routes, 0 for either takes its
+   * default; a request for an offloaded route gets a 503 while the pool's
+   * queue is full
+   */
+  __int_hs_configure_offload_fn configure_offload;
+  /* sizes the stacks coroutine routes run on, and how many are kept around
+   * per reactor once their handler returns; 0 for either takes its default
+   */
+  __int_hs_configure_coroutines_fn configure_coroutines;
 } *httpserver_t;
 
 __THUNK_DECL void __int_set_route_table_thunk (httpserver_t this,
   route_table_t route_table);
 __THUNK_DECL void __int_start_event_loop_thunk (httpserver_t this);
+__THUNK_DECL void __int_start_workers_thunk (httpserver_t this,
+  size_t nr_workers);
+__THUNK_DECL void __int_enable_upgrades_thunk (httpserver_t this,
+  char* const* argv);
+__THUNK_DECL void __int_configure_offload_thunk (httpserver_t this,
+  size_t nr_threads, size_t max_queued);
+__THUNK_DECL void __int_configure_coroutines_thunk (httpserver_t this,
+  size_t stack_size, size_t max_pooled);
 /* callbacks, impl. in: src/httpcallbacks.c */
 void __int_cb_register_callbacks (httpserver_t server);
 __THUNK_DECL void __int_cb_client_connected (httpserver_t this,
@@ -38,14 +90,40 @@ __THUNK_DECL void __int_cb_client_writable (httpserver_t this,
   tcp_client_t who);
 
 httpserver_t __int_hs_create_with_bind (tcp_address_t host, tcp_port_t port);
+httpserver_t __int_hs_create_with_config (tcp_address_t host, tcp_port_t port,
+  const struct tcp_server_config* config);
 void __int_hs_free (httpserver_t server);
 
 struct __g_httpserver
 {
   typeof (__int_hs_create_with_bind)* create_and_bind_to;
+  typeof (__int_hs_create_with_config)* create_and_bind_with;
   typeof (__int_hs_free)* free;
 };
 
 extern struct __g_httpserver g_httpserver;
 
+/* for handlers of coroutine routes, impl. in: src/httpcallbacks.c; these
+ * switch back to the event loop while they'd block, and fail straight away
+ * when called from any other handler
+ */
+ssize_t __int_route_read (void* buf, size_t len);
+bool __int_route_wait_fd (int fd, bool writable);
+
+struct __g_route_io
+{
+  /* reads up to `len` bytes of what the client sent after the request
+   * head, waiting for some if there's none yet; 0 once the client has
+   * stopped sending and all of it has been read, -1 once it has gone, or
+   * if it doesn't send any before the body read deadline
+   */
+  typeof (__int_route_read)* read;
+  /* waits on `fd` becoming readable (or writable); false if it can't be
+   * waited on, or the client went away meanwhile
+   */
+  typeof (__int_route_wait_fd)* wait_fd;
+};
+
+extern struct __g_route_io g_route_io;
+
 #endif /* __HTTP_SERVER_H */
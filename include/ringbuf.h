@@ -0,0 +1,57 @@
+#ifndef __RINGBUF_H
+#define __RINGBUF_H
+
+#include "thunks.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the ring is mapped twice back-to-back in virtual memory, so that both
+ * the readable and the writable regions are always contiguous, no matter
+ * where they wrap around; the capacity is rounded up to a page multiple
+ */
+#define DEFAULT_RINGBUF_CAPACITY (1 << 14)
+
+__THUNK_DECL size_t ringbuf_readable_thunk (void);
+__THUNK_DECL size_t ringbuf_writable_thunk (void);
+__THUNK_DECL char* ringbuf_read_ptr_thunk (void);
+__THUNK_DECL char* ringbuf_write_ptr_thunk (void);
+__THUNK_DECL void ringbuf_produce_thunk (size_t nr_bytes);
+__THUNK_DECL void ringbuf_consume_thunk (size_t nr_bytes);
+__THUNK_DECL void ringbuf_free_thunk (void);
+
+typedef struct cnt_ringbuf
+{
+  typeof (ringbuf_free_thunk)* free;
+  struct
+  {
+    char* base;
+    size_t capacity;
+    size_t head, tail;  /* free-running read & write positions */
+  } __int;
+  typeof (ringbuf_readable_thunk)* readable;
+  typeof (ringbuf_writable_thunk)* writable;
+  typeof (ringbuf_read_ptr_thunk)* read_ptr;
+  typeof (ringbuf_write_ptr_thunk)* write_ptr;
+  typeof (ringbuf_produce_thunk)* produce;
+  typeof (ringbuf_consume_thunk)* consume;
+} *ringbuf_t;
+
+size_t ringbuf_readable (ringbuf_t ring);
+size_t ringbuf_writable (ringbuf_t ring);
+char* ringbuf_read_ptr (ringbuf_t ring);
+char* ringbuf_write_ptr (ringbuf_t ring);
+void ringbuf_produce (ringbuf_t ring, size_t nr_bytes);
+void ringbuf_consume (ringbuf_t ring, size_t nr_bytes);
+void ringbuf_free (ringbuf_t ring);
+
+ringbuf_t ringbuf_new (size_t capacity);
+
+struct __g_ringbuf
+{
+  typeof (ringbuf_new)* new;
+};
+
+extern struct __g_ringbuf g_ringbuf;
+
+#endif /* __RINGBUF_H */
@@ -17,10 +17,24 @@
 typedef bool (*route_match_fn)(const char* path);
 typedef void (*route_handler_fn)(void /* TODO */);
 
+enum route_mode
+{
+  ROUTE_INLINE = 0,  /* run straight from the event loop */
+  /* run on the server's work pool instead of the event loop, for handlers
+   * that block or take a while
+   */
+  ROUTE_OFFLOAD,
+  /* run on a stack of its own, for handlers that wait on the client or on
+   * other descriptors, see `g_route_io`
+   */
+  ROUTE_COROUTINE
+};
+
 struct __int_route
 {
   route_match_fn match;
   route_handler_fn handler;
+  enum route_mode mode;
   struct {
     char* identifier;
     char* expression;
@@ -54,6 +68,8 @@ enum __int_bf_parse_token
 #define TOK_COMMENT (';')
 #define TOK_SEPARATOR (':')
 #define TOK_EXPRESSION ('"')
+#define KW_OFFLOAD ("offload")
+#define KW_COROUTINE ("coroutine")
 
 __THUNK_DECL void
 __int_register_routes_thunk (route_table_t route_table,
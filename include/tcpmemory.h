@@ -0,0 +1,17 @@
+#ifndef __TCP_MEMORY_H
+#define __TCP_MEMORY_H
+
+#include "tcpserver.h"
+
+/* connections are opened by the reactor itself rather than accepted, and
+ * play out `config.memory`'s script through the same callbacks, receive
+ * rings and output queues as real ones; each reactor only ever runs on its
+ * own, so a run is repeatable down to every readable event
+ */
+#define DEFAULT_TCP_MEMORY_CONCURRENT (64)
+/* the most an output buffer is kept at between connections */
+#define TCP_MEMORY_OUTPUT_KEEP (64 * 1024)
+
+extern const struct __int_tcp_backend __int_ts_memory_backend;
+
+#endif /* __TCP_MEMORY_H */
@@ -3,32 +3,97 @@
 
 #include "common.h"
 #include "thunks.h"
+#include "ringbuf.h"
+#include "timerwheel.h"
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 
-#define DEFAULT_TCP_BACKLOG (8)
+#if __has_include(<linux/io_uring.h>)
+# define TCP_HAVE_IO_URING
+#endif
+
+#define DEFAULT_TCP_BACKLOG (4096)  /* clamped to net.core.somaxconn */
 #if DEFAULT_TCP_BACKLOG <= 0
 # pragma GCC error "DEFAULT_TCP_BACKLOG must be positive"
 #endif
-#define NULL_RECV_BUFFER_THRESHOLD (512)
-#if NULL_RECV_BUFFER_THRESHOLD <= 0
-# pragma GCC error "NULL_RECV_BUFFER_THRESHOLD must be positive"
+#define DEFAULT_TCP_REACTORS (1)
+#if DEFAULT_TCP_REACTORS < 0
+# pragma GCC error "DEFAULT_TCP_REACTORS must not be negative"
 #endif
+#define TCP_REACTOR_UNPINNED (-1)
+#define DEFAULT_TCP_SPIN_US (50)
+#define DEFAULT_TCP_BLOCK_TIMEOUT_MS (-1)
+#define DEFAULT_TCP_BUSY_POLL_US (0)
+#define DEFAULT_TCP_MAX_EVENTS (256)
+#if DEFAULT_TCP_MAX_EVENTS <= 0
+# pragma GCC error "DEFAULT_TCP_MAX_EVENTS must be positive"
+#endif
+#define DEFAULT_TCP_BUDGET_BYTES (64 * 1024)
+#define DEFAULT_TCP_BUDGET_CALLBACKS (16)
+#define DEFAULT_TCP_MAX_CONNECTIONS (0)
+#define TCP_ACCEPT_BACKOFF_MS (100)
+#define DEFAULT_TCP_DEFER_ACCEPT_S (0)
+#define DEFAULT_TCP_FASTOPEN_QLEN (0)
+#define TCP_TX_IOV_BATCH (64)
+#define TCP_TX_INITIAL_SEGMENTS (4)
+#define TCP_CLIENT_SLAB_SIZE (64)
+#define DEFAULT_TCP_HEADER_READ_TIMEOUT_MS (10000)
+#define DEFAULT_TCP_BODY_READ_TIMEOUT_MS (30000)
+#define DEFAULT_TCP_IDLE_TIMEOUT_MS (60000)
+#define DEFAULT_TCP_WRITE_STALL_TIMEOUT_MS (30000)
+#define DEFAULT_TCP_DRAIN_TIMEOUT_MS (30000)
+/* while draining, a connection that hasn't started on a request gets no
+ * longer than this to do so
+ */
+#define TCP_DRAIN_IDLE_TIMEOUT_MS (1000)
+/* SCM_MAX_FD, the most descriptors a single message can carry */
+#define TCP_HANDOFF_MAX_LISTENERS (253)
+#define TCP_HANDOFF_TIMEOUT_MS (10000)
 
 typedef typeof (socket (SOCK_STREAM, AF_INET, 0)) tcp_sockfd_t;
 typedef typeof (recv (0, NULL, 0, 0)) recv_ret_t;
 typedef typeof (send (0, NULL, 0, 0)) send_ret_t;
 
+typedef struct __int_tcp_client* tcp_client_t;
+
+/* fired once every byte of a `sendv` batch was handed to the kernel, or
+ * with `sent` unset if the connection went away first; either way the
+ * caller may release the batch's buffers from then on
+ */
+typedef void (*tcp_send_done_fn)(tcp_client_t who, void* data, bool sent);
+
+/* what a connection is waiting on the peer for, each with a timeout of its
+ * own in the server's config; a connection missing its deadline is closed
+ * as if the peer had gone away
+ */
+enum tcp_deadline
+{
+  TCP_DEADLINE_NONE = 0,
+  TCP_DEADLINE_HEADER_READ,
+  TCP_DEADLINE_BODY_READ,
+  TCP_DEADLINE_IDLE
+};
+
 /* thunk typedef stubs */
 typedef void (*__int_set_recv_low_watermark_fn)(size_t watermark);
+typedef void (*__int_set_deadline_fn)(enum tcp_deadline deadline);
 typedef recv_ret_t (*__int_recv_fn)(void* buf, size_t len);
 typedef recv_ret_t (*__int_peek_fn)(void* buf, size_t len);
 typedef send_ret_t (*__int_send_fn)(void* buf, size_t len);
+typedef send_ret_t (*__int_sendv_fn)(const struct iovec* iov, int iovcnt,
+  tcp_send_done_fn on_done, void* data);
+typedef send_ret_t (*__int_sendfile_fn)(int fd, off_t offset, size_t len,
+  tcp_send_done_fn on_done, void* data);
 typedef void (*__int_close_fn)(void);
 typedef void (*__int_ts_start_event_loop_fn)(void);
 typedef void (*__int_tcp_socket_free_fn)(void);
@@ -45,6 +110,24 @@ typedef struct __int_tcp_conninfo (*__int_getaddr_fn)(void);
 typedef typeof (((struct __int_tcp_conninfo*)NULL)->address) tcp_address_t;
 typedef typeof (((struct __int_tcp_conninfo*)NULL)->port) tcp_port_t;
 
+struct __int_tcp_tx_segment
+{
+  const char* base;
+  size_t len;
+  bool owned;                 /* copied in by `send`, free()d once sent */
+  bool is_file;               /* `len` bytes of `file`, instead of `base` */
+  struct
+  {
+    int fd;
+    off_t offset;
+    bool is_pipe;             /* spliced rather than sendfile()d */
+  } file;
+  tcp_send_done_fn on_done;   /* only set on the last segment of a batch */
+  void* data;
+};
+
+struct __int_tcp_uring_chunk;
+
 struct __int_tcp_socket
 {
   struct
@@ -55,41 +138,435 @@ struct __int_tcp_socket
   {
     __int_recv_fn recv;
     __int_send_fn send;
+    __int_sendv_fn sendv;
+    /* queues `len` bytes of `fd` from `offset` on (pipes are read from
+     * their current position, and must already hold all `len` bytes), the
+     * descriptor is borrowed until `on_done` fires, just as with `sendv`
+     */
+    __int_sendfile_fn sendfile;
     __int_peek_fn peek;
     __int_close_fn close;
+    /* the address is NULL if the peer is already gone, in which case the
+     * connection is torn down on its next event
+     */
     __int_getaddr_fn get_address;
   } op;
   struct
   {
     __int_set_recv_low_watermark_fn set_recv_low_watermark;
+    /* setting the deadline that's already running leaves it running */
+    __int_set_deadline_fn set_deadline;
   } cfg;
   tcp_sockfd_t sockfd;
+  ringbuf_t rx;
+  struct
+  {
+    struct __int_tcp_tx_segment* segments;  /* circular, `head` first */
+    size_t head, nr_segments, capacity;
+    size_t offset;      /* bytes of the head segment already sent */
+    size_t nr_pending;  /* bytes queued across all segments */
+    bool want_writable; /* EPOLLOUT is armed while bytes are pending */
+  } tx;
+  struct
+  {
+    /* received by the io_uring backend, but not yet copied into `rx` */
+    struct __int_tcp_uring_chunk* stash;
+    size_t nr_stashed, stash_capacity;
+    unsigned int nr_inflight;    /* operations still owing a completion */
+    unsigned int nr_sends;       /* sends left in the current linked chain */
+    bool recv_armed, starved;
+    struct __int_tcp_client* next_starved;
+  } uring;
   bool is_blocking;
   bool closed;
+  bool closing;  /* close requested, waiting on the output queue to drain */
+  bool read_closed;  /* the peer sent EOF, it may still be sent to */
+  /* set by the application while a response is still to come, which the
+   * peer's EOF doesn't cut short
+   */
+  bool answering;
+  bool peer_closed;  /* reset, or a send failed: nothing goes either way */
 };
 
+struct __int_tcp_reactor;
+struct __int_tcp_listener;
+
 typedef struct __int_tcp_client
 {
   struct
   {
-    tcp_address_t address;
+    tcp_address_t address;  /* NULL until `connection.op.get_address` */
     tcp_port_t port;
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    char address_buf[INET6_ADDRSTRLEN];  /* or "unix:" for Unix peers */
   } info;
   struct __int_tcp_socket connection;
+  struct __int_tcp_reactor* reactor;
+  struct __int_tcp_listener* listener;  /* the client was accepted on */
+  struct
+  {
+    timerwheel_timer_t read;
+    timerwheel_timer_t write;  /* armed while queued output isn't moving */
+    enum tcp_deadline read_kind;
+  } deadlines;
+  struct
+  {
+    /* what's left of this iteration's budget, renewed on first use in
+     * each iteration of the event loop
+     */
+    uint64_t iteration;
+    size_t nr_bytes;
+    unsigned int nr_callbacks;
+    /* on the reactor's ready list, since `queued_at`, while held back */
+    struct __int_tcp_client *prev, *next;
+    uint64_t queued_at;
+    bool queued;
+  } budget;
+  struct __int_tcp_client* next_free;  /* while pooled */
+  void* data;  /* left to the server's callbacks, NULL on connection */
 } *tcp_client_t;
 
+/* clients are carved out of slabs, and go back to their reactor's pool on
+ * close with their thunks, receive ring & output queue storage intact
+ */
+struct __int_tcp_client_slab
+{
+  struct __int_tcp_client_slab* next;
+  struct __int_tcp_client clients[TCP_CLIENT_SLAB_SIZE];
+};
+
 typedef int conn_backlog_t;
 typedef int poller_t;
 
+enum tcp_listener_family
+{
+  TCP_LISTENER_INET = 0,
+  TCP_LISTENER_INET6,
+  TCP_LISTENER_UNIX
+};
+
+/* an address to accept connections on; all of a server's listeners feed
+ * the same reactors and callbacks
+ */
+struct tcp_listener_config
+{
+  enum tcp_listener_family family;
+  /* the host for IPv4/IPv6, or the Unix socket's path, in the abstract
+   * namespace if it starts with '@'
+   */
+  const char* address;
+  tcp_port_t port;          /* unused by Unix sockets */
+  conn_backlog_t backlog;   /* 0 takes the server's `sockets.backlog` */
+  bool v6_only;             /* IPv6 listeners are dual-stack unless set */
+};
+
 typedef void (*__int_callback_t)(tcp_client_t who);
+/* run on reactor #0's thread, from its event loop */
+typedef void (*tcp_signal_fn)(void* data, const struct signalfd_siginfo* info);
+
+enum tcp_backend_type
+{
+  TCP_BACKEND_EPOLL = 0,
+  TCP_BACKEND_IO_URING,  /* only if built with <linux/io_uring.h> */
+  TCP_BACKEND_MEMORY     /* scripted connections, see `config.memory` */
+};
+
+/* called on the connection's reactor with everything the server sent it,
+ * once the server has closed it; `id` counts the reactor's connections
+ */
+typedef void (*tcp_memory_output_fn)(void* data, size_t id,
+  const char* output, size_t len);
 
-typedef struct
+struct tcp_server_config
 {
+  enum tcp_backend_type backend;
   struct
   {
-    tcp_address_t address;
-    tcp_port_t port;
+    /* 0 runs one reactor per online CPU, each reactor owns a SO_REUSEPORT
+     * listening socket, an epoll instance and a thread
+     */
+    size_t nr_reactors;
+    /* when `pin_to_cpus` is set, reactor `i` is pinned to `cpu_affinity[i]`,
+     * or to CPU `i % nr_cpus` if no affinity list is given; entries equal
+     * to `TCP_REACTOR_UNPINNED` leave that reactor to the scheduler
+     */
+    bool pin_to_cpus;
+    const int* cpu_affinity;
+  } reactors;
+  struct
+  {
+    /* an idle reactor polls epoll without blocking for up to `spin_us`
+     * microseconds, and then blocks for up to `block_timeout_ms` (-1 blocks
+     * until an event arrives); `busy_poll_us` sets SO_BUSY_POLL on the
+     * listening and accepted sockets, 0 leaves it off
+     */
+    unsigned long spin_us;
+    int block_timeout_ms;
+    unsigned int busy_poll_us;
+    /* how many events a single epoll_wait() may return */
+    int max_events;
+  } wait;
+  struct
+  {
+    /* set on each listening socket, accepted sockets inherit all but
+     * `quickack`, which the kernel keeps turning off and is set on every
+     * accepted socket instead; a `defer_accept_s` of N only wakes the
+     * listener once a connection has sent data (or after N seconds),
+     * `fastopen_qlen` bounds pending TCP Fast Open requests, and buffer
+     * sizes of 0 leave them to the kernel's autotuning; options that fail
+     * to apply are warned about and skipped
+     */
+    conn_backlog_t backlog;
+    bool nodelay;
+    bool quickack;
+    int defer_accept_s;
+    int fastopen_qlen;
+    int sndbuf;
+    int rcvbuf;
+  } sockets;
+  struct
+  {
+    /* try reading straight after accepting, before waiting on epoll */
+    bool eager_read;
+  } accept;
+  struct
+  {
+    /* size of each connection's receive ring, rounded up to a page */
+    size_t rx_capacity;
+  } buffers;
+  struct
+  {
+    /* per-deadline timeouts, 0 disables the deadline; the write stall
+     * deadline is restarted whenever queued output makes progress
+     */
+    unsigned int header_read_ms;
+    unsigned int body_read_ms;
+    unsigned int idle_ms;
+    unsigned int write_stall_ms;
+    /* how long a draining server waits on its open connections before
+     * closing whatever is left, 0 waits for as long as they take
+     */
+    unsigned int drain_ms;
+  } timeouts;
+  struct
+  {
+    /* how much a connection may read, and how many readable callbacks it
+     * may get, in one iteration of the event loop before the rest of its
+     * input is held back for the next one, so that heavy clients can't
+     * starve light ones; 0 leaves either unlimited
+     */
+    size_t nr_bytes;
+    unsigned int nr_callbacks;
+  } budget;
+  struct
+  {
+    /* connections open at once across all reactors, 0 leaves it to the
+     * descriptor limit; each reactor gets an even share, and stops
+     * accepting while its share is used up
+     */
+    size_t max_connections;
+  } limits;
+  /* listened on in addition to the address and port the server is
+   * created with, which may then be left out (NULL)
+   */
+  const struct tcp_listener_config* listeners;
+  size_t nr_listeners;
+  /* a Unix socket that a previous instance hands its listening sockets
+   * over on, they're then taken up in place of binding new ones, and the
+   * reactor count follows the previous instance's; -1 binds as usual
+   */
+  int handoff_fd;
+  struct
+  {
+    /* the memory backend's connections, which never touch the kernel:
+     * `nr_connections` of them, shared out between the reactors with at
+     * most `nr_concurrent` open at once on each, every one sending `input`
+     * and then hanging up if `hangup` is set; each readable event delivers
+     * at most `chunk` bytes and each iteration takes at most `window`
+     * bytes of output, so that partial reads and slow clients replay
+     * exactly, 0 for either delivers or takes everything at once; a
+     * reactor drains once its share of connections is done
+     */
+    const char* input;
+    size_t input_len;
+    size_t nr_connections;
+    size_t nr_concurrent;
+    size_t chunk;
+    size_t window;
+    bool hangup;
+    tcp_memory_output_fn on_output;  /* may be NULL */
+    void* data;
+  } memory;
+};
+
+extern const struct tcp_server_config tcp_default_config;
+
+/* socket-level failures only ever cost the connection they happen on, and
+ * are counted by the class of their errno
+ */
+enum tcp_error_class
+{
+  TCP_ERROR_PEER = 0,   /* the peer is gone, e.g. EPIPE, ECONNRESET */
+  TCP_ERROR_RESOURCE,   /* out of descriptors or memory, e.g. EMFILE */
+  TCP_ERROR_OTHER,
+  TCP_NR_ERROR_CLASSES
+};
+
+struct tcp_loop_stats
+{
+  uint64_t spin_hits;       /* waits that returned events while spinning */
+  uint64_t block_wakeups;   /* waits that returned events after blocking */
+  uint64_t block_timeouts;  /* blocking waits that returned nothing */
+  uint64_t nr_events;       /* events returned across all waits */
+  uint64_t nr_expired;      /* connections closed for missing a deadline */
+  uint64_t nr_budget_hits;  /* connections held back for the next iteration */
+  uint64_t nr_accept_pauses;  /* times a listener stopped accepting */
+  uint64_t nr_shed;         /* accepted and closed for lack of descriptors */
+  uint64_t nr_errors[TCP_NR_ERROR_CLASSES];  /* contained socket failures */
+  double avg_batch;         /* nr_events / (spin_hits + block_wakeups) */
+};
+
+/* a reactor's socket for one of the server's listeners; TCP listeners
+ * have a SO_REUSEPORT socket per reactor, whereas a Unix listener's single
+ * socket is shared between them all
+ */
+typedef struct __int_tcp_listener
+{
+  struct __int_tcp_reactor* reactor;
+  const struct tcp_listener_config* config;
+  tcp_sockfd_t sockfd;
+  struct
+  {
+    bool accept_armed;
+  } uring;
+} *tcp_listener_t;
+
+/* handed to a reactor by any thread, and called back on the reactor's own
+ * thread; embedded into whatever it completes, like timers
+ */
+typedef struct tcp_completion
+{
+  struct tcp_completion* next;
+  void (*on_complete)(void* data);
+  void* data;
+} tcp_completion_t;
+
+/* a one-shot wait on a descriptor the server doesn't own becoming readable
+ * (or writable), e.g. an upstream connection; embedded into whatever waits
+ * on it, like completions
+ */
+typedef struct tcp_watch
+{
+  int fd;
+  bool writable;
+  /* called once per watch, on the reactor's thread, with `ready` unset if
+   * the watch was cancelled or the descriptor couldn't be polled
+   */
+  void (*on_ready)(void* data, bool ready);
+  void* data;
+} tcp_watch_t;
+
+/* an event backend owns a reactor's thread once it's started, and reports
+ * connection events through the same server callbacks as any other
+ */
+struct __int_tcp_backend
+{
+  const char* name;
+  /* connections have no socket, their `sockfd` only names them, and is
+   * never handed to the kernel
+   */
+  bool socketless;
+  void* (*run)(struct __int_tcp_reactor* reactor);
+  /* pushes the output queue towards the socket, false once the peer is
+   * gone; anything not written yet is left queued
+   */
+  bool (*flush)(tcp_client_t client);
+  /* starts or stops taking connections off the reactor's listeners,
+   * which are accepting from the moment the backend starts running
+   */
+  void (*set_accepting)(struct __int_tcp_reactor* reactor, bool accepting);
+  /* called on a closed client instead of freeing it, for backends that may
+   * still hold references to it; NULL frees it straight away
+   */
+  void (*release)(tcp_client_t client);
+  /* start and cancel a watch on the reactor's own thread, `watch` is false
+   * if the descriptor can't be waited on; a cancelled watch is still
+   * called back, possibly before `unwatch` returns
+   */
+  bool (*watch)(struct __int_tcp_reactor* reactor, tcp_watch_t* watch);
+  void (*unwatch)(struct __int_tcp_reactor* reactor, tcp_watch_t* watch);
+};
+
+typedef struct __int_tcp_reactor
+{
+  struct __int_tcpserver* server;
+  const struct __int_tcp_backend* backend;
+  void* backend_state;
+  size_t id;
+  int cpu;
+  pthread_t thread;
+  poller_t poller;
+  tcp_listener_t listeners;  /* one per listener of the server, in order */
+  size_t nr_listeners;
+  struct tcp_loop_stats stats;
+  timerwheel_t timers;  /* connection deadlines */
+  uint64_t iteration;   /* of the event loop */
+  int wake_fd;          /* eventfd, for other threads to get its attention */
+  /* pushed on by any thread without locking, and taken off all at once
+   * when woken up; newest first
+   */
+  tcp_completion_t* completions;
+  struct
+  {
+    bool requested;     /* set from any thread, or a signal handler */
+    bool active;
+    timerwheel_timer_t deadline;
+  } drain;
+  struct
+  {
+    size_t max_connections;  /* this reactor's share, 0 if unlimited */
+    size_t nr_connections;
+    /* held open to be given up when descriptors run out, so that pending
+     * connections can still be accepted, and closed straight away
+     */
+    int reserve_fd;
+    bool paused;
+    timerwheel_timer_t backoff;  /* armed while out of descriptors */
+  } accept;
+  struct
+  {
+    /* connections whose input was held back for lack of budget */
+    tcp_client_t head, tail;
+  } ready;
+  struct
+  {
+    tcp_client_t* by_fd;  /* the reactor's live clients, by descriptor */
+    size_t capacity;
+  } clients;
+  struct
+  {
+    tcp_watch_t** by_fd;  /* only kept by the epoll backend */
+    size_t capacity;
+    size_t nr_watches;    /* yet to be called back, a drain waits on them */
+  } watches;
+  struct
+  {
+    struct __int_tcp_client_slab* slabs;
+    tcp_client_t free;
+    size_t nr_clients, nr_live;
+  } pool;
+} *tcp_reactor_t;
+
+typedef struct __int_tcpserver
+{
+  struct
+  {
+    /* the address given on creation, if any, followed by the config's */
+    struct tcp_listener_config* listeners;
+    size_t nr_listeners;
     conn_backlog_t backlog;
+    bool handed_over;  /* Unix socket paths are left to the new instance */
   } __int_bind_info;
   struct
   {
@@ -98,8 +575,10 @@ typedef struct
       struct __int_tcp_client* clients;
       size_t nr_clients;
     };
-    struct __int_tcp_socket self;
+    struct __int_tcp_reactor* reactors;
+    size_t nr_reactors;
   } __int_stream;
+  struct tcp_server_config config;
   struct 
   {
     __int_callback_t client_connected;
@@ -107,6 +586,19 @@ typedef struct
     __int_callback_t client_readable;
     __int_callback_t client_writable;
   } callbacks;
+  struct
+  {
+    /* blocked in every reactor thread, and read off a signalfd by reactor
+     * #0 instead; only set up if any handlers were registered
+     */
+    int fd;
+    sigset_t mask;
+    struct
+    {
+      tcp_signal_fn fn;
+      void* data;
+    } handlers[NSIG];
+  } signals;
   __int_ts_start_event_loop_fn start_event_loop;
 }* tcpserver_t;
 
@@ -115,20 +607,89 @@ __THUNK_DECL void __int_set_recv_low_watermark (tcp_client_t self,
   size_t watermark);
 __THUNK_DECL recv_ret_t __int_ts_recv (tcp_client_t self, void* buf,
   size_t len);
-__THUNK_DECL recv_ret_t __int_ts_send (tcp_client_t self, void* buf,
+__THUNK_DECL send_ret_t __int_ts_send (tcp_client_t self, void* buf,
   size_t len);
+__THUNK_DECL send_ret_t __int_ts_sendv (tcp_client_t self,
+  const struct iovec* iov, int iovcnt, tcp_send_done_fn on_done, void* data);
+__THUNK_DECL send_ret_t __int_ts_sendfile (tcp_client_t self, int fd,
+  off_t offset, size_t len, tcp_send_done_fn on_done, void* data);
 __THUNK_DECL void __int_ts_start_event_loop (tcpserver_t server);
 __THUNK_DECL struct __int_tcp_conninfo __int_ts_getaddr (tcp_client_t self);
 __THUNK_DECL void __int_tcp_socket_free (tcp_client_t self);
 __THUNK_DECL void __int_ts_socket_close (tcp_client_t self);
 
-static struct __int_tcp_socket __int_create_tcp_socket (void);
+static tcp_sockfd_t __int_create_listen_socket (
+  const struct tcp_listener_config* listener, bool reuse_port);
+
+/* shared with the event backends */
+tcp_client_t __int_ts_new_client (tcp_listener_t listener, tcp_sockfd_t sockfd,
+  const struct sockaddr_storage* peer, socklen_t peer_len);
+tcp_client_t __int_ts_clients_get (tcp_reactor_t reactor, tcp_sockfd_t sockfd);
+tcp_client_t __int_ts_configure_client (tcp_reactor_t reactor,
+  tcp_client_t self);
+struct __int_tcp_tx_segment* __int_ts_tx_segment_at (tcp_client_t self,
+  size_t index);
+void __int_ts_tx_advance (tcp_client_t self, size_t nr_sent);
+void __int_ts_tx_discard (tcp_client_t self);
+send_ret_t __int_ts_tx_send_file (tcp_client_t self);
+void __int_ts_pin_reactor (tcp_reactor_t reactor);
+void __int_ts_shed_connections (tcp_reactor_t reactor, bool back_off);
+enum tcp_error_class __int_ts_count_error (tcp_reactor_t reactor, int err);
+uint64_t __int_ts_monotonic_us (void);
+void __int_ts_dispatch_connected (tcp_client_t client);
+void __int_ts_dispatch_readable (tcp_client_t client,
+  bool (*refill)(tcp_client_t client, size_t limit));
+void __int_ts_run_ready (tcp_reactor_t reactor,
+  bool (*refill)(tcp_client_t client, size_t limit));
+void __int_ts_dispatch_writable (tcp_client_t client);
+void __int_ts_dispatch_disconnected (tcp_client_t client);
+int __int_ts_block_timeout (tcp_reactor_t reactor);
+void __int_ts_expire_deadlines (tcp_reactor_t reactor);
+void __int_ts_on_wake (tcp_reactor_t reactor);
+void __int_ts_on_signals (tcp_reactor_t reactor);
+bool __int_ts_drained (tcp_reactor_t reactor);
+void __int_ts_begin_drain (tcp_reactor_t reactor);
 
 tcpserver_t __int_ts_create_with_bind (tcp_address_t address, tcp_port_t port);
+tcpserver_t __int_ts_create_with_config (tcp_address_t address,
+  tcp_port_t port, const struct tcp_server_config* config);
 void __int_ts_free (tcpserver_t server);
+struct tcp_loop_stats __int_ts_loop_stats (tcpserver_t server);
+void __int_ts_on_signal (tcpserver_t server, int signum, tcp_signal_fn fn,
+  void* data);
+void __int_ts_drain (tcpserver_t server);
+void __int_ts_complete (tcp_reactor_t reactor, tcp_completion_t* completion);
+bool __int_ts_watch (tcp_reactor_t reactor, tcp_watch_t* watch);
+void __int_ts_unwatch (tcp_reactor_t reactor, tcp_watch_t* watch);
+void __int_ts_resume_reading (tcp_client_t client);
+bool __int_ts_hand_over (tcpserver_t server, int sockfd);
 
 struct __g_tcpserver {
   typeof (__int_ts_create_with_bind)* create_and_bind_to;
+  typeof (__int_ts_create_with_config)* create_and_bind_with;
+  typeof (__int_ts_loop_stats)* loop_stats;
+  /* registers a handler for `signum`, before the event loop is started */
+  typeof (__int_ts_on_signal)* on_signal;
+  /* stops accepting and lets open connections finish, the event loop
+   * returns once they have; safe to call from any thread or signal handler
+   */
+  typeof (__int_ts_drain)* drain;
+  /* passes the listening sockets to the instance on the other end of the
+   * Unix socket `sockfd`, and waits for it to take them up
+   */
+  typeof (__int_ts_hand_over)* hand_over;
+  /* calls `completion` back on `reactor`'s thread, and is safe to call
+   * from any thread; completions still pending once the event loop has
+   * returned are called back when the server is freed
+   */
+  typeof (__int_ts_complete)* complete;
+  /* waits on `watch` from `reactor`'s event loop, see `tcp_watch_t` */
+  typeof (__int_ts_watch)* watch;
+  typeof (__int_ts_unwatch)* unwatch;
+  /* hands `client` to its readable callback again next iteration, for a
+   * callback that left input in the receive ring and has since made room
+   */
+  typeof (__int_ts_resume_reading)* resume_reading;
   typeof (__int_ts_free)* free;
 };
 
@@ -0,0 +1,31 @@
+#ifndef __TCP_URING_H
+#define __TCP_URING_H
+
+#include "tcpserver.h"
+
+#ifdef TCP_HAVE_IO_URING
+#include <linux/io_uring.h>
+
+/* each reactor gets its own ring, and its own group of provided buffers
+ * which multishot receives pick from; a connection only holds on to a
+ * buffer until its contents are copied into the connection's receive ring
+ */
+#define TCP_URING_SQ_ENTRIES (1024)
+#define TCP_URING_NR_BUFFERS (512)  /* must be a power of two */
+#define TCP_URING_BUFFER_SIZE (4096)
+#define TCP_URING_BUFFER_GROUP (0)
+
+#if TCP_URING_NR_BUFFERS & (TCP_URING_NR_BUFFERS - 1)
+# pragma GCC error "TCP_URING_NR_BUFFERS must be a power of two"
+#endif
+
+struct __int_tcp_uring_chunk
+{
+  uint16_t bid;
+  uint32_t offset, len;
+};
+
+extern const struct __int_tcp_backend __int_ts_uring_backend;
+#endif /* TCP_HAVE_IO_URING */
+
+#endif /* __TCP_URING_H */
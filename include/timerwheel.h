@@ -0,0 +1,91 @@
+#ifndef __TIMERWHEEL_H
+#define __TIMERWHEEL_H
+
+#include "thunks.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* a hierarchical timer wheel: every level has TIMERWHEEL_SLOTS slots, and
+ * each slot of a level spans one whole turn of the level below it; timers
+ * due far out wait in coarse slots and cascade down as their deadline
+ * draws near, which keeps arming, cancelling and expiring O(1) without
+ * ever scanning the armed timers
+ *
+ * with 1ms ticks the wheel reaches about 4.6 hours ahead, timers due later
+ * than that are clamped to its horizon
+ */
+#define TIMERWHEEL_SLOT_BITS (6)
+#define TIMERWHEEL_SLOTS (1 << TIMERWHEEL_SLOT_BITS)
+#define TIMERWHEEL_LEVELS (4)
+#define DEFAULT_TIMERWHEEL_TICK_MS (1)
+
+typedef void (*timerwheel_expiry_fn)(void* data);
+
+/* timers are embedded into whatever they time, the wheel never allocates */
+typedef struct timerwheel_timer
+{
+  struct timerwheel_timer* next;
+  struct timerwheel_timer** pprev;  /* NULL while not armed */
+  uint64_t expires;                 /* in ticks */
+  uint8_t level, slot;
+  timerwheel_expiry_fn on_expiry;
+  void* data;
+} timerwheel_timer_t;
+
+static inline bool
+timerwheel_is_armed (const timerwheel_timer_t* timer)
+{
+  return timer->pprev != NULL;
+}
+
+__THUNK_DECL void timerwheel_arm_thunk (timerwheel_timer_t* timer,
+  uint64_t timeout_ms);
+__THUNK_DECL void timerwheel_cancel_thunk (timerwheel_timer_t* timer);
+__THUNK_DECL size_t timerwheel_advance_thunk (uint64_t now_ms);
+__THUNK_DECL int timerwheel_next_timeout_thunk (void);
+__THUNK_DECL void timerwheel_free_thunk (void);
+
+typedef struct cnt_timerwheel
+{
+  typeof (timerwheel_free_thunk)* free;
+  struct
+  {
+    timerwheel_timer_t* slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+    uint64_t occupied[TIMERWHEEL_LEVELS];  /* a bit per non-empty slot */
+    uint64_t now;       /* the next tick to process */
+    uint64_t base_ms;   /* time of tick 0 */
+    uint64_t last_ms;   /* time of the last advance */
+    uint64_t tick_ms;
+    size_t nr_timers;
+  } __int;
+  /* (re)arms `timer` to expire `timeout_ms` from the last advance, never
+   * earlier; expiry disarms the timer before `on_expiry` is called, which
+   * may arm or cancel any timer, including the expiring one
+   */
+  typeof (timerwheel_arm_thunk)* arm;
+  typeof (timerwheel_cancel_thunk)* cancel;
+  /* expires every timer due by `now_ms`, returns how many did */
+  typeof (timerwheel_advance_thunk)* advance;
+  /* milliseconds until the wheel next needs advancing, -1 when idle */
+  typeof (timerwheel_next_timeout_thunk)* next_timeout;
+} *timerwheel_t;
+
+void timerwheel_arm (timerwheel_t wheel, timerwheel_timer_t* timer,
+  uint64_t timeout_ms);
+void timerwheel_cancel (timerwheel_t wheel, timerwheel_timer_t* timer);
+size_t timerwheel_advance (timerwheel_t wheel, uint64_t now_ms);
+int timerwheel_next_timeout (timerwheel_t wheel);
+void timerwheel_free (timerwheel_t wheel);
+
+timerwheel_t timerwheel_new (uint64_t tick_ms, uint64_t now_ms);
+
+struct __g_timerwheel
+{
+  typeof (timerwheel_new)* new;
+};
+
+extern struct __g_timerwheel g_timerwheel;
+
+#endif /* __TIMERWHEEL_H */
@@ -0,0 +1,82 @@
+#ifndef __WORKPOOL_H
+#define __WORKPOOL_H
+
+#include "thunks.h"
+#include "common.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* a fixed set of threads taking jobs off a bounded FIFO queue, for work
+ * that would stall whoever had to do it inline; a job submitted while the
+ * queue is full is turned away rather than waited on, so the submitter can
+ * shed it instead of piling up latency
+ */
+#define DEFAULT_WORKPOOL_THREADS (4)
+#define DEFAULT_WORKPOOL_MAX_QUEUED (256)
+
+typedef void (*workpool_job_fn)(void* data);
+
+/* jobs are embedded into whatever they work on, the pool never allocates */
+typedef struct workpool_job
+{
+  struct workpool_job* next;
+  uint64_t queued_us;  /* when it was submitted */
+  workpool_job_fn run;
+  void* data;
+} workpool_job_t;
+
+struct workpool_stats
+{
+  size_t nr_queued;         /* waiting on a thread at the time */
+  size_t max_queued;        /* the most ever waiting at once */
+  uint64_t nr_submitted;    /* taken on, run or not */
+  uint64_t nr_rejected;     /* turned away for a full queue */
+  uint64_t nr_completed;
+  uint64_t total_wait_us;   /* spent queued, across the jobs started */
+  uint64_t max_wait_us;
+  double avg_wait_us;       /* total_wait_us / jobs started */
+};
+
+__THUNK_DECL bool workpool_submit_thunk (workpool_job_t* job);
+__THUNK_DECL void workpool_free_thunk (void);
+
+typedef struct cnt_workpool
+{
+  typeof (workpool_free_thunk)* free;
+  struct
+  {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    workpool_job_t *head, *tail;
+    pthread_t* threads;
+    size_t nr_threads, max_queued;
+    bool stopping;
+    struct workpool_stats stats;  /* guarded by `lock` */
+  } __int;
+  /* queues `job` to be run on one of the pool's threads, which may be
+   * before this returns; false if the queue is full, `job` is then left
+   * to the caller
+   */
+  typeof (workpool_submit_thunk)* submit;
+} *workpool_t;
+
+bool workpool_submit (workpool_t pool, workpool_job_t* job);
+void workpool_free (workpool_t pool);
+struct workpool_stats workpool_stats (workpool_t pool);
+
+/* threads are started with every signal blocked, signals are left to the
+ * threads that expect them; 0 for either takes its default
+ */
+workpool_t workpool_new (size_t nr_threads, size_t max_queued);
+
+struct __g_workpool
+{
+  typeof (workpool_new)* new;
+  typeof (workpool_stats)* stats;
+};
+
+extern struct __g_workpool g_workpool;
+
+#endif /* __WORKPOOL_H */
@@ -0,0 +1,158 @@
+#include "../include/coroutine.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static __thread coroutine_t coroutine_running;
+
+static void
+coroutine_entry (void)
+{
+  /* makecontext() only passes ints, the coroutine is picked up instead */
+  coroutine_t coroutine = coroutine_running;
+  coroutine->fn (coroutine->data);
+  coroutine->finished = true;
+}  /* and on to `uc_link`, i.e. the last resume */
+
+static coroutine_t
+coropool_map (coropool_t pool)
+{
+  coroutine_t coroutine = calloc_ptr_type (coroutine_t);
+  size_t mapping = pool->__int.page_size + pool->__int.stack_size;
+  coroutine->stack = mmap (NULL, mapping, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (coroutine->stack == MAP_FAILED)
+    panic ("failed to map coroutine stack (size=%zu): %s", mapping,
+           strerror (errno));
+  /* stacks grow down, so the guard goes at the bottom */
+  if (mprotect (coroutine->stack, pool->__int.page_size, PROT_NONE) == -1)
+    panic ("failed to protect coroutine stack guard page: %s",
+           strerror (errno));
+  coroutine->pool = pool;
+  return coroutine;
+}
+
+static void
+coropool_unmap (coroutine_t coroutine)
+{
+  coropool_t pool = coroutine->pool;
+  munmap (coroutine->stack, pool->__int.page_size + pool->__int.stack_size);
+  free (coroutine);
+}
+
+coroutine_t
+coropool_spawn (coropool_t pool, coroutine_fn fn, void* data)
+{
+  coroutine_t coroutine = pool->__int.pooled;
+  if (coroutine != NULL)
+    {
+      pool->__int.pooled = coroutine->next_free;
+      --pool->__int.nr_pooled;
+    }
+  else
+    coroutine = coropool_map (pool);
+  if (getcontext (&coroutine->context) == -1)
+    panic ("failed to get coroutine context: %s", strerror (errno));
+  coroutine->context.uc_stack.ss_sp = coroutine->stack
+                                      + pool->__int.page_size;
+  coroutine->context.uc_stack.ss_size = pool->__int.stack_size;
+  coroutine->context.uc_link = &coroutine->caller;
+  makecontext (&coroutine->context, coroutine_entry, 0);
+  coroutine->fn = fn;
+  coroutine->data = data;
+  coroutine->finished = false;
+  if (++pool->__int.nr_live > pool->__int.max_live)
+    pool->__int.max_live = pool->__int.nr_live;
+  return coroutine;
+}
+
+bool
+coroutine_resume (coroutine_t coroutine)
+{
+  /* a coroutine may resume another, and gets the thread back after */
+  coroutine_t resumer = coroutine_running;
+  coroutine_running = coroutine;
+  if (swapcontext (&coroutine->caller, &coroutine->context) == -1)
+    panic ("failed to switch to coroutine: %s", strerror (errno));
+  coroutine_running = resumer;
+  if (!coroutine->finished)
+    return true;
+
+  coropool_t pool = coroutine->pool;
+  --pool->__int.nr_live;
+  if (pool->__int.nr_pooled < pool->__int.max_pooled)
+    {
+      coroutine->next_free = pool->__int.pooled;
+      pool->__int.pooled = coroutine;
+      ++pool->__int.nr_pooled;
+    }
+  else
+    coropool_unmap (coroutine);
+  return false;
+}
+
+void
+coroutine_yield (void)
+{
+  coroutine_t coroutine = coroutine_running;
+  if (coroutine == NULL)
+    panic ("can't yield outside of a coroutine");
+  if (swapcontext (&coroutine->context, &coroutine->caller) == -1)
+    panic ("failed to switch out of coroutine: %s", strerror (errno));
+}
+
+coroutine_t
+coroutine_current (void)
+{
+  return coroutine_running;
+}
+
+void
+coropool_free (coropool_t pool)
+{
+  if (pool->__int.nr_live)
+    warn ("freeing coroutine pool with %zu coroutine(s) suspended",
+          pool->__int.nr_live);
+  while (pool->__int.pooled != NULL)
+    {
+      coroutine_t coroutine = pool->__int.pooled;
+      pool->__int.pooled = coroutine->next_free;
+      coropool_unmap (coroutine);
+    }
+  g_thunks.deallocate_thunk (pool->spawn);
+  g_thunks.deallocate_thunk (pool->free);
+  free (pool);
+}
+
+coropool_t
+coropool_new (size_t stack_size, size_t max_pooled)
+{
+  coropool_t pool = calloc_ptr_type (coropool_t);
+  { /* initialize pool structure */
+    size_t page_size = sysconf (_SC_PAGESIZE);
+    if (!stack_size)
+      stack_size = DEFAULT_COROUTINE_STACK_SIZE;
+    pool->__int.page_size = page_size;
+    pool->__int.stack_size = (stack_size + page_size - 1) & ~(page_size - 1);
+    pool->__int.max_pooled = max_pooled? max_pooled
+                                       : DEFAULT_COROUTINE_MAX_POOLED;
+  }
+  { /* allocate pool thunks */
+    pool->spawn = g_thunks.allocate_thunk (
+      "coropool_spawn",
+      coropool_spawn, pool
+    );
+    pool->free = g_thunks.allocate_thunk (
+      "coropool_free",
+      coropool_free, pool
+    );
+  }
+  return pool;
+}
+
+struct __g_coroutine g_coroutine = {
+  .new_pool = coropool_new,
+  .resume = coroutine_resume,
+  .yield = coroutine_yield,
+  .current = coroutine_current
+};
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "../include/httpserver.h"
 #include "../include/httpimpl.h"
 #include "../include/thunks.h"
@@ -29,94 +30,363 @@ __int_cb_register_callbacks (httpserver_t server)
     );
 }
 
-static recv_ret_t sz_initial_recv = ALG_INCR_INITIAL_RECV;
+static struct __int_route*
+__int_http_match_route (route_table_t route_table, const char* path)
+{
+  for (size_t i = 0; i < route_table->nr_routes; ++i)
+    if (route_table->routes[i].match (path))
+      return &route_table->routes[i];
+  return NULL;
+}
+
+static void
+__int_http_response_sent (tcp_client_t who, void* head, bool sent)
+{
+  if (!sent)
+    cb_debug ("client went away before the response was sent: %p", who);
+  free (head);
+}
+
+static void
+__int_http_respond (tcp_client_t who, unsigned int status,
+  const char* reason, const char* body)
+{
+  /* the head and body go out as separate segments of one gather-write, the
+   * body is borrowed and the head is released once it has been sent
+   */
+  size_t sz_body = strlen (body);
+  char* head;
+  int sz_head = asprintf (
+    &head,
+    "HTTP/1.1 %u %s" "\r\n"
+    "Content-Length: %zu" "\r\n"
+    "Connection: close" "\r\n"
+    "\r\n",
+    status, reason, sz_body
+  );
+  if (sz_head == -1)
+    panic ("failed to format HTTP response head");
+  struct iovec response[] = {
+    {.iov_base = head, .iov_len = sz_head},
+    {.iov_base = (void*)body, .iov_len = sz_body}
+  };
+  who->connection.op.sendv (
+    response, sizeof (response) / sizeof (*response),
+    __int_http_response_sent, head
+  );
+}
 
-static recv_ret_t
-__int_sk_incremental_find (
-  tcp_client_t from, char ** into, const char *const pattern)
+/* a request whose response is left to its handler, hung off `who->data`
+ * until it's answered; input and the client going away are passed on
+ */
+struct __int_http_pending
 {
-  size_t sz_pattern = strlen (pattern);
-  if (!sz_pattern)
-    panic ("search pattern is empty");
-  char* search_buffer = malloc (sz_initial_recv);
-  recv_ret_t sz_recv = sz_initial_recv,
-             offset = 0, pos = -1;
-  if (search_buffer == NULL)
-    panic ("failed to allocate search buffer (size = %d)", sz_initial_recv);
-  while (true)
+  void (*on_readable)(tcp_client_t who);
+  void (*on_disconnected)(tcp_client_t who);
+};
+
+/* a request whose route is offloaded, from being queued on the work pool
+ * until it's answered back on the reactor that took it
+ */
+struct __int_http_offload
+{
+  struct __int_http_pending pending;
+  workpool_job_t job;
+  tcp_completion_t completion;
+  tcp_reactor_t reactor;
+  tcp_client_t who;
+  route_handler_fn handler;
+  bool cancelled;  /* the client went away meanwhile */
+};
+
+static void
+__int_http_offload_run (void* data)
+{
+  /* on a pool thread, the client is only touched again on its reactor */
+  struct __int_http_offload* offload = data;
+  if (!__atomic_load_n (&offload->cancelled, __ATOMIC_ACQUIRE))
+    offload->handler ();
+  g_tcpserver.complete (offload->reactor, &offload->completion);
+}
+
+static void
+__int_http_offload_done (void* data)
+{
+  struct __int_http_offload* offload = data;
+  if (!offload->cancelled)
     {
-      recv_ret_t nr_recv = from->connection.op.peek (search_buffer, sz_recv);
-      if (!nr_recv)
-        return -1;
-      for (size_t i = offset; i < nr_recv; ++i)
-        {
-          if (strncmp (&search_buffer[i], pattern, sz_pattern))
-            {
-              if ((search_buffer[i] == pattern[0])
-                  && (i >= nr_recv - sz_pattern - 1))
-                {
-                  offset = i - sz_pattern;
-                  break;
-                }
-              else
-                offset = i;
-              continue;
-            }
-          else
-            {
-              search_buffer[i + sz_pattern] = '\0';
-              *into = search_buffer;
-              sz_initial_recv = (sz_initial_recv + nr_recv) / 2;
-              return i + sz_pattern;
-            }
-        }
-      sz_recv = sz_recv / 2 + nr_recv;
-      search_buffer = realloc (search_buffer, sz_recv);
+      offload->who->data = NULL;
+      offload->who->connection.answering = false;
+      __int_http_respond (offload->who, 200, "OK", "");
+      offload->who->connection.op.close ();
     }
-  if (pos == -1)
-    free (search_buffer);
-  return pos;
+  free (offload);
 }
 
-static raw_httpheader_t
-__int_http_read_header_line (tcp_client_t from)
+static void
+__int_http_offload_readable (tcp_client_t who)
 {
-  raw_httpheader_t header;
-  recv_ret_t sz_header = __int_sk_incremental_find (from, &header, "\r\n");
-  if (sz_header == -1)
-    return NULL;
-  from->connection.op.recv (NULL, sz_header);
-  return header;
+  /* the connection is closed once it's answered, so anything sent
+   * meanwhile is dropped
+   */
+  ringbuf_t rx = who->connection.rx;
+  rx->consume (rx->readable ());
 }
 
-__THUNK_DECL void
-__int_cb_client_connected (httpserver_t this, tcp_client_t who)
+static void
+__int_http_offload_disconnected (tcp_client_t who)
 {
-  cb_debug ("client connected: %s:%d", who->info.address, who->info.port);
+  /* freed once it's back from the pool, the handler is skipped if it
+   * hasn't been started yet
+   */
+  struct __int_http_offload* offload = who->data;
+  __atomic_store_n (&offload->cancelled, true, __ATOMIC_RELEASE);
 }
 
-__THUNK_DECL void
-__int_cb_client_disconnected (httpserver_t this, tcp_client_t who)
+static bool
+__int_http_offload (httpserver_t this, tcp_client_t who,
+  struct __int_route* route)
 {
-  cb_debug ("client disconnected: %p", who);
+  /* the connection is kept open, and its input ignored, until the handler
+   * has run; the read deadline doesn't hold for the server's own work
+   */
+  struct __int_http_offload* offload = malloc (sizeof (*offload));
+  if (offload == NULL)
+    panic ("failed to allocate offloaded request");
+  *offload = (struct __int_http_offload){
+    .pending = {
+      .on_readable = __int_http_offload_readable,
+      .on_disconnected = __int_http_offload_disconnected
+    },
+    .job = {.run = __int_http_offload_run, .data = offload},
+    .completion = {.on_complete = __int_http_offload_done, .data = offload},
+    .reactor = who->reactor,
+    .who = who,
+    .handler = route->handler
+  };
+  who->data = offload;
+  if (!this->__int.offload->submit (&offload->job))
+    {
+      who->data = NULL;
+      free (offload);
+      return false;
+    }
+  who->connection.cfg.set_deadline (TCP_DEADLINE_NONE);
+  who->connection.answering = true;
+  return true;
 }
 
-__THUNK_DECL void
-__int_cb_client_readable (httpserver_t this, tcp_client_t who)
+/* a request whose route runs as a coroutine on its reactor, switched to
+ * whenever what it waits on is ready, and answered once it returns
+ */
+struct __int_http_coroutine
 {
-  void  /* intellisense doesn't like nested functions */
-  when_parser_fails (const char* msg, httpmethodline_t methodline)
+  struct __int_http_pending pending;
+  tcp_client_t who;
+  route_handler_fn handler;
+  coroutine_t coroutine;
+  tcp_watch_t watch;
+  enum
   {
-    cb_error ("HTTP request failed to parse methodline: '%s'", msg);
-    who->connection.op.close ();
-    /* this may double-free when malloc() already failed in
-     * `g_http_methods.parse_methodline`, but at that point
-     * we're already in a bad state, and we can accept our fate
-     */
-    if (methodline != NULL)
-      free (methodline);
-  }
-  void
+    HTTP_COROUTINE_RUNNING = 0,
+    HTTP_COROUTINE_WAIT_INPUT,
+    HTTP_COROUTINE_WAIT_FD
+  } waiting;
+  bool watch_ready;
+  bool gone;  /* the client went away, `who` isn't to be touched */
+};
+
+static void
+__int_http_coroutine_run (void* data)
+{
+  struct __int_http_coroutine* co = data;
+  co->handler ();
+}
+
+static void
+__int_http_coroutine_resume (struct __int_http_coroutine* co)
+{
+  co->waiting = HTTP_COROUTINE_RUNNING;
+  if (g_coroutine.resume (co->coroutine))
+    return;
+  if (!co->gone)
+    {
+      co->who->data = NULL;
+      co->who->connection.answering = false;
+      __int_http_respond (co->who, 200, "OK", "");
+      co->who->connection.op.close ();
+    }
+  free (co);
+}
+
+static void
+__int_http_coroutine_readable (tcp_client_t who)
+{
+  /* anything sent while the handler is busy stays buffered for it */
+  struct __int_http_coroutine* co = who->data;
+  if (co->waiting == HTTP_COROUTINE_WAIT_INPUT)
+    __int_http_coroutine_resume (co);
+}
+
+static void
+__int_http_coroutine_disconnected (tcp_client_t who)
+{
+  /* a handler that's waiting is woken up to find its client gone, and
+   * finishes from here or once its watch is called back
+   */
+  struct __int_http_coroutine* co = who->data;
+  co->gone = true;
+  if (co->waiting == HTTP_COROUTINE_WAIT_INPUT)
+    __int_http_coroutine_resume (co);
+  else if (co->waiting == HTTP_COROUTINE_WAIT_FD)
+    g_tcpserver.unwatch (who->reactor, &co->watch);
+}
+
+static void
+__int_http_coroutine_watched (void* data, bool ready)
+{
+  struct __int_http_coroutine* co = data;
+  co->watch_ready = ready;
+  __int_http_coroutine_resume (co);
+}
+
+static void
+__int_http_coroutine (httpserver_t this, tcp_client_t who,
+  struct __int_route* route)
+{
+  /* runs up to its first wait straight away, the read deadline only holds
+   * while it waits on the client
+   */
+  struct __int_http_coroutine* co = calloc (1, sizeof (*co));
+  if (co == NULL)
+    panic ("failed to allocate coroutine request");
+  co->pending = (struct __int_http_pending){
+    .on_readable = __int_http_coroutine_readable,
+    .on_disconnected = __int_http_coroutine_disconnected
+  };
+  co->who = who;
+  co->handler = route->handler;
+  co->coroutine = this->__int.coroutines[who->reactor->id]->spawn (
+    __int_http_coroutine_run, co
+  );
+  who->data = co;
+  who->connection.cfg.set_deadline (TCP_DEADLINE_NONE);
+  who->connection.answering = true;
+  __int_http_coroutine_resume (co);
+}
+
+static struct __int_http_coroutine*
+__int_http_coroutine_current (void)
+{
+  /* coroutines are only ever spawned for requests */
+  coroutine_t coroutine = g_coroutine.current ();
+  return coroutine != NULL? coroutine->data: NULL;
+}
+
+ssize_t
+__int_route_read (void* buf, size_t len)
+{
+  struct __int_http_coroutine* co = __int_http_coroutine_current ();
+  if (co == NULL)
+    return -1;
+  while (!co->gone)
+    {
+      ringbuf_t rx = co->who->connection.rx;
+      size_t nr_buffered = rx->readable ();
+      if (nr_buffered)
+        {
+          /* a full ring isn't refilled until it's been made room in */
+          bool was_full = !rx->writable ();
+          size_t nr_read = nr_buffered < len? nr_buffered: len;
+          memcpy (buf, rx->read_ptr (), nr_read);
+          rx->consume (nr_read);
+          if (was_full)
+            g_tcpserver.resume_reading (co->who);
+          return nr_read;
+        }
+      if (co->who->connection.read_closed)
+        return 0;
+      /* a client that stops sending while it's being read from has gone */
+      co->who->connection.cfg.set_deadline (TCP_DEADLINE_BODY_READ);
+      co->who->connection.answering = false;
+      co->waiting = HTTP_COROUTINE_WAIT_INPUT;
+      g_coroutine.yield ();
+      if (!co->gone)
+        {
+          co->who->connection.cfg.set_deadline (TCP_DEADLINE_NONE);
+          co->who->connection.answering = true;
+        }
+    }
+  return -1;
+}
+
+bool
+__int_route_wait_fd (int fd, bool writable)
+{
+  struct __int_http_coroutine* co = __int_http_coroutine_current ();
+  if (co == NULL || co->gone)
+    return false;
+  co->watch = (tcp_watch_t){
+    .fd = fd,
+    .writable = writable,
+    .on_ready = __int_http_coroutine_watched,
+    .data = co
+  };
+  if (!g_tcpserver.watch (co->who->reactor, &co->watch))
+    return false;
+  co->waiting = HTTP_COROUTINE_WAIT_FD;
+  g_coroutine.yield ();
+  return co->watch_ready && !co->gone;
+}
+
+struct __g_route_io g_route_io = {
+  .read = __int_route_read,
+  .wait_fd = __int_route_wait_fd
+};
+
+static bool
+__int_http_dispatch (httpserver_t this, tcp_client_t who,
+  httpmethodline_t method_line)
+{
+  /* false if the response is left to an offloaded or coroutine handler */
+  struct __int_route* route = __int_http_match_route (
+    this->__int.route_table, method_line->path
+  );
+  if (route == NULL || route->handler == NULL)
+    {
+      cb_debug ("no route for '%s'", method_line->path);
+      __int_http_respond (who, 404, "Not Found", "404 Not Found\n");
+      return true;
+    }
+  cb_debug ("dispatching '%s' to %s%s", method_line->path,
+            route->__int_ident.identifier,
+            route->mode == ROUTE_OFFLOAD? " (offloaded)"
+            : route->mode == ROUTE_COROUTINE? " (coroutine)": "");
+  if (route->mode == ROUTE_COROUTINE)
+    {
+      __int_http_coroutine (this, who, route);
+      return false;
+    }
+  if (route->mode == ROUTE_OFFLOAD)
+    {
+      if (__int_http_offload (this, who, route))
+        return false;
+      /* shed rather than queued behind a backlog it would only add to */
+      cb_debug ("work pool is full, rejecting '%s'", method_line->path);
+      __int_http_respond (who, 503, "Service Unavailable",
+                          "503 Service Unavailable\n");
+      return true;
+    }
+  route->handler ();
+  __int_http_respond (who, 200, "OK", "");
+  return true;
+}
+
+static void
+__int_http_request (httpserver_t this, tcp_client_t who, httphead_t head,
+  char* buf)
+{
+  void  /* intellisense doesn't like nested functions */
   when_context_fails (const char* msg, httpcontext_t context)
   {
     cb_error ("HTTP request failed to parse headers: '%s'", msg);
@@ -124,46 +394,154 @@ __int_cb_client_readable (httpserver_t this, tcp_client_t who)
     if (context != NULL)
       context->free ();
   }
+  g_httpparse.terminate (head, buf);
+  struct httpmethodline method_line;
+  g_http_methods.parse_methodline (head, buf, &method_line);
 #pragma GCC diagnostic ignored "-Wuninitialized"
 #pragma GCC diagnostic push
-  httpmethodline_t method_line =
-    g_http_methods.parse_methodline (__int_http_read_header_line (who))
-    .try_unwrap ((result_action_t){
-      .otherwise = when_parser_fails,
-      .pass_on = method_line
-    });
-  if (method_line == NULL)
-    return;
   httpcontext_t context = g_http_methods.create_context ();
-  while (true)
+  for (size_t i = 0; i < head->nr_headers; ++i)
     {
-      httpheader_t header =
-        g_http_methods.parse_headerline (__int_http_read_header_line (who))
-        .try_unwrap ((result_action_t){
-          .otherwise = when_parser_fails,
-          .pass_on = header
-        });
-      if (header == NULL)
-        break;
-      context->update_from_header (header).try_unwrap ((result_action_t){
+      struct httpheader header;
+      context->update_from_header (
+        g_http_methods.parse_headerline (head, buf, i, &header)
+      ).try_unwrap ((result_action_t){
         .otherwise = when_context_fails,
         .pass_on = context
       });
       if (who->connection.closed)
-        goto finalize;
+        return;
     }
-  hashmap_for_each_entry (context->connection.aux_headers, entry)
+  if (context->connection.aux_headers != NULL)
     {
-      cb_debug ("'%s': '%s'", entry->key, entry->value);
+      hashmap_for_each_entry (context->connection.aux_headers, entry)
+        {
+          cb_debug ("'%s': '%s'", entry->key, entry->value);
+        }
     }
-  who->connection.op.close ();
-finalize:
+  /* whatever follows is the body, for a coroutine handler to read; the
+   * head stays where it is meanwhile, the ring is only refilled once this
+   * has returned
+   */
+  who->connection.rx->consume (head->length);
+  if (__int_http_dispatch (this, who, &method_line))
+    who->connection.op.close ();
   cb_debug ("finalising HTTP request, deallocating resources");
   context->free ();
-  free (method_line);
 #pragma GCC diagnostic pop  
 }
 
+/* a request head that has arrived in part, kept with its connection and
+ * parsed on from where it ran out once more has arrived
+ */
+struct __int_http_parsing
+{
+  struct __int_http_pending pending;
+  httpserver_t server;
+  struct httphead head;
+};
+
+static void __int_http_read_head (httpserver_t this, tcp_client_t who,
+  httphead_t head, struct __int_http_parsing* parsing);
+
+static void
+__int_http_parsing_readable (tcp_client_t who)
+{
+  struct __int_http_parsing* parsing = who->data;
+  __int_http_read_head (parsing->server, who, &parsing->head, parsing);
+}
+
+static void
+__int_http_parsing_disconnected (tcp_client_t who)
+{
+  free (who->data);
+}
+
+static void
+__int_http_read_head (httpserver_t this, tcp_client_t who, httphead_t head,
+  struct __int_http_parsing* parsing)
+{
+  /* `parsing` is NULL until the head is found to be incomplete, which most
+   * aren't, the parse is only moved off the stack then
+   */
+  ringbuf_t rx = who->connection.rx;
+  char* buf = rx->read_ptr ();
+  switch (g_httpparse.head (head, buf, rx->readable ()))
+    {
+    case HTTPPARSE_NEED_MORE:
+      if (!rx->writable ())
+        {
+          cb_error ("HTTP request head exceeds the receive buffer");
+          break;
+        }
+      if (parsing == NULL)
+        {
+          parsing = malloc (sizeof (*parsing));
+          if (parsing == NULL)
+            panic ("failed to allocate partial request head");
+          parsing->pending = (struct __int_http_pending){
+            .on_readable = __int_http_parsing_readable,
+            .on_disconnected = __int_http_parsing_disconnected
+          };
+          parsing->server = this;
+          parsing->head = *head;
+          who->data = parsing;
+        }
+      /* the clock starts with the first byte of the head */
+      who->connection.cfg.set_deadline (TCP_DEADLINE_HEADER_READ);
+      return;
+    case HTTPPARSE_ERROR:
+      cb_error ("HTTP request failed to parse: '%s'", head->error);
+      break;
+    case HTTPPARSE_DONE:
+      who->data = NULL;
+      __int_http_request (this, who, head, buf);
+      free (parsing);
+      return;
+    }
+  who->data = NULL;
+  free (parsing);
+  who->connection.op.close ();
+}
+
+__THUNK_DECL void
+__int_cb_client_connected (httpserver_t this, tcp_client_t who)
+{
+  __auto_type conninfo = who->connection.op.get_address ();
+  if (conninfo.address == NULL)
+    return;  /* gone already */
+  cb_debug ("client connected: %s:%d", conninfo.address, conninfo.port);
+  who->connection.cfg.set_deadline (TCP_DEADLINE_IDLE);
+}
+
+__THUNK_DECL void
+__int_cb_client_disconnected (httpserver_t this, tcp_client_t who)
+{
+  cb_debug ("client disconnected: %p", who);
+  struct __int_http_pending* pending = who->data;
+  if (pending != NULL)
+    {
+      pending->on_disconnected (who);
+      who->data = NULL;
+    }
+}
+
+__THUNK_DECL void
+__int_cb_client_readable (httpserver_t this, tcp_client_t who)
+{
+  if (who->data != NULL)
+    {
+      /* a request is still being read or handled, and decides what becomes
+       * of anything sent meanwhile
+       */
+      ((struct __int_http_pending*)who->data)->on_readable (who);
+      return;
+    }
+  struct httphead head;
+  g_httpparse.begin (&head);
+  __int_http_read_head (this, who, &head, NULL);
+}
+
 __THUNK_DECL void
 __int_cb_client_writable (httpserver_t this, tcp_client_t who)
 {
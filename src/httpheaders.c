@@ -0,0 +1,204 @@
+#include "../include/httpheaders.h"
+#include "../include/httpscan.h"
+#include "../include/common.h"
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+/* a multiplicative hash of the length and the first and last four bytes,
+ * or all of them if fewer, with every byte's 0x20 bit set so that letters
+ * hash the same by either case
+ */
+#define HTTPHEADER_FOLD (0x20202020)
+/* multipliers are tried from the first on, stepping by an even amount to
+ * keep them odd, so every run lands on the same one
+ */
+#define HTTPHEADER_FIRST_MULTIPLIER (0x9e3779b1)
+#define HTTPHEADER_MULTIPLIER_STEP (0x6a09e668)
+#define HTTPHEADER_MAX_TRIES (1 << 16)
+
+_Static_assert (HTTPHEADER_OTHER < 256,
+                "header types must fit the slots they're kept in");
+
+/* the known names by their hashes, built from `httpheader_value_names` at
+ * startup under a multiplier that gives each its own slot; slots no name
+ * lands on are `HTTPHEADER_OTHER`
+ */
+static struct
+{
+  uint32_t multiplier;
+  size_t min_length, max_length;
+  uint8_t slots[256];
+} httpheader_table;
+
+static inline uint8_t
+httpheader_hash (const char* name, size_t len, uint32_t multiplier)
+{
+  uint32_t first = 0, last = 0;
+  if (len >= 4)
+    {
+      memcpy (&first, name, 4);
+      memcpy (&last, name + len - 4, 4);
+    }
+  else
+    {
+      memcpy (&first, name, len);
+      last = first;
+    }
+  uint32_t key = (first | HTTPHEADER_FOLD) ^ ((last | HTTPHEADER_FOLD) << 1)
+                 ^ (uint32_t)len;
+  return (key * multiplier) >> 24;
+}
+
+static bool
+httpheader_fill_slots (uint32_t multiplier)
+{
+  /* false as soon as two names share a slot */
+  memset (httpheader_table.slots, HTTPHEADER_OTHER,
+          sizeof (httpheader_table.slots));
+  for (enum httpheader_value_type ty = 0; ty < HTTPHEADER_OTHER; ++ty)
+    {
+      const char* name = header_name (ty);
+      uint8_t* slot = &httpheader_table.slots[
+        httpheader_hash (name, strlen (name), multiplier)
+      ];
+      if (*slot != HTTPHEADER_OTHER)
+        return false;
+      *slot = ty;
+    }
+  return true;
+}
+
+__attribute__((constructor))
+static void
+httpheader_build_table (void)
+{
+  httpheader_table.min_length = SIZE_MAX;
+  for (enum httpheader_value_type ty = 0; ty < HTTPHEADER_OTHER; ++ty)
+    {
+      size_t len = strlen (header_name (ty));
+      if (len < httpheader_table.min_length)
+        httpheader_table.min_length = len;
+      if (len > httpheader_table.max_length)
+        httpheader_table.max_length = len;
+    }
+  uint32_t multiplier = HTTPHEADER_FIRST_MULTIPLIER;
+  for (size_t i = 0; !httpheader_fill_slots (multiplier); ++i)
+    {
+      if (i == HTTPHEADER_MAX_TRIES)
+        panic ("found no perfect hash over %d header names",
+               HTTPHEADER_OTHER);
+      multiplier += HTTPHEADER_MULTIPLIER_STEP;
+    }
+  httpheader_table.multiplier = multiplier;
+}
+
+enum httpheader_value_type
+httpheader_lookup (const char* name, size_t len)
+{
+  if (len < httpheader_table.min_length || len > httpheader_table.max_length)
+    return HTTPHEADER_OTHER;
+  enum httpheader_value_type type = httpheader_table.slots[
+    httpheader_hash (name, len, httpheader_table.multiplier)
+  ];
+  if (type == HTTPHEADER_OTHER)
+    return HTTPHEADER_OTHER;
+  const char* known = header_name (type);
+  if (strncasecmp (name, known, len) || known[len] != '\0')
+    return HTTPHEADER_OTHER;
+  return type;
+}
+
+void
+httpheader_list_begin (httplist_t list, const char* value)
+{
+  list->value = value;
+  list->length = strlen (value);
+  list->position = 0;
+}
+
+static size_t
+httpheader_list_delimiter (const char* value, size_t from, size_t len)
+{
+  /* the next ',' or ';' past any quoted strings, whose escapes are skipped
+   * along with them
+   */
+  while ((from = g_httpscan.any (value, from, len, ",;\"")) < len
+         && value[from] == '"')
+    {
+      for (++from; from < len && value[from] != '"'; ++from)
+        if (value[from] == '\\' && from + 1 < len)
+          ++from;
+      if (from < len)
+        ++from;
+    }
+  return from;
+}
+
+static httpspan_t
+httpheader_list_strip (const char* value, size_t from, size_t to)
+{
+  while (from < to && (value[from] == ' ' || value[from] == '\t'))
+    ++from;
+  while (to > from && (value[to - 1] == ' ' || value[to - 1] == '\t'))
+    --to;
+  return (httpspan_t){.offset = from, .length = to - from};
+}
+
+static bool
+httpheader_list_weight (const char* value, httpspan_t param, uint16_t* into)
+{
+  /* "q=" and either "0" with up to three decimals, or "1" with only zeros */
+  const char* p = value + param.offset;
+  size_t len = param.length;
+  if (len < 3 || len > 7 || (p[0] | 0x20) != 'q' || p[1] != '=')
+    return false;
+  if ((p[2] != '0' && p[2] != '1') || (len > 3 && p[3] != '.'))
+    return false;
+  unsigned int q = (p[2] - '0') * 1000, scale = 100;
+  for (size_t i = 4; i < len; ++i, scale /= 10)
+    {
+      if (p[i] < '0' || p[i] > '9')
+        return false;
+      q += (p[i] - '0') * scale;
+    }
+  if (q > 1000)
+    return false;
+  *into = q;
+  return true;
+}
+
+bool
+httpheader_list_next (httplist_t list, httplistitem_t into)
+{
+  const char* value = list->value;
+  size_t len = list->length;
+  while (list->position < len)
+    {
+      size_t end = httpheader_list_delimiter (value, list->position, len),
+             item_end = end;
+      into->token = httpheader_list_strip (value, list->position, end);
+      into->params = (httpspan_t){.offset = end, .length = 0};
+      into->q = 1000;
+      while (item_end < len && value[item_end] == ';')
+        {
+          size_t from = item_end + 1;
+          item_end = httpheader_list_delimiter (value, from, len);
+          httpheader_list_weight (
+            value, httpheader_list_strip (value, from, item_end), &into->q
+          );
+        }
+      if (item_end != end)
+        into->params = httpheader_list_strip (value, end + 1, item_end);
+      list->position = item_end + (item_end < len);
+      if (into->token.length)
+        return true;
+    }
+  return false;
+}
+
+struct __g_httpheaders g_httpheaders = {
+  .lookup = httpheader_lookup,
+  .list_begin = httpheader_list_begin,
+  .list_next = httpheader_list_next
+};
@@ -0,0 +1,183 @@
+#include "../include/httpparse.h"
+#include "../include/httpscan.h"
+
+static inline bool
+httpparse_is_ows (unsigned char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+static inline httpspan_t
+httpparse_span (size_t from, size_t to)
+{
+  return (httpspan_t){.offset = from, .length = to - from};
+}
+
+void
+httpparse_begin (httphead_t head)
+{
+  head->nr_headers = 0;
+  head->error = NULL;
+  head->__int.state = HTTPPARSE_AT_METHOD;
+  head->__int.position = 0;
+}
+
+#define need_more() \
+  do { st->position = i; return HTTPPARSE_NEED_MORE; } while (0)
+#define fail(why) \
+  do { head->error = (why); return HTTPPARSE_ERROR; } while (0)
+
+enum httpparse_status
+httpparse_head (httphead_t head, const char* buf, size_t len)
+{
+  /* each state scans as far as the bytes go, and falls through to the
+   * next; running out of bytes leaves the state to be picked up again
+   */
+  const unsigned char* p = (const unsigned char*)buf;
+  __auto_type st = &head->__int;
+  size_t i = st->position;
+  while (true)
+    switch (st->state)
+      {
+      case HTTPPARSE_AT_METHOD:
+        i = g_httpscan.token (buf, i, len);
+        if (i == len)
+          need_more ();
+        if (p[i] != ' ')
+          fail ("methodline has an invalid method");
+        if (!i)
+          fail ("methodline has no method");
+        head->method = httpparse_span (0, i);
+        st->start = ++i;
+        st->state = HTTPPARSE_AT_PATH;
+        /* fallthrough */
+      case HTTPPARSE_AT_PATH:
+        /* the request target is taken as it is */
+        i = g_httpscan.target (buf, i, len);
+        if (i == len)
+          need_more ();
+        if (p[i] != ' ')
+          fail ("methodline has an invalid path, or no version");
+        if (i == st->start)
+          fail ("methodline has no path");
+        head->path = httpparse_span (st->start, i);
+        ++i;
+        st->matched = 0;
+        st->state = HTTPPARSE_AT_VERSION;
+        /* fallthrough */
+      case HTTPPARSE_AT_VERSION:
+        { /* through the end of the line */
+          static const char pattern[] = "HTTP/#.#\r\n";
+          for (; st->matched < sizeof (pattern) - 1; ++i, ++st->matched)
+            {
+              if (i == len)
+                need_more ();
+              char expected = pattern[st->matched];
+              if (expected == '#'? p[i] < '0' || p[i] > '9'
+                                 : p[i] != expected)
+                fail ("methodline has an improper version");
+            }
+          head->version.major = p[i - 5] - '0';
+          head->version.minor = p[i - 3] - '0';
+          st->state = HTTPPARSE_AT_LINE;
+        }
+        /* fallthrough */
+      case HTTPPARSE_AT_LINE:
+        if (i == len)
+          need_more ();
+        if (p[i] == '\r')
+          {
+            ++i;
+            st->state = HTTPPARSE_AT_END_LF;
+            break;
+          }
+        if (head->nr_headers == HTTP_MAX_HEADERS)
+          fail ("head has too many headers");
+        st->start = i;
+        st->state = HTTPPARSE_AT_NAME;
+        /* fallthrough */
+      case HTTPPARSE_AT_NAME:
+        i = g_httpscan.token (buf, i, len);
+        if (i == len)
+          need_more ();
+        if (p[i] != ':')
+          fail (i == st->start && httpparse_is_ows (p[i])
+                ? "header is folded over several lines"
+                : "header name has an invalid character");
+        if (i == st->start)
+          fail ("header has no name");
+        head->headers[head->nr_headers].name = httpparse_span (st->start, i);
+        ++i;
+        st->state = HTTPPARSE_AT_VALUE_OWS;
+        /* fallthrough */
+      case HTTPPARSE_AT_VALUE_OWS:
+        while (i < len && httpparse_is_ows (p[i]))
+          ++i;
+        if (i == len)
+          need_more ();
+        st->start = st->end = i;
+        st->state = HTTPPARSE_AT_VALUE;
+        /* fallthrough */
+      case HTTPPARSE_AT_VALUE:
+        { /* `end` is kept past the last byte that isn't whitespace */
+          size_t from = i;
+          i = g_httpscan.field (buf, i, len);
+          for (size_t j = i; j > from; --j)
+            if (!httpparse_is_ows (p[j - 1]))
+              {
+                st->end = j;
+                break;
+              }
+        }
+        if (i == len)
+          need_more ();
+        if (p[i] != '\r')
+          fail ("header value has an invalid character");
+        head->headers[head->nr_headers].value
+          = httpparse_span (st->start, st->end);
+        ++i;
+        st->state = HTTPPARSE_AT_VALUE_LF;
+        /* fallthrough */
+      case HTTPPARSE_AT_VALUE_LF:
+        if (i == len)
+          need_more ();
+        if (p[i] != '\n')
+          fail ("header is not CRLF-terminated");
+        ++i;
+        ++head->nr_headers;
+        st->state = HTTPPARSE_AT_LINE;
+        break;
+      case HTTPPARSE_AT_END_LF:
+        if (i == len)
+          need_more ();
+        if (p[i] != '\n')
+          fail ("head is not CRLF-terminated");
+        head->length = i + 1;
+        return HTTPPARSE_DONE;
+      }
+}
+
+#undef need_more
+#undef fail
+
+void
+httpparse_terminate (httphead_t head, char* buf)
+{
+  /* every span is followed by a delimiter or whitespace that's of no more
+   * use, a value's being either trailing whitespace or its line's CR
+   */
+  buf[head->method.offset + head->method.length] = '\0';
+  buf[head->path.offset + head->path.length] = '\0';
+  for (size_t i = 0; i < head->nr_headers; ++i)
+    {
+      __auto_type header = &head->headers[i];
+      buf[header->name.offset + header->name.length] = '\0';
+      buf[header->value.offset + header->value.length] = '\0';
+    }
+}
+
+struct __g_httpparse g_httpparse = {
+  .begin = httpparse_begin,
+  .head = httpparse_head,
+  .terminate = httpparse_terminate
+};
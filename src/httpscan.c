@@ -0,0 +1,304 @@
+#include "../include/httpscan.h"
+#include <string.h>
+#include <immintrin.h>
+
+/* RFC 9110's `tchar`, which methods and header names are made of */
+static const bool httpscan_tchar[256] = {
+  ['!'] = true, ['#'] = true, ['$'] = true, ['%'] = true, ['&'] = true,
+  ['\''] = true, ['*'] = true, ['+'] = true, ['-'] = true, ['.'] = true,
+  ['^'] = true, ['_'] = true, ['`'] = true, ['|'] = true, ['~'] = true,
+  ['0' ... '9'] = true, ['A' ... 'Z'] = true, ['a' ... 'z'] = true
+};
+
+size_t
+httpscan_scalar_token (const char* buf, size_t from, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)buf;
+  while (from < len && httpscan_tchar[p[from]])
+    ++from;
+  return from;
+}
+
+size_t
+httpscan_scalar_target (const char* buf, size_t from, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)buf;
+  while (from < len && p[from] > ' ' && p[from] != 0x7f)
+    ++from;
+  return from;
+}
+
+size_t
+httpscan_scalar_field (const char* buf, size_t from, size_t len)
+{
+  /* visible characters, whitespace and obs-text, i.e. anything but CTLs */
+  const unsigned char* p = (const unsigned char*)buf;
+  while (from < len && (p[from] >= ' ' || p[from] == '\t')
+         && p[from] != 0x7f)
+    ++from;
+  return from;
+}
+
+size_t
+httpscan_scalar_any (const char* buf, size_t from, size_t len,
+  const char* set)
+{
+  size_t nr_set = strlen (set);
+  while (from < len && memchr (set, buf[from], nr_set) == NULL)
+    ++from;
+  return from;
+}
+
+/* SSE4.2: PCMPESTRI matches a vector against up to 8 byte ranges, or 16
+ * bytes, at once
+ */
+#define SSE42_RANGES (_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES \
+                      | _SIDD_LEAST_SIGNIFICANT)
+#define SSE42_ANY (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY \
+                   | _SIDD_LEAST_SIGNIFICANT)
+
+__attribute__((target("sse4.2")))
+static size_t
+httpscan_sse42_token (const char* buf, size_t from, size_t len)
+{
+  /* a non-`tchar` takes 10 ranges, so '|' and '~' are caught along with
+   * the rest of "{" through "\xff", and let through afterwards
+   */
+  static const char ranges[16] = "\x00 \"\"(),,//:@[]{\xff";
+  const __m128i r = _mm_loadu_si128 ((const __m128i*)ranges);
+  while (from + 16 <= len)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i*)(buf + from));
+      int index = _mm_cmpestri (r, 16, v, 16, SSE42_RANGES);
+      from += index;
+      if (index == 16)
+        continue;
+      if (buf[from] != '|' && buf[from] != '~')
+        return from;
+      ++from;
+    }
+  return httpscan_scalar_token (buf, from, len);
+}
+
+__attribute__((target("sse4.2")))
+static size_t
+httpscan_sse42_target (const char* buf, size_t from, size_t len)
+{
+  static const char ranges[16] = "\x00 \x7f\x7f";
+  const __m128i r = _mm_loadu_si128 ((const __m128i*)ranges);
+  while (from + 16 <= len)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i*)(buf + from));
+      int index = _mm_cmpestri (r, 4, v, 16, SSE42_RANGES);
+      from += index;
+      if (index != 16)
+        return from;
+    }
+  return httpscan_scalar_target (buf, from, len);
+}
+
+__attribute__((target("sse4.2")))
+static size_t
+httpscan_sse42_field (const char* buf, size_t from, size_t len)
+{
+  static const char ranges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+  const __m128i r = _mm_loadu_si128 ((const __m128i*)ranges);
+  while (from + 16 <= len)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i*)(buf + from));
+      int index = _mm_cmpestri (r, 6, v, 16, SSE42_RANGES);
+      from += index;
+      if (index != 16)
+        return from;
+    }
+  return httpscan_scalar_field (buf, from, len);
+}
+
+__attribute__((target("sse4.2")))
+static size_t
+httpscan_sse42_any (const char* buf, size_t from, size_t len,
+  const char* set)
+{
+  char padded[16] = {0};
+  size_t nr_set = strlen (set);
+  memcpy (padded, set, nr_set);
+  const __m128i s = _mm_loadu_si128 ((const __m128i*)padded);
+  while (from + 16 <= len)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i*)(buf + from));
+      int index = _mm_cmpestri (s, nr_set, v, 16, SSE42_ANY);
+      from += index;
+      if (index != 16)
+        return from;
+    }
+  return httpscan_scalar_any (buf, from, len, set);
+}
+
+/* AVX2: 32 bytes at a time, classified with unsigned min/compare, and
+ * `tchar`s exactly with a lookup on either nibble
+ */
+static char httpscan_avx2_tchar_lo[16], httpscan_avx2_tchar_hi[16];
+
+static void
+httpscan_avx2_build_tables (void)
+{
+  /* a byte is a `tchar` if the entry for its low nibble has the bit for
+   * its high nibble set, none with the high bit set is one
+   */
+  for (size_t hi = 0; hi < 8; ++hi)
+    {
+      httpscan_avx2_tchar_hi[hi] = 1 << hi;
+      for (size_t lo = 0; lo < 16; ++lo)
+        if (httpscan_tchar[(hi << 4) | lo])
+          httpscan_avx2_tchar_lo[lo] |= 1 << hi;
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t
+httpscan_avx2_token (const char* buf, size_t from, size_t len)
+{
+  const __m256i lo_table = _mm256_broadcastsi128_si256 (
+    _mm_loadu_si128 ((const __m128i*)httpscan_avx2_tchar_lo));
+  const __m256i hi_table = _mm256_broadcastsi128_si256 (
+    _mm_loadu_si128 ((const __m128i*)httpscan_avx2_tchar_hi));
+  const __m256i nibble = _mm256_set1_epi8 (0x0f);
+  while (from + 32 <= len)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*)(buf + from));
+      __m256i lo = _mm256_shuffle_epi8 (lo_table,
+                                        _mm256_and_si256 (v, nibble));
+      __m256i hi = _mm256_shuffle_epi8 (
+        hi_table, _mm256_and_si256 (_mm256_srli_epi16 (v, 4), nibble));
+      __m256i stop = _mm256_cmpeq_epi8 (_mm256_and_si256 (lo, hi),
+                                        _mm256_setzero_si256 ());
+      unsigned int mask = _mm256_movemask_epi8 (stop);
+      if (mask)
+        return from + __builtin_ctz (mask);
+      from += 32;
+    }
+  return httpscan_scalar_token (buf, from, len);
+}
+
+__attribute__((target("avx2")))
+static size_t
+httpscan_avx2_target (const char* buf, size_t from, size_t len)
+{
+  const __m256i space = _mm256_set1_epi8 (' '), del = _mm256_set1_epi8 (0x7f);
+  while (from + 32 <= len)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*)(buf + from));
+      __m256i stop = _mm256_or_si256 (
+        _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, space), v),
+        _mm256_cmpeq_epi8 (v, del));
+      unsigned int mask = _mm256_movemask_epi8 (stop);
+      if (mask)
+        return from + __builtin_ctz (mask);
+      from += 32;
+    }
+  return httpscan_scalar_target (buf, from, len);
+}
+
+__attribute__((target("avx2")))
+static size_t
+httpscan_avx2_field (const char* buf, size_t from, size_t len)
+{
+  const __m256i below_space = _mm256_set1_epi8 (0x1f),
+                tab = _mm256_set1_epi8 ('\t'), del = _mm256_set1_epi8 (0x7f);
+  while (from + 32 <= len)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*)(buf + from));
+      __m256i ctl = _mm256_andnot_si256 (
+        _mm256_cmpeq_epi8 (v, tab),
+        _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, below_space), v));
+      __m256i stop = _mm256_or_si256 (ctl, _mm256_cmpeq_epi8 (v, del));
+      unsigned int mask = _mm256_movemask_epi8 (stop);
+      if (mask)
+        return from + __builtin_ctz (mask);
+      from += 32;
+    }
+  return httpscan_scalar_field (buf, from, len);
+}
+
+__attribute__((target("avx2")))
+static size_t
+httpscan_avx2_any (const char* buf, size_t from, size_t len,
+  const char* set)
+{
+  size_t nr_set = strlen (set);
+  while (from + 32 <= len)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i*)(buf + from)),
+              stop = _mm256_setzero_si256 ();
+      for (size_t i = 0; i < nr_set; ++i)
+        stop = _mm256_or_si256 (
+          stop, _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 (set[i])));
+      unsigned int mask = _mm256_movemask_epi8 (stop);
+      if (mask)
+        return from + __builtin_ctz (mask);
+      from += 32;
+    }
+  return httpscan_scalar_any (buf, from, len, set);
+}
+
+static const struct
+{
+  const char* name;
+  typeof (httpscan_scalar_token)* token;
+  typeof (httpscan_scalar_target)* target;
+  typeof (httpscan_scalar_field)* field;
+  typeof (httpscan_scalar_any)* any;
+} httpscan_kernels[HTTPSCAN_NR_ISAS] = {
+  [HTTPSCAN_SCALAR] = {
+    "scalar",
+    httpscan_scalar_token, httpscan_scalar_target,
+    httpscan_scalar_field, httpscan_scalar_any
+  },
+  [HTTPSCAN_SSE42] = {
+    "sse4.2",
+    httpscan_sse42_token, httpscan_sse42_target,
+    httpscan_sse42_field, httpscan_sse42_any
+  },
+  [HTTPSCAN_AVX2] = {
+    "avx2",
+    httpscan_avx2_token, httpscan_avx2_target,
+    httpscan_avx2_field, httpscan_avx2_any
+  }
+};
+
+bool
+httpscan_select (enum httpscan_isa isa)
+{
+  __auto_type kernels = &httpscan_kernels[isa];
+  __builtin_cpu_init ();
+  /* `__builtin_cpu_supports` only takes a literal */
+  if (isa == HTTPSCAN_SSE42 && !__builtin_cpu_supports ("sse4.2"))
+    return false;
+  if (isa == HTTPSCAN_AVX2 && !__builtin_cpu_supports ("avx2"))
+    return false;
+  g_httpscan.isa = kernels->name;
+  g_httpscan.token = kernels->token;
+  g_httpscan.target = kernels->target;
+  g_httpscan.field = kernels->field;
+  g_httpscan.any = kernels->any;
+  return true;
+}
+
+__attribute__((constructor))
+static void
+httpscan_select_best (void)
+{
+  httpscan_avx2_build_tables ();
+  for (enum httpscan_isa isa = HTTPSCAN_NR_ISAS; isa-- > HTTPSCAN_SCALAR;)
+    if (httpscan_select (isa))
+      break;
+}
+
+struct __g_httpscan g_httpscan = {
+  .isa = "scalar",
+  .token = httpscan_scalar_token,
+  .target = httpscan_scalar_target,
+  .field = httpscan_scalar_field,
+  .any = httpscan_scalar_any,
+  .select = httpscan_select
+};
@@ -1,5 +1,21 @@
+#define _GNU_SOURCE
 #include "../include/httpserver.h"
 #include "../include/thunks.h"
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+struct __int_http_worker
+{
+  pid_t pid;              /* 0 while not running */
+  uint64_t started_ms;
+  uint64_t respawn_at_ms; /* 0 unless waiting to be respawned */
+};
 
 __THUNK_DECL void
 __int_set_route_table_thunk (httpserver_t this, route_table_t route_table)
@@ -9,15 +25,327 @@ __int_set_route_table_thunk (httpserver_t this, route_table_t route_table)
 
 }
 
+static void
+__int_hs_on_stop_signal (void* data, const struct signalfd_siginfo* info)
+{
+  /* taken on the event loop rather than in a handler, so requests being
+   * served when it arrives are seen through before anything is freed
+   */
+  httpserver_t this = data;
+  log ("caught %s, draining connections...", strsignal (info->ssi_signo));
+  g_tcpserver.drain (this->__int.tcp_server);
+}
+
 __THUNK_DECL void
 __int_start_event_loop_thunk (httpserver_t this)
 {
   if (this->__int.route_table == NULL)
     panic ("route table was not set");
+  g_tcpserver.on_signal (this->__int.tcp_server, SIGINT,
+                         __int_hs_on_stop_signal, this);
+  g_tcpserver.on_signal (this->__int.tcp_server, SIGTERM,
+                         __int_hs_on_stop_signal, this);
+  /* started here rather than on creation, so that every worker process
+   * gets threads of its own
+   */
+  route_table_t route_table = this->__int.route_table;
+  for (size_t i = 0; i < route_table->nr_routes; ++i)
+    if (route_table->routes[i].mode == ROUTE_OFFLOAD)
+      {
+        this->__int.offload = g_workpool.new (
+          this->__int.offload_config.nr_threads,
+          this->__int.offload_config.max_queued
+        );
+        debug ("started work pool of %zu thread(s) for offloaded routes",
+               this->__int.offload->__int.nr_threads);
+        break;
+      }
+  for (size_t i = 0; i < route_table->nr_routes; ++i)
+    if (route_table->routes[i].mode == ROUTE_COROUTINE)
+      {
+        size_t nr_pools = this->__int.tcp_server->__int_stream.nr_reactors;
+        this->__int.coroutines = calloc (nr_pools,
+                                         sizeof (*this->__int.coroutines));
+        if (this->__int.coroutines == NULL)
+          panic ("failed to allocate %zu coroutine pools", nr_pools);
+        for (size_t j = 0; j < nr_pools; ++j)
+          this->__int.coroutines[j] = g_coroutine.new_pool (
+            this->__int.coroutine_config.stack_size,
+            this->__int.coroutine_config.max_pooled
+          );
+        this->__int.nr_coroutine_pools = nr_pools;
+        debug ("created %zu coroutine pool(s) of %zu byte stacks", nr_pools,
+               this->__int.coroutines[0]->__int.stack_size);
+        break;
+      }
   debug ("starting event loop for HTTP server");
   this->__int.tcp_server->start_event_loop ();
 }
 
+__THUNK_DECL void
+__int_configure_offload_thunk (httpserver_t this, size_t nr_threads,
+  size_t max_queued)
+{
+  this->__int.offload_config.nr_threads = nr_threads;
+  this->__int.offload_config.max_queued = max_queued;
+}
+
+__THUNK_DECL void
+__int_configure_coroutines_thunk (httpserver_t this, size_t stack_size,
+  size_t max_pooled)
+{
+  this->__int.coroutine_config.stack_size = stack_size;
+  this->__int.coroutine_config.max_pooled = max_pooled;
+}
+
+static uint64_t
+__int_hs_monotonic_ms (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool
+__int_hs_upgrade (httpserver_t this)
+{
+  /* the new instance is exec()d from a fork of this one, and finds its end
+   * of a socketpair in the environment; until it has taken the listeners
+   * up, this instance carries on as if nothing happened
+   */
+  int pair[2];
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1)
+    {
+      warn ("failed to create handoff socket pair: %s", strerror (errno));
+      return false;
+    }
+  /* prepared up front, the child may only make async-signal-safe calls
+   * until it has exec()d
+   */
+  char handoff[32];
+  snprintf (handoff, sizeof (handoff), HTTP_HANDOFF_FD_ENV "=%d", pair[1]);
+  size_t nr_env = 0, prefix_len = strlen (HTTP_HANDOFF_FD_ENV "=");
+  for (char** var = environ; *var != NULL; ++var)
+    ++nr_env;
+  char **env = calloc (nr_env + 2, sizeof (*env)), **next = env;
+  if (env == NULL)
+    panic ("failed to allocate environment for new instance");
+  for (char** var = environ; *var != NULL; ++var)
+    if (strncmp (*var, HTTP_HANDOFF_FD_ENV "=", prefix_len))
+      *next++ = *var;
+  *next = handoff;
+  sigset_t unblocked;
+  sigemptyset (&unblocked);
+
+  fflush (NULL);
+  pid_t pid = fork ();
+  if (!pid)
+    {
+      sigprocmask (SIG_SETMASK, &unblocked, NULL);
+      if (fcntl (pair[1], F_SETFD, 0) != -1)
+        execvpe (this->__int.upgrade_argv[0], this->__int.upgrade_argv, env);
+      _exit (EXIT_FAILURE);
+    }
+  close (pair[1]);
+  free (env);
+  if (pid == -1)
+    {
+      warn ("failed to fork new instance: %s", strerror (errno));
+      close (pair[0]);
+      return false;
+    }
+
+  log ("upgrading to new instance (pid=%d) of '%s'", pid,
+       this->__int.upgrade_argv[0]);
+  bool handed_over = g_tcpserver.hand_over (this->__int.tcp_server, pair[0]);
+  close (pair[0]);
+  if (!handed_over)
+    {
+      warn ("new instance (pid=%d) didn't take over, carrying on", pid);
+      kill (pid, SIGKILL);
+      waitpid (pid, NULL, 0);
+    }
+  return handed_over;
+}
+
+static void
+__int_hs_on_upgrade_signal (void* data, const struct signalfd_siginfo* info)
+{
+  /* a worker's listeners have been handed over by its master already */
+  httpserver_t this = data;
+  if (this->__int.handed_over)
+    return;
+  if (this->__int.is_worker || __int_hs_upgrade (this))
+    {
+      this->__int.handed_over = true;
+      g_tcpserver.drain (this->__int.tcp_server);
+    }
+}
+
+__THUNK_DECL void
+__int_enable_upgrades_thunk (httpserver_t this, char* const* argv)
+{
+  this->__int.upgrade_argv = argv;
+  g_tcpserver.on_signal (this->__int.tcp_server, SIGUSR2,
+                         __int_hs_on_upgrade_signal, this);
+}
+
+static void
+__int_hs_spawn_worker (httpserver_t this, struct __int_http_worker* worker,
+  size_t id, const sigset_t* saved_mask)
+{
+  pid_t master = getpid ();
+  worker->started_ms = __int_hs_monotonic_ms ();
+  worker->respawn_at_ms = 0;
+  /* or the worker would repeat whatever the master had yet to write out */
+  fflush (NULL);
+  if ((worker->pid = fork ()) == -1)
+    {
+      /* tried again like a worker that crashed straight away */
+      warn ("failed to fork worker #%zu: %s", id, strerror (errno));
+      worker->pid = 0;
+      worker->respawn_at_ms = worker->started_ms
+                              + HTTP_WORKER_RESPAWN_BACKOFF_MS;
+      return;
+    }
+  if (worker->pid)
+    {
+      log ("spawned worker #%zu (pid=%d)", id, worker->pid);
+      return;
+    }
+
+  /* a worker outliving its master would keep serving unsupervised */
+  if (prctl (PR_SET_PDEATHSIG, SIGTERM) == -1 || getppid () != master)
+    _exit (EXIT_FAILURE);
+  sigprocmask (SIG_SETMASK, saved_mask, NULL);
+  this->__int.is_worker = true;
+  __int_start_event_loop_thunk (this);
+  exit (EXIT_SUCCESS);
+}
+
+__THUNK_DECL void
+__int_start_workers_thunk (httpserver_t this, size_t nr_workers)
+{
+  if (this->__int.route_table == NULL)
+    panic ("route table was not set");
+  if (!nr_workers)
+    panic ("can't start a server with no workers");
+  struct __int_http_worker* workers = calloc (nr_workers, sizeof (*workers));
+  if (workers == NULL)
+    panic ("failed to allocate %zu workers", nr_workers);
+
+  /* the master only ever waits on its workers and for being told to stop,
+   * so those signals are taken synchronously rather than by handlers
+   */
+  sigset_t signals, saved_mask;
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGTERM);
+  sigaddset (&signals, SIGCHLD);
+  if (this->__int.upgrade_argv != NULL)
+    sigaddset (&signals, SIGUSR2);
+  sigprocmask (SIG_BLOCK, &signals, &saved_mask);
+
+  debug ("starting %zu workers for HTTP server", nr_workers);
+  for (size_t i = 0; i < nr_workers; ++i)
+    __int_hs_spawn_worker (this, &workers[i], i, &saved_mask);
+
+  bool stopping = false;
+  for (;;)
+    {
+      size_t nr_running = 0;
+      uint64_t next_respawn_ms = 0;
+      for (size_t i = 0; i < nr_workers; ++i)
+        if (workers[i].pid)
+          ++nr_running;
+        else if (!stopping && workers[i].respawn_at_ms
+                 && (!next_respawn_ms
+                     || workers[i].respawn_at_ms < next_respawn_ms))
+          next_respawn_ms = workers[i].respawn_at_ms;
+      if (!nr_running && !next_respawn_ms)
+        break;
+
+      siginfo_t info;
+      int signum;
+      if (next_respawn_ms)
+        {
+          uint64_t now_ms = __int_hs_monotonic_ms (),
+                   wait_ms = next_respawn_ms > now_ms
+                     ? next_respawn_ms - now_ms
+                     : 0;
+          struct timespec timeout = {
+            .tv_sec = wait_ms / 1000,
+            .tv_nsec = (wait_ms % 1000) * 1000000
+          };
+          signum = sigtimedwait (&signals, &info, &timeout);
+        }
+      else
+        signum = sigwaitinfo (&signals, &info);
+
+      if ((signum == SIGINT || signum == SIGTERM) && !stopping)
+        {
+          /* each worker drains the way it would if signalled itself */
+          log ("stopping %zu workers...", nr_running);
+          stopping = true;
+          for (size_t i = 0; i < nr_workers; ++i)
+            if (workers[i].pid)
+              kill (workers[i].pid, signum);
+        }
+      else if (signum == SIGUSR2 && !stopping && __int_hs_upgrade (this))
+        {
+          /* the workers drain, and aren't replaced as they finish */
+          log ("handed over to new instance, draining %zu workers...",
+               nr_running);
+          stopping = true;
+          for (size_t i = 0; i < nr_workers; ++i)
+            if (workers[i].pid)
+              kill (workers[i].pid, SIGUSR2);
+        }
+
+      /* one SIGCHLD may stand for any number of exited workers */
+      int status;
+      pid_t pid;
+      while ((pid = waitpid (-1, &status, WNOHANG)) > 0)
+        for (size_t i = 0; i < nr_workers; ++i)
+          {
+            struct __int_http_worker* worker = &workers[i];
+            if (worker->pid != pid)
+              continue;
+            worker->pid = 0;
+            if (stopping)
+              debug ("worker #%zu (pid=%d) stopped", i, pid);
+            else if (WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS)
+              log ("worker #%zu (pid=%d) exited, not respawning it", i, pid);
+            else
+              {
+                uint64_t now_ms = __int_hs_monotonic_ms ();
+                if (WIFSIGNALED (status))
+                  warn ("worker #%zu (pid=%d) killed by signal %d (%s)",
+                        i, pid, WTERMSIG (status),
+                        strsignal (WTERMSIG (status)));
+                else
+                  warn ("worker #%zu (pid=%d) exited with status %d",
+                        i, pid, WEXITSTATUS (status));
+                worker->respawn_at_ms =
+                  now_ms - worker->started_ms < HTTP_WORKER_RESPAWN_BACKOFF_MS
+                    ? now_ms + HTTP_WORKER_RESPAWN_BACKOFF_MS
+                    : now_ms;
+              }
+            break;
+          }
+
+      uint64_t now_ms = __int_hs_monotonic_ms ();
+      for (size_t i = 0; !stopping && i < nr_workers; ++i)
+        if (!workers[i].pid && workers[i].respawn_at_ms
+            && workers[i].respawn_at_ms <= now_ms)
+          __int_hs_spawn_worker (this, &workers[i], i, &saved_mask);
+    }
+
+  sigprocmask (SIG_SETMASK, &saved_mask, NULL);
+  free (workers);
+  debug ("all workers of HTTP server have exited");
+}
+
 static void
 __int_allocate_thunks (httpserver_t server)
 {
@@ -31,34 +359,82 @@ __int_allocate_thunks (httpserver_t server)
     __int_start_event_loop_thunk,
     server    
   );
+  server->start_workers = g_thunks.allocate_thunk (
+    "http_start_workers",
+    __int_start_workers_thunk,
+    server
+  );
+  server->enable_upgrades = g_thunks.allocate_thunk (
+    "http_enable_upgrades",
+    __int_enable_upgrades_thunk,
+    server
+  );
+  server->configure_offload = g_thunks.allocate_thunk (
+    "http_configure_offload",
+    __int_configure_offload_thunk,
+    server
+  );
+  server->configure_coroutines = g_thunks.allocate_thunk (
+    "http_configure_coroutines",
+    __int_configure_coroutines_thunk,
+    server
+  );
   debug ("registering TCP callback thunks");
   __int_cb_register_callbacks (server);
   debug ("all thunks allocated on HTTP server instance");
 }
 
 httpserver_t
-__int_hs_create_with_bind (tcp_address_t host, tcp_port_t port)
+__int_hs_create_with_config (tcp_address_t host, tcp_port_t port,
+  const struct tcp_server_config* config)
 {
   httpserver_t server = malloc (sizeof (struct __int_httpserver));
   if (server == NULL)
     panic ("malloc() failed to allocate HTTP server instance");
   server->__int.route_table = NULL;
+  server->__int.upgrade_argv = NULL;
+  server->__int.is_worker = false;
+  server->__int.handed_over = false;
+  server->__int.offload = NULL;
+  server->__int.offload_config.nr_threads = 0;
+  server->__int.offload_config.max_queued = 0;
+  server->__int.coroutines = NULL;
+  server->__int.nr_coroutine_pools = 0;
+  server->__int.coroutine_config.stack_size = 0;
+  server->__int.coroutine_config.max_pooled = 0;
   debug ("allocated HTTP server instance, creating TCP server");
-  server->__int.tcp_server = g_tcpserver.create_and_bind_to (host, port);
+  server->__int.tcp_server = g_tcpserver.create_and_bind_with (
+    host, port, config
+  );
   debug ("allocating HTTP method thunks");
   __int_allocate_thunks (server);
   return server;
 }
 
+httpserver_t
+__int_hs_create_with_bind (tcp_address_t host, tcp_port_t port)
+{
+  return __int_hs_create_with_config (host, port, &tcp_default_config);
+}
+
 void
 __int_hs_free (httpserver_t server)
 {
   debug ("free()ing HTTP server");
+  /* handlers still running are waited on, and what they complete is
+   * cleaned up along with the TCP server
+   */
+  if (server->__int.offload != NULL)
+    server->__int.offload->free ();
   __int_ts_free (server->__int.tcp_server);
+  for (size_t i = 0; i < server->__int.nr_coroutine_pools; ++i)
+    server->__int.coroutines[i]->free ();
+  free (server->__int.coroutines);
   free (server);
 }
 
 struct __g_httpserver g_httpserver = {
   .create_and_bind_to = __int_hs_create_with_bind,
+  .create_and_bind_with = __int_hs_create_with_config,
   .free = __int_hs_free
 };
\ No newline at end of file
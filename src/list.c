@@ -77,11 +77,21 @@ void
 list_free (list_t list)
 {
   list_debug ("freeing list structure");
+  { /* deallocate thunks */
+    g_thunks.deallocate_thunk (list->append);
+    g_thunks.deallocate_thunk (list->insert);
+    g_thunks.deallocate_thunk (list->remove);
+    g_thunks.deallocate_thunk (list->get);
+    g_thunks.deallocate_thunk (list->free);
+    g_thunks.deallocate_thunk (list->contains);
+    g_thunks.deallocate_thunk (list->set);
+  }
   for (size_t i = 0; i < list->__int.nr_entries; ++i)
     {
       list_try_free_entry (list->__int.entries[i]);
       list_debug ("freeing index: %zu, in list: %p", i, list);
     }
+  free (list->__int.entries);
   free (list);
 }
 
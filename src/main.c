@@ -1,14 +1,18 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
-#include <signal.h>
+#include <getopt.h>
+#include <time.h>
 #include "../include/common.h"
 #include "../include/routes.h"
 #include "../include/httpserver.h"
+#include "../include/httpscan.h"
 
 ROUTE_FUNCTION(route_index)
 {
@@ -37,29 +41,374 @@ check_exists_route_file (const char* const path)
 
 static route_table_t route_table;
 static httpserver_t server;
+/* what the memory backend's connections got back, by status class, with
+ * [0] counting those that got no response at all
+ */
+static struct
+{
+  uint64_t nr_responses[6];
+  uint64_t nr_bytes;
+} memory_tally;
 
-void
-kbint_handler (int signum)
+static int*
+parse_cpu_list (char* list, size_t* nr_cpus)
 {
-  printf ("\b\b");  /* backspace to erase the '^C' */
-  log ("keyboard interrupt caught, exiting...");
-  g_httpserver.free (server);
-  g_route_parser.free (route_table);
-  exit (EXIT_SUCCESS);
+  int* cpus = NULL;
+  *nr_cpus = 0;
+  for (char* cpu = strtok (list, ","); cpu != NULL; cpu = strtok (NULL, ","))
+    {
+      char* end;
+      long id = strtol (cpu, &end, 10);
+      if (end == cpu || *end != '\0' || id < 0)
+        panic ("invalid CPU '%s' in affinity list", cpu);
+      if ((cpus = realloc (cpus, (*nr_cpus + 1) * sizeof (*cpus))) == NULL)
+        panic ("failed to allocate CPU affinity list");
+      cpus[(*nr_cpus)++] = (int)id;
+    }
+  return cpus;
+}
+
+static void
+parse_listener (const char* spec, struct tcp_listener_config* listener)
+{
+  /* `host:port`, `[ipv6-host]:port` or `unix:path` (`unix:@name` for the
+   * abstract namespace), followed by `,backlog=N` and/or `,v6only`; the
+   * spec is left as it is, an upgrade runs the same command line again
+   */
+  size_t len = strcspn (spec, ",");
+  const char *options = spec + len, *port = NULL, *address = spec;
+  size_t address_len = len;
+  *listener = (struct tcp_listener_config){ .family = TCP_LISTENER_INET };
+  if (!strncmp (spec, "unix:", strlen ("unix:")))
+    {
+      listener->family = TCP_LISTENER_UNIX;
+      address += strlen ("unix:");
+      address_len -= strlen ("unix:");
+    }
+  else if (spec[0] == '[')
+    {
+      const char* end = memchr (spec, ']', len);
+      if (end == NULL || end[1] != ':')
+        panic ("invalid IPv6 listener '%.*s', expected [host]:port",
+               (int)len, spec);
+      listener->family = TCP_LISTENER_INET6;
+      address = spec + 1;
+      address_len = end - address;
+      port = end + 2;
+    }
+  else if ((port = memrchr (spec, ':', len)) != NULL)
+    address_len = port++ - spec;
+  else
+    panic ("invalid listener '%.*s', expected host:port", (int)len, spec);
+  if ((listener->address = strndup (address, address_len)) == NULL)
+    panic ("failed to allocate listener address");
+  if (port != NULL)
+    {
+      char* end;
+      long number = strtol (port, &end, 10);
+      if (end == port || end != options || number <= 0 || number > 65535)
+        panic ("listener port '%.*s' not in range 0..65536",
+               (int)(options - port), port);
+      listener->port = number;
+    }
+  while (*options++ == ',')
+    {
+      size_t option_len = strcspn (options, ",");
+      if (!strncmp (options, "backlog=", strlen ("backlog=")))
+        listener->backlog = atoi (options + strlen ("backlog="));
+      else if (option_len == strlen ("v6only")
+               && !strncmp (options, "v6only", option_len)
+               && listener->family == TCP_LISTENER_INET6)
+        listener->v6_only = true;
+      else
+        panic ("invalid listener option '%.*s'", (int)option_len, options);
+      options += option_len;
+    }
+}
+
+static char*
+read_memory_script (const char* spec, struct tcp_server_config* config)
+{
+  /* `request-file,connections[,concurrent[,chunk[,window[,hangup]]]]`,
+   * the request file being sent as it is by every connection
+   */
+  const char* options = strchr (spec, ',');
+  int hangup = 0;
+  if (options == NULL || sscanf (options, ",%zu,%zu,%zu,%zu,%d",
+                                 &config->memory.nr_connections,
+                                 &config->memory.nr_concurrent,
+                                 &config->memory.chunk,
+                                 &config->memory.window, &hangup) < 1)
+    panic ("invalid memory script '%s', expected "
+           "request-file,connections[,concurrent,chunk,window,hangup]",
+           spec);
+  config->memory.hangup = hangup;
+  char* path = strndup (spec, options - spec);
+  FILE* f_input = path != NULL? fopen (path, "rb"): NULL;
+  if (f_input == NULL)
+    panic ("failed to open request file '%.*s'", (int)(options - spec),
+           spec);
+  char* input = NULL;
+  size_t len = 0, nr_read;
+  do
+    {
+      if ((input = realloc (input, len + 4096)) == NULL)
+        panic ("failed to allocate request file '%s'", path);
+      len += nr_read = fread (input + len, 1, 4096, f_input);
+    }
+  while (nr_read == 4096);
+  fclose (f_input);
+  free (path);
+  config->memory.input = input;
+  config->memory.input_len = len;
+  return input;
+}
+
+static void
+tally_memory_output (void* data, size_t id, const char* output, size_t len)
+{
+  /* called on every reactor, the status code is all that's looked at */
+  size_t class = 0;
+  if (len > strlen ("HTTP/1.x ") && !memcmp (output, "HTTP/1.", 7)
+      && output[8] == ' ' && output[9] >= '1' && output[9] <= '5')
+    class = output[9] - '0';
+  __atomic_add_fetch (&memory_tally.nr_responses[class], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&memory_tally.nr_bytes, len, __ATOMIC_RELAXED);
+}
+
+static uint64_t
+monotonic_us (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void
+log_memory_stats (uint64_t elapsed_us)
+{
+  uint64_t nr_connections = 0, *nr_responses = memory_tally.nr_responses;
+  for (size_t i = 0; i < 6; ++i)
+    nr_connections += nr_responses[i];
+  log ("memory transport: %" PRIu64 " connections in %.1f ms, %.0f per "
+       "second; %" PRIu64 " 1xx, %" PRIu64 " 2xx, %" PRIu64 " 3xx, "
+       "%" PRIu64 " 4xx, %" PRIu64 " 5xx, %" PRIu64 " unanswered; "
+       "%" PRIu64 " bytes out",
+       nr_connections, elapsed_us / 1000.0,
+       elapsed_us? nr_connections * 1e6 / elapsed_us: 0.0,
+       nr_responses[1], nr_responses[2], nr_responses[3], nr_responses[4],
+       nr_responses[5], nr_responses[0], memory_tally.nr_bytes);
+}
+
+static void
+log_loop_stats (void)
+{
+  struct tcp_loop_stats stats = g_tcpserver.loop_stats (
+    server->__int.tcp_server
+  );
+  log ("event loop: %" PRIu64 " spin hits, %" PRIu64 " block wakeups, "
+       "%" PRIu64 " block timeouts, %.2f events per wakeup, "
+       "%" PRIu64 " connections timed out, %" PRIu64 " held back",
+       stats.spin_hits, stats.block_wakeups, stats.block_timeouts,
+       stats.avg_batch, stats.nr_expired, stats.nr_budget_hits);
+  log ("socket errors: %" PRIu64 " peer, %" PRIu64 " resource, "
+       "%" PRIu64 " other; accepts paused %" PRIu64 " times, "
+       "%" PRIu64 " connections shed",
+       stats.nr_errors[TCP_ERROR_PEER], stats.nr_errors[TCP_ERROR_RESOURCE],
+       stats.nr_errors[TCP_ERROR_OTHER], stats.nr_accept_pauses,
+       stats.nr_shed);
+}
+
+static void
+log_offload_stats (void)
+{
+  if (server->__int.offload == NULL)
+    return;
+  struct workpool_stats stats = g_workpool.stats (server->__int.offload);
+  log ("work pool: %" PRIu64 " offloaded, %" PRIu64 " completed, "
+       "%" PRIu64 " rejected; queue depth %zu (%zu at most), "
+       "%.1fus average wait (%" PRIu64 "us at most)",
+       stats.nr_submitted, stats.nr_completed, stats.nr_rejected,
+       stats.nr_queued, stats.max_queued, stats.avg_wait_us,
+       stats.max_wait_us);
+}
+
+static void
+log_coroutine_stats (void)
+{
+  size_t max_live = 0, nr_pooled = 0;
+  if (!server->__int.nr_coroutine_pools)
+    return;
+  for (size_t i = 0; i < server->__int.nr_coroutine_pools; ++i)
+    {
+      coropool_t pool = server->__int.coroutines[i];
+      max_live += pool->__int.max_live;
+      nr_pooled += pool->__int.nr_pooled;
+    }
+  log ("coroutines: %zu live at most across reactors, %zu stack(s) of "
+       "%zu KiB pooled", max_live, nr_pooled,
+       server->__int.coroutines[0]->__int.stack_size / 1024);
 }
 
 int
-main (int argc, const char ** argv)
+main (int argc, char ** argv)
 {
-  if (argc != 4)
-    panic ("usage: %s [path-to-routes: str] [host: str] [port: u16]",
+  struct tcp_server_config config = tcp_default_config;
+  int* cpu_affinity = NULL;
+  struct tcp_listener_config* listeners = NULL;
+  size_t nr_cpus = 0, nr_workers = 0, nr_listeners = 0,
+         nr_offload_threads = 0, max_offload_queued = 0,
+         coroutine_stack_kib = 0, max_coroutines_pooled = 0;
+  char* memory_input = NULL;
+  int opt;
+  while ((opt = getopt (argc, argv,
+                        "b:r:a:s:w:B:et:l:n:o:qNW:m:p:T:C:L:M:")) != -1)
+    switch (opt)
+      {
+      case 'b':
+        if (!strcmp (optarg, "epoll"))
+          config.backend = TCP_BACKEND_EPOLL;
+        else if (!strcmp (optarg, "uring"))
+          config.backend = TCP_BACKEND_IO_URING;
+        else if (!strcmp (optarg, "memory"))
+          config.backend = TCP_BACKEND_MEMORY;
+        else
+          argc = -1;
+        break;
+      case 'r':
+        config.reactors.nr_reactors = strtoul (optarg, NULL, 10);
+        break;
+      case 'a':
+        cpu_affinity = parse_cpu_list (optarg, &nr_cpus);
+        config.reactors.pin_to_cpus = true;
+        break;
+      case 's':
+        config.wait.spin_us = strtoul (optarg, NULL, 10);
+        break;
+      case 'w':
+        config.wait.block_timeout_ms = atoi (optarg);
+        break;
+      case 'B':
+        config.wait.busy_poll_us = strtoul (optarg, NULL, 10);
+        break;
+      case 'e':
+        config.accept.eager_read = true;
+        break;
+      case 't':
+        if (sscanf (optarg, "%u,%u,%u,%u,%u",
+                    &config.timeouts.header_read_ms,
+                    &config.timeouts.body_read_ms,
+                    &config.timeouts.idle_ms,
+                    &config.timeouts.write_stall_ms,
+                    &config.timeouts.drain_ms) < 4)
+          argc = -1;
+        break;
+      case 'l':
+        config.sockets.backlog = atoi (optarg);
+        break;
+      case 'n':
+        config.wait.max_events = atoi (optarg);
+        break;
+      case 'o':
+        if (sscanf (optarg, "%d,%d,%d,%d",
+                    &config.sockets.defer_accept_s,
+                    &config.sockets.fastopen_qlen,
+                    &config.sockets.sndbuf,
+                    &config.sockets.rcvbuf) != 4)
+          argc = -1;
+        break;
+      case 'q':
+        config.sockets.quickack = true;
+        break;
+      case 'N':
+        config.sockets.nodelay = false;
+        break;
+      case 'm':
+        config.limits.max_connections = strtoul (optarg, NULL, 10);
+        break;
+      case 'p':
+        nr_workers = strtoul (optarg, NULL, 10);
+        break;
+      case 'T':
+        if (sscanf (optarg, "%zu,%zu", &nr_offload_threads,
+                    &max_offload_queued) < 1)
+          argc = -1;
+        break;
+      case 'M':
+        free (memory_input);
+        memory_input = read_memory_script (optarg, &config);
+        break;
+      case 'C':
+        if (sscanf (optarg, "%zu,%zu", &coroutine_stack_kib,
+                    &max_coroutines_pooled) < 1)
+          argc = -1;
+        break;
+      case 'L':
+        listeners = realloc (listeners,
+                             (nr_listeners + 1) * sizeof (*listeners));
+        if (listeners == NULL)
+          panic ("failed to allocate listener list");
+        parse_listener (optarg, &listeners[nr_listeners++]);
+        break;
+      case 'W':
+        if (sscanf (optarg, "%zu,%u", &config.budget.nr_bytes,
+                    &config.budget.nr_callbacks) != 2)
+          argc = -1;
+        break;
+      default:
+        argc = -1;
+      }
+  /* the host and port may be left out when listeners are given, and are
+   * to be with the memory backend, which has nothing to listen on
+   */
+  bool in_memory = config.backend == TCP_BACKEND_MEMORY;
+  if ((memory_input != NULL) != in_memory)
+    argc = -1;
+  if (argc - optind != 3
+      && (!(nr_listeners || in_memory) || argc - optind != 1))
+    panic ("usage: %s [-b epoll|uring|memory] [-r reactors: u32] "
+           "[-a cpu-list: str] "
+           "[-s spin-us: u32] [-w block-timeout-ms: i32] "
+           "[-B busy-poll-us: u32] [-e] "
+           "[-t header-ms,body-ms,idle-ms,write-stall-ms[,drain-ms]: u32s] "
+           "[-l backlog: i32] [-n max-events: i32] "
+           "[-o defer-accept-s,fastopen-qlen,sndbuf,rcvbuf: i32s] [-q] [-N] "
+           "[-W budget-bytes,budget-callbacks: u32s] [-m max-connections: u32] "
+           "[-p workers: u32] [-T threads[,max-queued]: u32s] "
+           "[-C stack-kib[,max-pooled]: u32s] "
+           "[-M request-file,connections[,concurrent,chunk,window,hangup]: "
+           "str,u32s] "
+           "[-L listener: str]... "
+           "[path-to-routes: str] [host: str] [port: u16]",
            argv[0]);
+  if (cpu_affinity != NULL)
+    {
+      /* the reactor count follows the affinity list unless given */
+      if (!config.reactors.nr_reactors)
+        config.reactors.nr_reactors = nr_cpus;
+      if (config.reactors.nr_reactors > nr_cpus)
+        panic ("%zu reactors requested, but only %zu CPUs in affinity list",
+               config.reactors.nr_reactors, nr_cpus);
+      config.reactors.cpu_affinity = cpu_affinity;
+    }
+  if (nr_workers)
+    {
+      /* every worker would pin its reactors to the same CPUs */
+      if (cpu_affinity != NULL)
+        panic ("a CPU affinity list can't be shared between workers");
+      /* processes take the place of reactors unless both are asked for */
+      if (!config.reactors.nr_reactors)
+        config.reactors.nr_reactors = 1;
+    }
   
-  const char *path_to_routes = argv[1],
-             *host = argv[2];
-  const int port = atoi (argv[3]);
-  if (port <= 0 || port > 65535)
+  const char *path_to_routes = argv[optind],
+             *host = argc - optind == 3? argv[optind + 1]: NULL;
+  const int port = host != NULL? atoi (argv[optind + 2]): 0;
+  if (host != NULL && (port <= 0 || port > 65535))
     panic ("port not in range 0..65536");
+  config.listeners = listeners;
+  config.nr_listeners = nr_listeners;
+  config.memory.on_output = tally_memory_output;
 
   if (!check_exists_route_file (path_to_routes))
     panic ("route file: '%s' couldn't be found", path_to_routes);
@@ -71,19 +420,54 @@ main (int argc, const char ** argv)
        route_table->nr_routes, path_to_routes);
   route_table->register_routes (route_table_map);
   log ("registered all routes to their corresponding handlers");
-  log ("attempting to create and bind HTTP server to '%s:%d'", host, port);
+  log ("scanning request heads with %s kernels", g_httpscan.isa);
+  /* set when exec()d by a running instance that's handing over to us */
+  const char* handoff_fd = getenv (HTTP_HANDOFF_FD_ENV);
+  if (handoff_fd != NULL)
+    {
+      config.handoff_fd = atoi (handoff_fd);
+      unsetenv (HTTP_HANDOFF_FD_ENV);
+      log ("taking over listening sockets from previous instance");
+    }
+  else if (in_memory)
+    log ("creating HTTP server to play %zu in-memory connection(s)",
+         config.memory.nr_connections);
+  else if (host != NULL)
+    log ("attempting to create and bind HTTP server to '%s:%d'%s",
+         host, port, nr_listeners? " and other listeners": "");
+  else
+    log ("attempting to create and bind HTTP server to %zu listener(s)",
+         nr_listeners);
 
-  server = g_httpserver.create_and_bind_to (host, port);
+  server = g_httpserver.create_and_bind_with (host, port, &config);
+  free (cpu_affinity);
   server->set_route_table (route_table);
+  server->enable_upgrades (argv);
+  server->configure_offload (nr_offload_threads, max_offload_queued);
+  server->configure_coroutines (coroutine_stack_kib * 1024,
+                                max_coroutines_pooled);
 
-  if (signal (SIGINT, kbint_handler) == SIG_IGN)
-    signal (SIGINT, SIG_IGN);
-
-  server->start_event_loop ();
+  /* SIGINT and SIGTERM drain the event loop, which returns once done */
+  if (nr_workers)
+    server->start_workers (nr_workers);
+  else
+    {
+      uint64_t started_us = monotonic_us ();
+      server->start_event_loop ();
+      if (in_memory)
+        log_memory_stats (monotonic_us () - started_us);
+      log_loop_stats ();
+      log_offload_stats ();
+      log_coroutine_stats ();
+    }
 
   log ("all done, deallocating resources & exiting...");
   g_httpserver.free (server);
   g_route_parser.free (route_table);
+  for (size_t i = 0; i < nr_listeners; ++i)
+    free ((char*)listeners[i].address);
+  free (listeners);
+  free (memory_input);
   log ("done, goodbye!");
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+#include "../include/ringbuf.h"
+#include "../include/common.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t
+ringbuf_round_capacity (size_t capacity)
+{
+  size_t page_size = sysconf (_SC_PAGE_SIZE);
+  if (!capacity)
+    capacity = DEFAULT_RINGBUF_CAPACITY;
+  return (capacity + page_size - 1) / page_size * page_size;
+}
+
+static char*
+ringbuf_map_mirrored (size_t capacity)
+{
+  /* reserve twice the address space, map shared pages into the first half
+   * and alias them into the second; going without a memfd means a ring can
+   * still be had when the process is out of file descriptors
+   */
+  char* base = mmap (NULL, capacity << 1, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    panic ("failed to reserve ring buffer address space (size=%zu)",
+           capacity << 1);
+  if (mmap (base, capacity, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+    panic ("failed to create ring buffer backing memory (size=%zu)",
+           capacity);
+  /* an old size of 0 duplicates a shared mapping instead of moving it */
+  if (mremap (base, 0, capacity, MREMAP_MAYMOVE | MREMAP_FIXED,
+              base + capacity) == MAP_FAILED)
+    panic ("failed to mirror ring buffer mapping (size=%zu)", capacity);
+  return base;
+}
+
+size_t
+ringbuf_readable (ringbuf_t ring)
+{
+  return ring->__int.tail - ring->__int.head;
+}
+
+size_t
+ringbuf_writable (ringbuf_t ring)
+{
+  return ring->__int.capacity - ringbuf_readable (ring);
+}
+
+char*
+ringbuf_read_ptr (ringbuf_t ring)
+{
+  return ring->__int.base + ring->__int.head % ring->__int.capacity;
+}
+
+char*
+ringbuf_write_ptr (ringbuf_t ring)
+{
+  return ring->__int.base + ring->__int.tail % ring->__int.capacity;
+}
+
+void
+ringbuf_produce (ringbuf_t ring, size_t nr_bytes)
+{
+  if (nr_bytes > ringbuf_writable (ring))
+    panic ("tried to produce %zu byte(s) into ring with %zu free",
+           nr_bytes, ringbuf_writable (ring));
+  ring->__int.tail += nr_bytes;
+}
+
+void
+ringbuf_consume (ringbuf_t ring, size_t nr_bytes)
+{
+  if (nr_bytes > ringbuf_readable (ring))
+    panic ("tried to consume %zu byte(s) from ring with %zu buffered",
+           nr_bytes, ringbuf_readable (ring));
+  ring->__int.head += nr_bytes;
+  if (ring->__int.head == ring->__int.tail)
+    ring->__int.head = ring->__int.tail = 0;  /* keep hot data page-aligned */
+}
+
+void
+ringbuf_free (ringbuf_t ring)
+{
+  munmap (ring->__int.base, ring->__int.capacity << 1);
+  g_thunks.deallocate_thunk (ring->readable);
+  g_thunks.deallocate_thunk (ring->writable);
+  g_thunks.deallocate_thunk (ring->read_ptr);
+  g_thunks.deallocate_thunk (ring->write_ptr);
+  g_thunks.deallocate_thunk (ring->produce);
+  g_thunks.deallocate_thunk (ring->consume);
+  g_thunks.deallocate_thunk (ring->free);
+  free (ring);
+}
+
+ringbuf_t
+ringbuf_new (size_t capacity)
+{
+  ringbuf_t ring = calloc_ptr_type (ringbuf_t);
+  { /* initialize ring structure */
+    ring->__int.capacity = ringbuf_round_capacity (capacity);
+    ring->__int.base = ringbuf_map_mirrored (ring->__int.capacity);
+    ring->__int.head = ring->__int.tail = 0;
+  }
+  { /* allocate ring thunks */
+    ring->readable = g_thunks.allocate_thunk (
+      "ringbuf_readable",
+      ringbuf_readable, ring
+    );
+    ring->writable = g_thunks.allocate_thunk (
+      "ringbuf_writable",
+      ringbuf_writable, ring
+    );
+    ring->read_ptr = g_thunks.allocate_thunk (
+      "ringbuf_read_ptr",
+      ringbuf_read_ptr, ring
+    );
+    ring->write_ptr = g_thunks.allocate_thunk (
+      "ringbuf_write_ptr",
+      ringbuf_write_ptr, ring
+    );
+    ring->produce = g_thunks.allocate_thunk (
+      "ringbuf_produce",
+      ringbuf_produce, ring
+    );
+    ring->consume = g_thunks.allocate_thunk (
+      "ringbuf_consume",
+      ringbuf_consume, ring
+    );
+    ring->free = g_thunks.allocate_thunk (
+      "ringbuf_free",
+      ringbuf_free, ring
+    );
+  }
+  return ring;
+}
+
+struct __g_ringbuf g_ringbuf = {
+  .new = ringbuf_new
+};
@@ -109,8 +109,25 @@ __int_parse_route_table_entries (route_table_t route_table, FILE * f_route)
     __int_expect (f_route, NULL, SEPARATOR);
     if (__int_expect (f_route, &identifier, IDENTIFIER) == FEOF)
       break;
+    /* the identifier may be followed by keywords, cut off here */
+    char* keyword = identifier + strcspn (identifier, " \t");
+    enum route_mode mode = ROUTE_INLINE;
+    if (*keyword != '\0')
+      {
+        *keyword++ = '\0';
+        keyword += strspn (keyword, " \t");
+        keyword[strcspn (keyword, " \t")] = '\0';
+        if (!strcmp (keyword, KW_OFFLOAD))
+          mode = ROUTE_OFFLOAD;
+        else if (!strcmp (keyword, KW_COROUTINE))
+          mode = ROUTE_COROUTINE;
+        else if (*keyword != '\0')
+          panic ("parse error: unexpected '%s' after route identifier '%s'",
+                 keyword, identifier);
+      }
     route_table->routes[route_table->nr_routes++] = (struct __int_route){
       .handler = NULL,
+      .mode = mode,
       .match = __int_create_match_thunk (expression),
       .__int_ident = {
         .identifier = identifier,
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include "../include/tcpmemory.h"
+#include <poll.h>
+
+/* a connection in the making, or in play; its index is what its client's
+ * `sockfd` is set to
+ */
+struct __int_tcp_memory_slot
+{
+  tcp_client_t client;  /* NULL while the slot is free */
+  size_t id;
+  size_t nr_delivered;  /* of the script's input */
+  uint64_t fed_at;      /* the iteration a chunk was last delivered in */
+  size_t window_left;   /* of this iteration's output */
+  bool hung_up;
+  char* output;
+  size_t output_len, output_capacity;
+};
+
+struct __int_tcp_memory
+{
+  /* what the reactor's clients claim to be accepted on, it's never
+   * listened on
+   */
+  struct __int_tcp_listener listener;
+  struct __int_tcp_memory_slot* slots;
+  size_t nr_slots;
+  size_t nr_open;
+  size_t nr_left;   /* of the reactor's share, yet to be opened */
+  size_t next_id;
+  bool accepting;
+};
+
+static const struct tcp_listener_config __int_memory_listener = {
+  .family = TCP_LISTENER_UNIX,
+  .address = "memory"
+};
+
+static inline struct __int_tcp_memory*
+__int_memory_of (tcp_reactor_t reactor)
+{
+  return reactor->backend_state;
+}
+
+static inline struct __int_tcp_memory_slot*
+__int_memory_slot (tcp_client_t client)
+{
+  return &__int_memory_of (client->reactor)->slots[client->connection.sockfd];
+}
+
+static struct __int_tcp_memory*
+__int_memory_create (tcp_reactor_t reactor)
+{
+  /* the connections are dealt out as evenly as they go, the first
+   * reactors taking one more each if they don't
+   */
+  tcpserver_t server = reactor->server;
+  __auto_type config = &server->config.memory;
+  struct __int_tcp_memory* memory = calloc (1, sizeof (*memory));
+  if (memory == NULL)
+    panic ("failed to allocate memory backend state");
+  memory->listener = (struct __int_tcp_listener){
+    .reactor = reactor,
+    .config = &__int_memory_listener,
+    .sockfd = -1
+  };
+  size_t nr_reactors = server->__int_stream.nr_reactors;
+  memory->nr_left = config->nr_connections / nr_reactors
+                    + (reactor->id < config->nr_connections % nr_reactors);
+  memory->nr_slots = config->nr_concurrent? config->nr_concurrent
+                                          : DEFAULT_TCP_MEMORY_CONCURRENT;
+  memory->slots = calloc (memory->nr_slots, sizeof (*memory->slots));
+  if (memory->slots == NULL)
+    panic ("failed to allocate %zu in-memory connections",
+           memory->nr_slots);
+  memory->accepting = true;
+  return memory;
+}
+
+static void
+__int_memory_destroy (tcp_reactor_t reactor)
+{
+  struct __int_tcp_memory* memory = __int_memory_of (reactor);
+  for (size_t i = 0; i < memory->nr_slots; ++i)
+    free (memory->slots[i].output);
+  free (memory->slots);
+  free (memory);
+  reactor->backend_state = NULL;
+}
+
+static char*
+__int_memory_output_ptr (struct __int_tcp_memory_slot* slot, size_t len)
+{
+  /* room for `len` more bytes at the end of the slot's output */
+  if (slot->output_len + len > slot->output_capacity)
+    {
+      size_t capacity = slot->output_capacity? slot->output_capacity: 4096;
+      while (capacity < slot->output_len + len)
+        capacity <<= 1;
+      char* output = realloc (slot->output, capacity);
+      if (output == NULL)
+        panic ("failed to grow in-memory output to %zu bytes", capacity);
+      slot->output = output;
+      slot->output_capacity = capacity;
+    }
+  return slot->output + slot->output_len;
+}
+
+static bool
+__int_memory_flush (tcp_client_t self)
+{
+  /* whatever the window lets through is taken at once, and nothing more
+   * until the next iteration; file segments are read in like any other
+   */
+  struct __int_tcp_memory_slot* slot = __int_memory_slot (self);
+  __auto_type tx = &self->connection.tx;
+  while (tx->nr_segments && slot->window_left)
+    {
+      __auto_type segment = __int_ts_tx_segment_at (self, 0);
+      size_t len = segment->len - tx->offset;
+      if (len > slot->window_left)
+        len = slot->window_left;
+      char* output = __int_memory_output_ptr (slot, len);
+      if (segment->is_file)
+        {
+          ssize_t nr_read = segment->file.is_pipe
+            ? read (segment->file.fd, output, len)
+            : pread (segment->file.fd, output, len,
+                     segment->file.offset + tx->offset);
+          if (nr_read <= 0)
+            {
+              int err = nr_read? errno: ENODATA;
+              if (err == EINTR)
+                continue;
+              __int_ts_count_error (self->reactor, err);
+              debug ("failed to read file for in-memory connection (fd=%d): "
+                     "%s", self->connection.sockfd, strerror (err));
+              self->connection.peer_closed = true;
+              __int_ts_tx_discard (self);
+              return false;
+            }
+          len = nr_read;
+        }
+      else
+        memcpy (output, segment->base + tx->offset, len);
+      slot->output_len += len;
+      slot->window_left -= len;
+      __int_ts_tx_advance (self, len);
+    }
+  return true;
+}
+
+static bool
+__int_memory_refill (tcp_client_t client, size_t limit)
+{
+  /* a chunk per iteration at most, the script's end doubling as the
+   * client hanging up if it's meant to
+   */
+  struct __int_tcp_memory_slot* slot = __int_memory_slot (client);
+  __auto_type config = &client->reactor->server->config.memory;
+  ringbuf_t rx = client->connection.rx;
+  size_t len = config->input_len - slot->nr_delivered;
+  if (config->chunk && slot->fed_at == client->reactor->iteration)
+    return len > 0;
+  if (config->chunk && len > config->chunk)
+    len = config->chunk;
+  if (len > limit)
+    len = limit;
+  if (len > rx->writable ())
+    len = rx->writable ();
+  if (len)
+    {
+      memcpy (rx->write_ptr (), config->input + slot->nr_delivered, len);
+      rx->produce (len);
+      slot->nr_delivered += len;
+      slot->fed_at = client->reactor->iteration;
+    }
+  if (slot->nr_delivered < config->input_len)
+    return true;
+  if (config->hangup && !slot->hung_up)
+    {
+      debug ("in-memory connection (fd=%d) hung up",
+             client->connection.sockfd);
+      slot->hung_up = true;
+      client->connection.read_closed = true;
+    }
+  return false;
+}
+
+static bool
+__int_memory_open (struct __int_tcp_memory* memory, size_t window)
+{
+  /* as many connections as there are free slots, unless told to stop */
+  bool opened = false;
+  for (size_t i = 0; i < memory->nr_slots && memory->nr_left
+                     && memory->accepting; ++i)
+    {
+      struct __int_tcp_memory_slot* slot = &memory->slots[i];
+      if (slot->client != NULL)
+        continue;
+      slot->id = memory->next_id++;
+      slot->nr_delivered = 0;
+      slot->fed_at = 0;
+      slot->hung_up = false;
+      slot->output_len = 0;
+      slot->window_left = window? window: SIZE_MAX;
+      --memory->nr_left;
+      ++memory->nr_open;
+      /* a Unix peer, for lack of anything better to show for an address */
+      struct sockaddr_storage peer = {.ss_family = AF_UNIX};
+      slot->client = __int_ts_new_client (&memory->listener, i, &peer,
+                                          sizeof (peer.ss_family));
+      debug ("opened in-memory connection #%zu (fd=%zu) on reactor #%zu",
+             slot->id, i, memory->listener.reactor->id);
+      __int_ts_dispatch_connected (slot->client);
+      opened = true;
+    }
+  return opened;
+}
+
+static bool
+__int_memory_step (struct __int_tcp_memory_slot* slot, size_t window)
+{
+  /* one iteration's worth of input and output, false if neither moved */
+  tcp_client_t client = slot->client;
+  slot->window_left = window? window: SIZE_MAX;
+  if (client->connection.closing)
+    {
+      /* closed by the application, only the output queue is left */
+      if (!__int_memory_flush (client) || !client->connection.tx.nr_segments)
+        client->connection.op.close ();
+      return true;
+    }
+
+  bool progressed = false;
+  __auto_type config = &client->reactor->server->config.memory;
+  if ((slot->nr_delivered < config->input_len
+       || (config->hangup && !slot->hung_up))
+      && !client->budget.queued)
+    {
+      __int_ts_dispatch_readable (client, __int_memory_refill);
+      progressed = true;
+      if (slot->client != client || client->connection.closed
+          || client->connection.closing)
+        return true;
+    }
+
+  if (client->connection.tx.nr_segments)
+    {
+      if (!__int_memory_flush (client))
+        __int_ts_dispatch_disconnected (client);
+      else if (!client->connection.tx.nr_segments)
+        __int_ts_dispatch_writable (client);
+      progressed = true;
+    }
+  return progressed;
+}
+
+static void
+__int_memory_set_accepting (tcp_reactor_t reactor, bool accepting)
+{
+  __int_memory_of (reactor)->accepting = accepting;
+}
+
+static void
+__int_memory_release (tcp_client_t client)
+{
+  /* the client is done with as soon as its output has been handed over */
+  struct __int_tcp_memory* memory = __int_memory_of (client->reactor);
+  struct __int_tcp_memory_slot* slot = __int_memory_slot (client);
+  __auto_type config = &client->reactor->server->config.memory;
+  if (config->on_output != NULL)
+    config->on_output (config->data, slot->id, slot->output,
+                       slot->output_len);
+  if (slot->output_capacity > TCP_MEMORY_OUTPUT_KEEP)
+    {
+      free (slot->output);
+      slot->output = NULL;
+      slot->output_capacity = 0;
+    }
+  slot->client = NULL;
+  --memory->nr_open;
+  client->connection.__int.free ();
+}
+
+static bool
+__int_memory_watch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  /* there's no poller to wait on a descriptor with */
+  debug ("can't watch descriptor (fd=%d) with the memory backend",
+         watch->fd);
+  return false;
+}
+
+static void
+__int_memory_unwatch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+}
+
+static void*
+__int_memory_run (tcp_reactor_t reactor)
+{
+  __int_ts_pin_reactor (reactor);
+
+  struct __int_tcp_memory* memory = __int_memory_create (reactor);
+  reactor->backend_state = memory;
+  debug ("reactor #%zu playing %zu in-memory connection(s), %zu at a time",
+         reactor->id, memory->nr_left, memory->nr_slots);
+
+  size_t window = reactor->server->config.memory.window;
+  int signal_fd = reactor->id? -1: reactor->server->signals.fd;
+  struct pollfd fds[] = {
+    {.fd = reactor->wake_fd, .events = POLLIN},
+    {.fd = signal_fd, .events = POLLIN}
+  };
+  while (!__int_ts_drained (reactor))
+    {
+      ++reactor->iteration;
+      __int_ts_expire_deadlines (reactor);
+      bool progressed = __int_memory_open (memory, window);
+      for (size_t i = 0; i < memory->nr_slots; ++i)
+        if (memory->slots[i].client != NULL)
+          progressed |= __int_memory_step (&memory->slots[i], window);
+      __int_ts_run_ready (reactor, __int_memory_refill);
+      if (!memory->nr_left && !memory->nr_open && !reactor->drain.active)
+        {
+          /* which may well be done with already */
+          __int_ts_begin_drain (reactor);
+          progressed = true;
+        }
+
+      if (progressed || reactor->ready.head != NULL)
+        {
+          /* the kernel is kept out of it for as long as there's work,
+           * completions and drains are looked for without the eventfd
+           */
+          if (__atomic_load_n (&reactor->completions, __ATOMIC_ACQUIRE)
+                != NULL
+              || (!reactor->drain.active
+                  && __atomic_load_n (&reactor->drain.requested,
+                                      __ATOMIC_ACQUIRE)))
+            __int_ts_on_wake (reactor);
+          continue;
+        }
+      /* every connection is waiting on the server, or on a deadline */
+      int nr_ready = poll (fds, sizeof (fds) / sizeof (*fds),
+                           __int_ts_block_timeout (reactor));
+      if (nr_ready == -1 && errno != EINTR)
+        panic ("failed to poll reactor #%zu: %s", reactor->id,
+               strerror (errno));
+      if (nr_ready <= 0)
+        {
+          reactor->stats.block_timeouts += !nr_ready;
+          continue;
+        }
+      ++reactor->stats.block_wakeups;
+      reactor->stats.nr_events += nr_ready;
+      if (fds[0].revents & POLLIN)
+        __int_ts_on_wake (reactor);
+      if (fds[1].revents & POLLIN)
+        __int_ts_on_signals (reactor);
+    }
+  __int_memory_destroy (reactor);
+  return NULL;
+}
+
+const struct __int_tcp_backend __int_ts_memory_backend = {
+  .name = "memory",
+  .socketless = true,
+  .run = __int_memory_run,
+  .flush = __int_memory_flush,
+  .set_accepting = __int_memory_set_accepting,
+  .release = __int_memory_release,
+  .watch = __int_memory_watch,
+  .unwatch = __int_memory_unwatch
+};
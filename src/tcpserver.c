@@ -1,8 +1,68 @@
+#define _GNU_SOURCE
 #include "../include/tcpserver.h"
 #include "../include/thunks.h"
-#include <alloca.h>
+#include "../include/tcpuring.h"
+#include "../include/tcpmemory.h"
+#include <sched.h>
+#include <time.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <stddef.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <inttypes.h>
+
+const struct tcp_server_config tcp_default_config = {
+  .backend = TCP_BACKEND_EPOLL,
+  .reactors = {
+    .nr_reactors = DEFAULT_TCP_REACTORS,
+    .pin_to_cpus = false,
+    .cpu_affinity = NULL
+  },
+  .wait = {
+    .spin_us = DEFAULT_TCP_SPIN_US,
+    .block_timeout_ms = DEFAULT_TCP_BLOCK_TIMEOUT_MS,
+    .busy_poll_us = DEFAULT_TCP_BUSY_POLL_US,
+    .max_events = DEFAULT_TCP_MAX_EVENTS
+  },
+  .sockets = {
+    .backlog = DEFAULT_TCP_BACKLOG,
+    .nodelay = true,
+    .quickack = false,
+    .defer_accept_s = DEFAULT_TCP_DEFER_ACCEPT_S,
+    .fastopen_qlen = DEFAULT_TCP_FASTOPEN_QLEN,
+    .sndbuf = 0,
+    .rcvbuf = 0
+  },
+  .accept = {
+    .eager_read = false
+  },
+  .buffers = {
+    .rx_capacity = DEFAULT_RINGBUF_CAPACITY
+  },
+  .timeouts = {
+    .header_read_ms = DEFAULT_TCP_HEADER_READ_TIMEOUT_MS,
+    .body_read_ms = DEFAULT_TCP_BODY_READ_TIMEOUT_MS,
+    .idle_ms = DEFAULT_TCP_IDLE_TIMEOUT_MS,
+    .write_stall_ms = DEFAULT_TCP_WRITE_STALL_TIMEOUT_MS,
+    .drain_ms = DEFAULT_TCP_DRAIN_TIMEOUT_MS
+  },
+  .budget = {
+    .nr_bytes = DEFAULT_TCP_BUDGET_BYTES,
+    .nr_callbacks = DEFAULT_TCP_BUDGET_CALLBACKS
+  },
+  .limits = {
+    .max_connections = DEFAULT_TCP_MAX_CONNECTIONS
+  },
+  .listeners = NULL,
+  .nr_listeners = 0,
+  .handoff_fd = -1
+};
 
 inline static bool
 __int_set_nonblocking (tcp_sockfd_t sockfd)
@@ -26,211 +86,922 @@ __int_set_reuse_address (tcp_sockfd_t sockfd)
   ) != -1;
 }
 
-static struct __int_tcp_socket
-__int_create_tcp_socket (void)
+inline static bool
+__int_set_reuse_port (tcp_sockfd_t sockfd)
+{
+  debug ("trying to set SO_REUSEPORT on socket (fd=%d)", sockfd);
+  int optval = 1;
+  return setsockopt (
+    sockfd, SOL_SOCKET, SO_REUSEPORT,
+    &optval, sizeof (optval)
+  ) != -1;
+}
+
+inline static bool
+__int_set_busy_poll (tcp_sockfd_t sockfd, unsigned int busy_poll_us)
+{
+  debug ("trying to set SO_BUSY_POLL to %uus on socket (fd=%d)",
+         busy_poll_us, sockfd);
+  int optval = busy_poll_us;
+  return setsockopt (
+    sockfd, SOL_SOCKET, SO_BUSY_POLL,
+    &optval, sizeof (optval)
+  ) != -1;
+}
+
+inline static bool
+__int_set_int_option (tcp_sockfd_t sockfd, int level, int name,
+  const char* option, int value)
+{
+  debug ("trying to set %s to %d on socket (fd=%d)", option, value, sockfd);
+  return setsockopt (sockfd, level, name, &value, sizeof (value)) != -1;
+}
+
+static void
+__int_ts_tune_socket (tcpserver_t server, tcp_sockfd_t sockfd,
+  enum tcp_listener_family family, bool listener)
+{
+  /* nothing here is vital, a kernel lacking an option just goes without;
+   * Unix sockets only take the buffer sizes
+   */
+  __auto_type profile = &server->config.sockets;
+  bool tcp = family != TCP_LISTENER_UNIX;
+  struct
+  {
+    bool wanted;
+    int level, name, value;
+    const char* option;
+  } options[] = {
+    {listener && profile->nodelay, IPPROTO_TCP, TCP_NODELAY, 1,
+     "TCP_NODELAY"},
+    {listener && profile->defer_accept_s > 0, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+     profile->defer_accept_s, "TCP_DEFER_ACCEPT"},
+    {listener && profile->fastopen_qlen > 0, IPPROTO_TCP, TCP_FASTOPEN,
+     profile->fastopen_qlen, "TCP_FASTOPEN"},
+    {listener && profile->sndbuf > 0, SOL_SOCKET, SO_SNDBUF, profile->sndbuf,
+     "SO_SNDBUF"},
+    {listener && profile->rcvbuf > 0, SOL_SOCKET, SO_RCVBUF, profile->rcvbuf,
+     "SO_RCVBUF"},
+    {!listener && profile->quickack, IPPROTO_TCP, TCP_QUICKACK, 1,
+     "TCP_QUICKACK"}
+  };
+  for (size_t i = 0; i < sizeof (options) / sizeof (*options); ++i)
+    if (options[i].wanted && (tcp || options[i].level == SOL_SOCKET)
+        && !__int_set_int_option (sockfd, options[i].level, options[i].name,
+                                  options[i].option, options[i].value))
+      warn ("failed to set %s on TCP socket (fd=%d): %s",
+            options[i].option, sockfd, strerror (errno));
+}
+
+static int
+__int_ts_listener_domain (const struct tcp_listener_config* listener)
+{
+  switch (listener->family)
+    {
+    case TCP_LISTENER_INET:
+      return AF_INET;
+    case TCP_LISTENER_INET6:
+      return AF_INET6;
+    case TCP_LISTENER_UNIX:
+      return AF_UNIX;
+    }
+  panic ("unknown listener family (family=%d)", listener->family);
+}
+
+static socklen_t
+__int_ts_listener_address (const struct tcp_listener_config* listener,
+  struct sockaddr_storage* addr)
+{
+  memset (addr, 0, sizeof (*addr));
+  switch (listener->family)
+    {
+    case TCP_LISTENER_INET:
+      {
+        struct sockaddr_in* in = (struct sockaddr_in*)addr;
+        in->sin_family = AF_INET;
+        in->sin_port = htons (listener->port);
+        if (!inet_aton (listener->address, &in->sin_addr))
+          panic ("failed to convert address '%s' to in_addr_t",
+                 listener->address);
+        return sizeof (*in);
+      }
+    case TCP_LISTENER_INET6:
+      {
+        struct sockaddr_in6* in6 = (struct sockaddr_in6*)addr;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons (listener->port);
+        if (inet_pton (AF_INET6, listener->address, &in6->sin6_addr) != 1)
+          panic ("failed to convert address '%s' to struct in6_addr",
+                 listener->address);
+        return sizeof (*in6);
+      }
+    case TCP_LISTENER_UNIX:
+      {
+        /* an abstract name is the path's bytes after a leading NUL, with
+         * no terminator, so its length is exactly the name's
+         */
+        struct sockaddr_un* un = (struct sockaddr_un*)addr;
+        size_t len = strlen (listener->address);
+        un->sun_family = AF_UNIX;
+        if (!len || len >= sizeof (un->sun_path))
+          panic ("Unix socket path '%s' must be 1 to %zu bytes long",
+                 listener->address, sizeof (un->sun_path) - 1);
+        memcpy (un->sun_path, listener->address, len);
+        if (un->sun_path[0] != '@')
+          return sizeof (*un);
+        un->sun_path[0] = '\0';
+        return offsetof (struct sockaddr_un, sun_path) + len;
+      }
+    }
+  panic ("unknown listener family (family=%d)", listener->family);
+}
+
+static void
+__int_ts_format_listener (const struct tcp_listener_config* listener,
+  char* buf, size_t len)
+{
+  switch (listener->family)
+    {
+    case TCP_LISTENER_INET:
+      snprintf (buf, len, "%s:%hu", listener->address, listener->port);
+      break;
+    case TCP_LISTENER_INET6:
+      snprintf (buf, len, "[%s]:%hu", listener->address, listener->port);
+      break;
+    case TCP_LISTENER_UNIX:
+      snprintf (buf, len, "unix:%s", listener->address);
+      break;
+    }
+}
+
+static tcp_sockfd_t
+__int_create_listen_socket (const struct tcp_listener_config* listener,
+  bool reuse_port)
 {
-  tcp_sockfd_t sockfd = socket (AF_INET, SOCK_STREAM, 0);
+  /* kept from a binary that's exec()d to take over, which is handed the
+   * listeners it needs explicitly. SO_REUSEPORT on a Unix socket only ever
+   * lets one of them bind, so those are shared instead
+   */
+  bool tcp = listener->family != TCP_LISTENER_UNIX;
+  tcp_sockfd_t sockfd = socket (__int_ts_listener_domain (listener),
+                                SOCK_STREAM | SOCK_CLOEXEC, 0);
   if (sockfd == -1)
     panic (
-      "failed to create TCP socket"
+      "failed to create listening socket"
     );
-  debug ("created TCP socket (fd=%d)", sockfd);
-  if (!__int_set_reuse_address (sockfd))
+  debug ("created listening socket (fd=%d)", sockfd);
+  if (tcp && !__int_set_reuse_address (sockfd))
     panic (
       "failed to set SO_REUSEADDR on TCP socket (fd=%d)", sockfd
     );
-  return (struct __int_tcp_socket) {
-    .sockfd = sockfd,
-    .is_blocking = !__int_set_nonblocking (sockfd)
-  };
+  if (tcp && reuse_port && !__int_set_reuse_port (sockfd))
+    panic (
+      "failed to set SO_REUSEPORT on TCP socket (fd=%d)", sockfd
+    );
+  if (listener->family == TCP_LISTENER_INET6
+      && !__int_set_int_option (sockfd, IPPROTO_IPV6, IPV6_V6ONLY,
+                                "IPV6_V6ONLY", listener->v6_only))
+    panic (
+      "failed to set IPV6_V6ONLY on TCP socket (fd=%d)", sockfd
+    );
+  if (!__int_set_nonblocking (sockfd))
+    panic (
+      "failed to set listening socket (fd=%d) to non-blocking mode", sockfd
+    );
+  return sockfd;
+}
+
+static void
+__int_ts_unlink_stale_socket (const struct sockaddr_un* addr,
+  socklen_t addr_len)
+{
+  /* a path left behind by an instance that never got to unlink it, i.e.
+   * one that was killed, refuses connections; one that's accepted, or
+   * can't tell, belongs to a live server, and binding to it fails as it
+   * should
+   */
+  struct stat st;
+  if (lstat (addr->sun_path, &st) == -1 || !S_ISSOCK (st.st_mode))
+    return;
+  int probe = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (probe == -1)
+    return;
+  if (connect (probe, (const struct sockaddr*)addr, addr_len) == -1
+      && errno == ECONNREFUSED)
+    {
+      if (unlink (addr->sun_path) == -1)
+        warn ("failed to remove stale Unix socket '%s': %s",
+              addr->sun_path, strerror (errno));
+      else
+        debug ("removed stale Unix socket '%s'", addr->sun_path);
+    }
+  close (probe);
 }
 
 static tcpserver_t
 __int_ts_bind_server (tcpserver_t server)
 {
-  struct sockaddr_in addr = {
-    .sin_family = AF_INET,
-    .sin_port = htons (server->__int_bind_info.port),
-  };
-  if (!inet_aton (server->__int_bind_info.address, &addr.sin_addr))
-    panic (
-      "failed to convert address '%s' to in_addr_t",
-      server->__int_bind_info.address
-    );
-  if (bind (
-        server->__int_stream.self.sockfd,
-        (struct sockaddr*)&addr,
-        sizeof (addr)
-      ) == -1)
-    panic (
-      "%s() failed to bind TCP socket to address %s:%hu",
-      __func__, server->__int_bind_info.address, server->__int_bind_info.port
-    );
-  debug (
-    "bound TCP socket (fd=%d) to address %s:%hu",
-    server->__int_stream.self.sockfd,
-    server->__int_bind_info.address, server->__int_bind_info.port
-  );
+  if (server->config.handoff_fd != -1)
+    {
+      /* bound and listening already, all that's left is letting the
+       * previous instance know it can stop accepting
+       */
+      char ack = 1;
+      if (send (server->config.handoff_fd, &ack, sizeof (ack), MSG_NOSIGNAL)
+          != sizeof (ack))
+        panic ("failed to acknowledge handoff on socket (fd=%d): %s",
+               server->config.handoff_fd, strerror (errno));
+      close (server->config.handoff_fd);
+      server->config.handoff_fd = -1;
+      debug ("took over %zu listener(s) for %zu reactor(s)",
+             server->__int_bind_info.nr_listeners,
+             server->__int_stream.nr_reactors);
+      return server;
+    }
+  for (size_t i = 0; i < server->__int_bind_info.nr_listeners; ++i)
+    {
+      const struct tcp_listener_config* listener =
+        &server->__int_bind_info.listeners[i];
+      struct sockaddr_storage addr;
+      socklen_t addr_len = __int_ts_listener_address (listener, &addr);
+      char name[sizeof (struct sockaddr_un) + 16];
+      __int_ts_format_listener (listener, name, sizeof (name));
+      if (listener->family == TCP_LISTENER_UNIX && listener->address[0] != '@')
+        __int_ts_unlink_stale_socket ((struct sockaddr_un*)&addr, addr_len);
+      /* a shared socket is the same in every reactor, and bound once */
+      size_t nr_sockets = listener->family == TCP_LISTENER_UNIX
+        ? 1
+        : server->__int_stream.nr_reactors;
+      for (size_t j = 0; j < nr_sockets; ++j)
+        {
+          tcp_sockfd_t sockfd =
+            server->__int_stream.reactors[j].listeners[i].sockfd;
+          if (bind (sockfd, (struct sockaddr*)&addr, addr_len) == -1)
+            panic (
+              "%s() failed to bind listening socket to %s: %s",
+              __func__, name, strerror (errno)
+            );
+          debug ("bound listening socket (fd=%d) to %s", sockfd, name);
+        }
+    }
   return server;
 }
 
 __THUNK_DECL void
 __int_set_recv_low_watermark (tcp_client_t self, size_t watermark)
 {
+  if (self->reactor->backend->socketless)
+    return;
   if (setsockopt (
       self->connection.sockfd, SOL_SOCKET, SO_RCVLOWAT,
       &watermark, sizeof (watermark)
       ))
-    panic ("failed to set SO_RCVLOWAT to %zu", watermark);
+    {
+      __int_ts_count_error (self->reactor, errno);
+      debug ("failed to set SO_RCVLOWAT to %zu on TCP socket (fd=%d): %s",
+             watermark, self->connection.sockfd, strerror (errno));
+      return;
+    }
   debug ("set SO_RCVLOWAT to %zu", watermark);
 }
 
 static inline recv_ret_t
-__int_ts_generic_recv (tcp_client_t self, void* buf, size_t len, int flags)
+__int_ts_generic_recv (tcp_client_t self, void* buf, size_t len, bool consume)
+{
+  /* reads are served from the receive ring, which is filled by the event
+   * loop; a NULL `buf` just discards up to `len` buffered bytes
+   */
+  ringbuf_t rx = self->connection.rx;
+  size_t nr_buffered = rx->readable ();
+  if (!nr_buffered)
+    {
+      if (self->connection.read_closed || self->connection.peer_closed)
+        return 0;
+      errno = EAGAIN;
+      return -1;
+    }
+  if (len > nr_buffered)
+    len = nr_buffered;
+  if (buf != NULL)
+    memcpy (buf, rx->read_ptr (), len);
+  if (consume)
+    rx->consume (len);
+  debug ("read %zu byte(s) from receive buffer (fd=%d, consume=%d)",
+         len, self->connection.sockfd, consume);
+  return len;
+}
+
+__THUNK_DECL recv_ret_t
+__int_ts_recv (tcp_client_t self, void* buf, size_t len)
 {
-  recv_ret_t ret;
-  bool allocated_tmp_buf = false;
+  return __int_ts_generic_recv (self, buf, len, true);
+}
+
+__THUNK_DECL recv_ret_t
+__int_ts_peek (tcp_client_t self, void* buf, size_t len)
+{
+  return __int_ts_generic_recv (self, buf, len, false);
+}
 
-  if (buf == NULL)
+static bool
+__int_ts_fill (tcp_client_t self, size_t limit)
+{
+  /* one recv() per readable event until the socket runs dry (as required
+   * under edge-triggered epoll), the ring is full or `limit` bytes were
+   * read; the peer closing its end shows up as a zero-length read, which
+   * only ends the input, there's still a response to send it
+   */
+  ringbuf_t rx = self->connection.rx;
+  recv_ret_t nr_total = 0;
+  bool drained = false;
+  while (rx->writable () && (size_t)nr_total < limit)
     {
-      if (len > NULL_RECV_BUFFER_THRESHOLD)
+      size_t nr_wanted = rx->writable () < limit - nr_total
+                         ? rx->writable () : limit - nr_total;
+      recv_ret_t nr_read = recv (
+        self->connection.sockfd, rx->write_ptr (), nr_wanted, 0
+      );
+      if (nr_read > 0)
         {
-          debug ("allocating temporary heap (size=%zu) buffer",
-                len);
-          buf = calloc (sizeof (*buf), len);
-          allocated_tmp_buf = true;
-          if (buf == NULL)
-            panic ("failed to allocate temporary buffer");
-        }   
-      else
+          rx->produce (nr_read);
+          nr_total += nr_read;
+          continue;
+        }
+      if (nr_read == -1 && errno == EINTR)
+        continue;
+      if (nr_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+          drained = true;
+          break;
+        }
+      if (nr_read == -1)
+        {
+          __int_ts_count_error (self->reactor, errno);
+          self->connection.peer_closed = true;
+        }
+      debug ("TCP socket (fd=%d) closed by peer, reason: %s",
+             self->connection.sockfd, nr_read? strerror (errno): "EOF");
+      self->connection.read_closed = true;
+      break;
+    }
+  debug ("filled receive buffer with %zd byte(s) (fd=%d, buffered=%zu)",
+         nr_total, self->connection.sockfd, rx->readable ());
+  /* stopping short may have left data in the socket, which edge-triggered
+   * epoll won't report again
+   */
+  return !drained && !self->connection.read_closed;
+}
+
+enum tcp_error_class
+__int_ts_count_error (tcp_reactor_t reactor, int err)
+{
+  enum tcp_error_class class;
+  switch (err)
+    {
+    case EPIPE: case ECONNRESET: case ECONNABORTED: case ENOTCONN:
+    case ETIMEDOUT: case EHOSTUNREACH: case ENETUNREACH: case ENETDOWN:
+    case EPROTO:
+      class = TCP_ERROR_PEER;
+      break;
+    case EMFILE: case ENFILE: case ENOBUFS: case ENOMEM:
+      class = TCP_ERROR_RESOURCE;
+      break;
+    default:
+      class = TCP_ERROR_OTHER;
+    }
+  ++reactor->stats.nr_errors[class];
+  return class;
+}
+
+static bool
+__int_ts_set_want_writable (tcp_client_t self, bool want_writable)
+{
+  if (self->connection.tx.want_writable == want_writable)
+    return true;
+  struct epoll_event event = {
+    .data = {.fd = self->connection.sockfd},
+    .events = EPOLLIN | EPOLLET | (want_writable? EPOLLOUT: 0)
+  };
+  if (epoll_ctl (
+      self->reactor->poller, EPOLL_CTL_MOD, self->connection.sockfd, &event
+      ) == -1)
+    {
+      __int_ts_count_error (self->reactor, errno);
+      debug ("failed to %s EPOLLOUT on TCP socket (fd=%d): %s",
+             want_writable? "arm": "disarm", self->connection.sockfd,
+             strerror (errno));
+      return false;
+    }
+  self->connection.tx.want_writable = want_writable;
+  debug ("%s EPOLLOUT on TCP socket (fd=%d)",
+         want_writable? "armed": "disarmed", self->connection.sockfd);
+  return true;
+}
+
+static void
+__int_ts_watch_write_stall (tcp_client_t self, bool progressed)
+{
+  timerwheel_t timers = self->reactor->timers;
+  unsigned int timeout_ms = self->reactor->server->config.timeouts
+                            .write_stall_ms;
+  if (!self->connection.tx.nr_segments || !timeout_ms)
+    timers->cancel (&self->deadlines.write);
+  else if (progressed || !timerwheel_is_armed (&self->deadlines.write))
+    timers->arm (&self->deadlines.write, timeout_ms);
+}
+
+struct __int_tcp_tx_segment*
+__int_ts_tx_segment_at (tcp_client_t self, size_t index)
+{
+  __auto_type tx = &self->connection.tx;
+  return &tx->segments[(tx->head + index) % tx->capacity];
+}
+
+static void
+__int_ts_tx_push (tcp_client_t self, struct __int_tcp_tx_segment segment)
+{
+  __auto_type tx = &self->connection.tx;
+  if (tx->nr_segments == tx->capacity)
+    {
+      /* unroll the circular queue into a larger allocation */
+      size_t capacity = tx->capacity? tx->capacity << 1
+                                    : TCP_TX_INITIAL_SEGMENTS;
+      struct __int_tcp_tx_segment* segments = malloc (
+        capacity * sizeof (*segments)
+      );
+      if (segments == NULL)
+        panic ("failed to grow output queue to %zu segments", capacity);
+      for (size_t i = 0; i < tx->nr_segments; ++i)
+        segments[i] = *__int_ts_tx_segment_at (self, i);
+      free (tx->segments);
+      tx->segments = segments;
+      tx->capacity = capacity;
+      tx->head = 0;
+    }
+  *__int_ts_tx_segment_at (self, tx->nr_segments++) = segment;
+  tx->nr_pending += segment.len;
+  __int_ts_watch_write_stall (self, false);
+}
+
+static void
+__int_ts_tx_pop (tcp_client_t self, bool sent)
+{
+  __auto_type tx = &self->connection.tx;
+  struct __int_tcp_tx_segment segment = *__int_ts_tx_segment_at (self, 0);
+  tx->head = (tx->head + 1) % tx->capacity;
+  --tx->nr_segments;
+  tx->nr_pending -= segment.len - tx->offset;
+  tx->offset = 0;
+  if (segment.owned)
+    free ((void*)segment.base);
+  if (segment.on_done != NULL)
+    segment.on_done (self, segment.data, sent);
+}
+
+void
+__int_ts_tx_discard (tcp_client_t self)
+{
+  /* the queue's storage stays with the client, for its next connection */
+  while (self->connection.tx.nr_segments)
+    __int_ts_tx_pop (self, false);
+  self->connection.tx.head = 0;
+  __int_ts_watch_write_stall (self, false);
+}
+
+void
+__int_ts_tx_advance (tcp_client_t self, size_t nr_sent)
+{
+  __auto_type tx = &self->connection.tx;
+  bool progressed = nr_sent > 0;
+  while (nr_sent > 0)
+    {
+      __auto_type segment = __int_ts_tx_segment_at (self, 0);
+      size_t remaining = segment->len - tx->offset;
+      if (nr_sent < remaining)
         {
-          debug ("allocating temporary stack buffer (size=%zu)", len);
-          buf = alloca (len);
+          tx->offset += nr_sent;
+          tx->nr_pending -= nr_sent;
+          break;
         }
+      nr_sent -= remaining;
+      __int_ts_tx_pop (self, true);
+    }
+  /* zero-length segments complete without ever being written */
+  while (tx->nr_segments && !__int_ts_tx_segment_at (self, 0)->len)
+    __int_ts_tx_pop (self, true);
+  if (!self->connection.closed)
+    __int_ts_watch_write_stall (self, progressed);
+}
+
+send_ret_t
+__int_ts_tx_send_file (tcp_client_t self)
+{
+  /* sends from the head segment's file, carrying on from wherever the
+   * last call left off; the kernel moves the pages straight from the page
+   * cache (or the pipe) to the socket
+   */
+  __auto_type tx = &self->connection.tx;
+  __auto_type segment = __int_ts_tx_segment_at (self, 0);
+  size_t remaining = segment->len - tx->offset;
+  send_ret_t nr_sent;
+  if (segment->file.is_pipe)
+    nr_sent = splice (segment->file.fd, NULL, self->connection.sockfd, NULL,
+                      remaining, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  else
+    {
+      off_t offset = segment->file.offset + tx->offset;
+      nr_sent = sendfile (self->connection.sockfd, segment->file.fd,
+                          &offset, remaining);
     }
-  if ((ret = recv (
-      self->connection.sockfd, buf, len, flags
-      )) <= 0)
+  if (!nr_sent && remaining)
     {
-      warn ("failed to receive %zu byte(s) from TCP socket", len);
+      /* the file is shorter than promised, the response can't be finished */
+      errno = ENODATA;
       return -1;
     }
-  debug ("trying to receive %zu byte(s) from socket, got %zu (fd=%d, flags=%d)",
-         len, ret, self->connection.sockfd, flags);
-  if (allocated_tmp_buf)
+  return nr_sent;
+}
+
+static bool
+__int_ts_epoll_flush (tcp_client_t self)
+{
+  /* gather as many queued segments as fit in one sendmsg(), which is
+   * writev() plus MSG_NOSIGNAL, so that a reset peer can't SIGPIPE us;
+   * file segments go out on their own; returns false once the peer is gone
+   */
+  __auto_type tx = &self->connection.tx;
+  while (tx->nr_segments)
     {
-      warn ("temporary heap buffer deallocated, read %d bytes", ret);
-      free (buf);
+      send_ret_t nr_sent;
+      if (__int_ts_tx_segment_at (self, 0)->is_file)
+        nr_sent = __int_ts_tx_send_file (self);
+      else
+        {
+          struct iovec iov[TCP_TX_IOV_BATCH];
+          size_t nr_iov = 0;
+          for (; nr_iov < tx->nr_segments && nr_iov < TCP_TX_IOV_BATCH;
+               ++nr_iov)
+            {
+              __auto_type segment = __int_ts_tx_segment_at (self, nr_iov);
+              size_t skip = nr_iov? 0: tx->offset;
+              if (segment->is_file)
+                break;
+              iov[nr_iov] = (struct iovec){
+                .iov_base = (char*)segment->base + skip,
+                .iov_len = segment->len - skip
+              };
+            }
+          struct msghdr msg = {.msg_iov = iov, .msg_iovlen = nr_iov};
+          nr_sent = sendmsg (self->connection.sockfd, &msg, MSG_NOSIGNAL);
+        }
+      if (nr_sent == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+              /* without EPOLLOUT the queue would never drain */
+              if (__int_ts_set_want_writable (self, true))
+                return true;
+            }
+          else
+            __int_ts_count_error (self->reactor, errno);
+          debug ("failed to send to TCP socket (fd=%d), reason: %s",
+                 self->connection.sockfd, strerror (errno));
+          self->connection.peer_closed = true;
+          __int_ts_tx_discard (self);
+          return false;
+        }
+      debug ("sent %zd of %zu pending byte(s) (fd=%d)",
+             nr_sent, tx->nr_pending, self->connection.sockfd);
+      __int_ts_tx_advance (self, nr_sent);
     }
-  return ret;
+  __int_ts_set_want_writable (self, false);  /* at worst a spurious wakeup */
+  return true;
 }
 
-__THUNK_DECL recv_ret_t
-__int_ts_recv (tcp_client_t self, void* buf, size_t len)
+__THUNK_DECL send_ret_t
+__int_ts_sendv (tcp_client_t self, const struct iovec* iov, int iovcnt,
+  tcp_send_done_fn on_done, void* data)
 {
-  return __int_ts_generic_recv (self, buf, len, 0);
+  /* the buffers are borrowed until `on_done` fires, which it does exactly
+   * once, even if the batch is refused outright
+   */
+  if (self->connection.closed || self->connection.closing
+      || self->connection.peer_closed)
+    {
+      if (on_done != NULL)
+        on_done (self, data, false);
+      errno = EPIPE;
+      return -1;
+    }
+  send_ret_t nr_queued = 0;
+  for (int i = 0; i < iovcnt; ++i)
+    {
+      __int_ts_tx_push (self, (struct __int_tcp_tx_segment){
+        .base = iov[i].iov_base,
+        .len = iov[i].iov_len,
+        .on_done = i == iovcnt - 1? on_done: NULL,
+        .data = data
+      });
+      nr_queued += iov[i].iov_len;
+    }
+  if (!iovcnt && on_done != NULL)
+    __int_ts_tx_push (self, (struct __int_tcp_tx_segment){
+      .on_done = on_done, .data = data
+    });
+  if (!self->reactor->backend->flush (self))
+    {
+      errno = EPIPE;
+      return -1;
+    }
+  return nr_queued;
 }
 
-__THUNK_DECL recv_ret_t
-__int_ts_peek (tcp_client_t self, void* buf, size_t len)
+__THUNK_DECL send_ret_t
+__int_ts_sendfile (tcp_client_t self, int fd, off_t offset, size_t len,
+  tcp_send_done_fn on_done, void* data)
 {
-  return __int_ts_generic_recv (self, buf, len, MSG_PEEK);
+  struct stat st;
+  bool refused = self->connection.closed || self->connection.closing
+                 || self->connection.peer_closed;
+  if (refused || fstat (fd, &st) == -1)
+    {
+      int err = refused? EPIPE: errno;
+      if (on_done != NULL)
+        on_done (self, data, false);
+      errno = err;
+      return -1;
+    }
+  __int_ts_tx_push (self, (struct __int_tcp_tx_segment){
+    .len = len,
+    .is_file = true,
+    .file = {.fd = fd, .offset = offset, .is_pipe = S_ISFIFO (st.st_mode)},
+    .on_done = on_done,
+    .data = data
+  });
+  if (!self->reactor->backend->flush (self))
+    {
+      errno = EPIPE;
+      return -1;
+    }
+  return len;
 }
 
 __THUNK_DECL send_ret_t
 __int_ts_send (tcp_client_t self, void* buf, size_t len)
 {
-  send_ret_t ret;
-  if ((ret = send (
-      self->connection.sockfd, buf, len, 0
-      )) == -1)
-    panic ("failed to send() to TCP socket");
-  return ret;
+  /* whatever the socket won't take right away is copied into the output
+   * queue, so the caller's buffer is free to go once we return
+   */
+  if (self->connection.closed || self->connection.closing
+      || self->connection.peer_closed)
+    {
+      errno = EPIPE;
+      return -1;
+    }
+  size_t nr_sent = 0;
+  if (!self->connection.tx.nr_segments
+      && !self->reactor->backend->socketless)
+    {
+      send_ret_t ret;
+      do
+        ret = send (self->connection.sockfd, buf, len,
+                    MSG_NOSIGNAL | MSG_DONTWAIT);
+      while (ret == -1 && errno == EINTR);
+      if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+          __int_ts_count_error (self->reactor, errno);
+          self->connection.peer_closed = true;
+          return -1;
+        }
+      nr_sent = ret == -1? 0: ret;
+    }
+  if (nr_sent < len)
+    {
+      char* copy = malloc (len - nr_sent);
+      if (copy == NULL)
+        {
+          /* part of it may be out already, the stream can't be resumed */
+          __int_ts_count_error (self->reactor, ENOMEM);
+          debug ("failed to allocate %zu byte(s) of output queue (fd=%d)",
+                 len - nr_sent, self->connection.sockfd);
+          self->connection.peer_closed = true;
+          errno = ENOMEM;
+          return -1;
+        }
+      memcpy (copy, (char*)buf + nr_sent, len - nr_sent);
+      __int_ts_tx_push (self, (struct __int_tcp_tx_segment){
+        .base = copy,
+        .len = len - nr_sent,
+        .owned = true
+      });
+      if (!self->reactor->backend->flush (self))
+        return -1;
+    }
+  return len;
 }
 
 inline static void
-__int_start_listening (tcpserver_t server)
+__int_start_listening (tcp_reactor_t reactor)
 {
-  if (listen (
-      server->__int_stream.self.sockfd,
-      server->__int_bind_info.backlog
-     ) == -1)
-    panic (
-      "failed to listen on TCP socket (fd=%d)",
-      server->__int_stream.self.sockfd
-    );
-  debug (
-    "started listening on TCP socket (fd=%d)",
-    server->__int_stream.self.sockfd
-  );
+  for (size_t i = 0; i < reactor->nr_listeners; ++i)
+    {
+      tcp_listener_t listener = &reactor->listeners[i];
+      conn_backlog_t backlog = listener->config->backlog
+        ? listener->config->backlog
+        : reactor->server->__int_bind_info.backlog;
+      if (listener->config->family == TCP_LISTENER_UNIX && reactor->id)
+        continue;  /* shared with reactor #0 */
+      if (listen (listener->sockfd, backlog) == -1)
+        panic (
+          "failed to listen on socket (fd=%d)",
+          listener->sockfd
+        );
+      debug (
+        "started listening on socket (fd=%d) with a backlog of %d",
+        listener->sockfd, backlog
+      );
+    }
+}
+
+static tcp_port_t
+__int_ts_peer_port (const struct sockaddr_storage* peer)
+{
+  switch (peer->ss_family)
+    {
+    case AF_INET:
+      return ntohs (((const struct sockaddr_in*)peer)->sin_port);
+    case AF_INET6:
+      return ntohs (((const struct sockaddr_in6*)peer)->sin6_port);
+    }
+  return 0;
 }
 
 __THUNK_DECL
 struct __int_tcp_conninfo
 __int_ts_getaddr (tcp_client_t self)
 {
-  struct sockaddr_in addr;
-  socklen_t addrlen = sizeof (addr);
-  if (getpeername (
-      self->connection.sockfd, (struct sockaddr*)&addr, &addrlen
-    ) == -1)
-    panic (
-      "failed to get remote address of TCP socket (fd=%d)",
-      self->connection.sockfd
-    );
-  debug (
-    "got remote address of TCP socket (fd=%d) to %s:%hu",
-    self->connection.sockfd, inet_ntoa (addr.sin_addr), ntohs (addr.sin_port)
-  );
+  /* the peer address is captured by accept4(), and only formatted on the
+   * first request for it, into storage owned by the client
+   */
+  if (self->info.address == NULL)
+    {
+      /* backends that can't capture the address when accepting (i.e.
+       * multishot accept) leave it to be looked up here instead
+       */
+      if (!self->info.peer_len)
+        {
+          self->info.peer_len = sizeof (self->info.peer);
+          if (getpeername (
+              self->connection.sockfd, (struct sockaddr*)&self->info.peer,
+              &self->info.peer_len
+            ) == -1)
+            {
+              /* reset before it was ever looked at, the teardown is left
+               * to the event loop, which sees the hangup next
+               */
+              __int_ts_count_error (self->reactor, errno);
+              debug ("failed to get remote address of TCP socket (fd=%d): %s",
+                     self->connection.sockfd, strerror (errno));
+              self->info.peer_len = 0;
+              self->connection.peer_closed = true;
+              return (struct __int_tcp_conninfo) { .address = NULL };
+            }
+          self->info.port = __int_ts_peer_port (&self->info.peer);
+        }
+      const void* addr = NULL;
+      switch (self->info.peer.ss_family)
+        {
+        case AF_INET:
+          addr = &((struct sockaddr_in*)&self->info.peer)->sin_addr;
+          break;
+        case AF_INET6:
+          addr = &((struct sockaddr_in6*)&self->info.peer)->sin6_addr;
+          break;
+        case AF_UNIX:
+          /* a Unix peer is rarely bound, and has no address to speak of */
+          strcpy (self->info.address_buf, "unix:");
+          break;
+        }
+      if (self->info.peer.ss_family != AF_UNIX && (addr == NULL || inet_ntop (
+            self->info.peer.ss_family, addr,
+            self->info.address_buf, sizeof (self->info.address_buf)
+          ) == NULL))
+        {
+          __int_ts_count_error (self->reactor,
+                                addr == NULL? EAFNOSUPPORT: errno);
+          return (struct __int_tcp_conninfo) { .address = NULL };
+        }
+      self->info.address = self->info.address_buf;
+      debug (
+        "got remote address of TCP socket (fd=%d) to %s:%hu",
+        self->connection.sockfd, self->info.address, self->info.port
+      );
+    }
   return (struct __int_tcp_conninfo) {
-    .address = inet_ntoa (addr.sin_addr),
-    .port = ntohs (addr.sin_port)
+    .address = self->info.address,
+    .port = self->info.port
   };
 }
 
+static void
+__int_ts_clients_set (tcp_reactor_t reactor, tcp_sockfd_t sockfd,
+  tcp_client_t client)
+{
+  __auto_type clients = &reactor->clients;
+  if ((size_t)sockfd >= clients->capacity)
+    {
+      size_t capacity = clients->capacity? clients->capacity: 64;
+      while (capacity <= (size_t)sockfd)
+        capacity <<= 1;
+      tcp_client_t* by_fd = realloc (clients->by_fd,
+                                     capacity * sizeof (*by_fd));
+      if (by_fd == NULL)
+        panic ("failed to grow connection table to %zu entries", capacity);
+      memset (by_fd + clients->capacity, 0,
+              (capacity - clients->capacity) * sizeof (*by_fd));
+      clients->by_fd = by_fd;
+      clients->capacity = capacity;
+    }
+  clients->by_fd[sockfd] = client;
+}
+
+tcp_client_t
+__int_ts_clients_get (tcp_reactor_t reactor, tcp_sockfd_t sockfd)
+{
+  /* NULL for descriptors closed since their event was reported */
+  if (sockfd < 0 || (size_t)sockfd >= reactor->clients.capacity)
+    return NULL;
+  return reactor->clients.by_fd[sockfd];
+}
+
 __THUNK_DECL void
-__int_tcp_socket_free (tcp_client_t self)
+__int_ts_set_deadline (tcp_client_t self, enum tcp_deadline deadline)
 {
-  debug ("free()ing TCP socket thunk control structures (fd=%d)",
-         self->connection.sockfd);
+  /* a request head trickling in mustn't keep pushing its deadline back */
+  if (deadline == self->deadlines.read_kind
+      && timerwheel_is_armed (&self->deadlines.read))
+    return;
+  __auto_type timeouts = &self->reactor->server->config.timeouts;
+  unsigned int timeout_ms = 0;
+  switch (deadline)
+    {
+    case TCP_DEADLINE_NONE:
+      break;
+    case TCP_DEADLINE_HEADER_READ:
+      timeout_ms = timeouts->header_read_ms;
+      break;
+    case TCP_DEADLINE_BODY_READ:
+      timeout_ms = timeouts->body_read_ms;
+      break;
+    case TCP_DEADLINE_IDLE:
+      timeout_ms = timeouts->idle_ms;
+      if (self->reactor->drain.active
+          && (!timeout_ms || timeout_ms > TCP_DRAIN_IDLE_TIMEOUT_MS))
+        timeout_ms = TCP_DRAIN_IDLE_TIMEOUT_MS;
+      break;
+    }
+  self->deadlines.read_kind = deadline;
+  if (timeout_ms)
+    self->reactor->timers->arm (&self->deadlines.read, timeout_ms);
+  else
+    self->reactor->timers->cancel (&self->deadlines.read);
+}
 
-  /* make sure all thunks allocated in __int_ts_accept() are freed */
-  g_thunks.deallocate_thunk (self->connection.cfg.set_recv_low_watermark);
-  g_thunks.deallocate_thunk (self->connection.op.get_address);
-  g_thunks.deallocate_thunk (self->connection.op.recv);
-  g_thunks.deallocate_thunk (self->connection.op.peek);
-  g_thunks.deallocate_thunk (self->connection.op.send);
-  g_thunks.deallocate_thunk (self->connection.op.close);
-  g_thunks.deallocate_thunk (self->connection.__int.free);
+static void
+__int_ts_deadline_expired (void* data)
+{
+  /* nothing goes in or out any more, which also cuts a deferred close's
+   * wait on the output queue short
+   */
+  tcp_client_t client = data;
+  debug ("TCP socket (fd=%d) missed a deadline", client->connection.sockfd);
+  ++client->reactor->stats.nr_expired;
+  client->connection.peer_closed = true;
+  if (client->connection.closing)
+    client->connection.op.close ();
+  else
+    __int_ts_dispatch_disconnected (client);
 }
 
 __THUNK_DECL void
-__int_ts_socket_close (tcp_client_t self)
+__int_tcp_socket_free (tcp_client_t self)
 {
-  debug ("closing TCP socket (fd=%d)", self->connection.sockfd);
-  shutdown (self->connection.sockfd, SHUT_RDWR);
-  if (close (self->connection.sockfd) == -1)
-    panic ("failed to close TCP socket (fd=%d)", self->connection.sockfd);
-  self->connection.closed = true;
-  self->connection.__int.free ();
+  /* hands the client back to its reactor's pool, thunks, buffers and all */
+  debug ("returning TCP client (fd=%d) to pool", self->connection.sockfd);
+  tcp_reactor_t reactor = self->reactor;
+  self->next_free = reactor->pool.free;
+  reactor->pool.free = self;
+  --reactor->pool.nr_live;
 }
 
-tcp_client_t
-__int_ts_accept (tcpserver_t server)
+static void
+__int_ts_client_bind (tcp_client_t client, size_t rx_capacity)
 {
-  tcp_sockfd_t sockfd = accept (
-    server->__int_stream.self.sockfd,
-    NULL, NULL
-  );
-  if (sockfd == -1)
-    panic (
-      "failed to accept TCP socket (fd=%d)",
-      server->__int_stream.self.sockfd
-    );
-  tcp_client_t client = calloc (1, sizeof (struct __int_tcp_client));
-  if (client == NULL)
-    panic ("failed to allocate memory for TCP client");
-  client->connection.sockfd = sockfd;
+  /* only done the first time a pooled client is handed out, everything
+   * bound here is kept across connections
+   */
   client->connection.__int.free = g_thunks.allocate_thunk (
     "tcp_socket_free",
     __int_tcp_socket_free, client
@@ -247,145 +1018,1011 @@ __int_ts_accept (tcpserver_t server)
     "socket_send",
     __int_ts_send, client
   );
+  client->connection.op.sendv = g_thunks.allocate_thunk (
+    "socket_sendv",
+    __int_ts_sendv, client
+  );
+  client->connection.op.sendfile = g_thunks.allocate_thunk (
+    "socket_sendfile",
+    __int_ts_sendfile, client
+  );
   client->connection.op.peek = g_thunks.allocate_thunk (
     "socket_peek",
     __int_ts_peek, client
   );
   client->connection.cfg.set_recv_low_watermark = g_thunks.allocate_thunk (
     "socket_set_recv_low_watermark",
-    __int_set_recv_low_watermark, server
+    __int_set_recv_low_watermark, client
   );
   client->connection.op.close = g_thunks.allocate_thunk (
     "socket_close",
     __int_ts_socket_close, client
   );
-  client->connection.closed = false;
+  client->connection.cfg.set_deadline = g_thunks.allocate_thunk (
+    "socket_set_deadline",
+    __int_ts_set_deadline, client
+  );
+  client->connection.rx = g_ringbuf.new (rx_capacity);
+  client->deadlines.read = client->deadlines.write = (timerwheel_timer_t){
+    .on_expiry = __int_ts_deadline_expired,
+    .data = client
+  };
+}
 
-  return client;
+static void
+__int_ts_client_unbind (tcp_client_t client)
+{
+  if (client->connection.__int.free == NULL)
+    return;  /* never handed out */
+  g_thunks.deallocate_thunk (client->connection.cfg.set_recv_low_watermark);
+  g_thunks.deallocate_thunk (client->connection.op.get_address);
+  g_thunks.deallocate_thunk (client->connection.op.recv);
+  g_thunks.deallocate_thunk (client->connection.op.peek);
+  g_thunks.deallocate_thunk (client->connection.op.send);
+  g_thunks.deallocate_thunk (client->connection.op.sendv);
+  g_thunks.deallocate_thunk (client->connection.op.sendfile);
+  g_thunks.deallocate_thunk (client->connection.op.close);
+  g_thunks.deallocate_thunk (client->connection.cfg.set_deadline);
+  g_thunks.deallocate_thunk (client->connection.__int.free);
+  client->connection.rx->free ();
+  free (client->connection.tx.segments);
+  free (client->connection.uring.stash);
 }
 
-inline static tcp_client_t
-__int_configure_client (tcp_client_t self)
+static tcp_client_t
+__int_ts_pool_get (tcp_reactor_t reactor)
 {
-  if (!__int_set_nonblocking (self->connection.sockfd))
-    panic (
-      "failed to set client TCP socket to non-blocking (fd=%d)",
-      self->connection.sockfd
-    );
-  __auto_type conninfo = self->connection.op.get_address ();
-  debug (
-    "configured client TCP socket (fd=%d) at %s:%hu",
-    self->connection.sockfd, conninfo.address, conninfo.port
-  );
-  self->info.address = conninfo.address;
-  self->info.port = conninfo.port;
-  return self;
+  if (reactor->pool.free == NULL)
+    {
+      struct __int_tcp_client_slab* slab = calloc (1, sizeof (*slab));
+      if (slab == NULL)
+        panic ("failed to allocate slab of %d TCP clients",
+               TCP_CLIENT_SLAB_SIZE);
+      slab->next = reactor->pool.slabs;
+      reactor->pool.slabs = slab;
+      for (size_t i = TCP_CLIENT_SLAB_SIZE; i--;)
+        {
+          slab->clients[i].next_free = reactor->pool.free;
+          reactor->pool.free = &slab->clients[i];
+        }
+      reactor->pool.nr_clients += TCP_CLIENT_SLAB_SIZE;
+      debug ("grew client pool of reactor #%zu to %zu", reactor->id,
+             reactor->pool.nr_clients);
+    }
+  tcp_client_t client = reactor->pool.free;
+  reactor->pool.free = client->next_free;
+  ++reactor->pool.nr_live;
+  if (client->connection.__int.free == NULL)
+    __int_ts_client_bind (client, reactor->server->config.buffers.rx_capacity);
+  return client;
 }
 
-__THUNK_DECL void
-__int_ts_start_event_loop (tcpserver_t server)
+static void
+__int_ts_pool_destroy (tcp_reactor_t reactor)
 {
-  tcp_sockfd_t self_sockfd = server->__int_stream.self.sockfd;
-  conn_backlog_t self_backlog = server->__int_bind_info.backlog;
+  struct __int_tcp_client_slab* slab = reactor->pool.slabs;
+  while (slab != NULL)
+    {
+      struct __int_tcp_client_slab* next = slab->next;
+      for (size_t i = 0; i < TCP_CLIENT_SLAB_SIZE; ++i)
+        __int_ts_client_unbind (&slab->clients[i]);
+      free (slab);
+      slab = next;
+    }
+  reactor->pool.slabs = NULL;
+  reactor->pool.free = NULL;
+  free (reactor->clients.by_fd);
+  reactor->clients.by_fd = NULL;
+  reactor->clients.capacity = 0;
+}
 
-  __int_start_listening (server);
+static void
+__int_ts_pause_accept (tcp_reactor_t reactor, uint64_t backoff_ms)
+{
+  if (backoff_ms)
+    reactor->timers->arm (&reactor->accept.backoff, backoff_ms);
+  if (reactor->accept.paused)
+    return;
+  reactor->accept.paused = true;
+  ++reactor->stats.nr_accept_pauses;
+  reactor->backend->set_accepting (reactor, false);
+  debug ("reactor #%zu paused accepting, %zu connection(s) open",
+         reactor->id, reactor->accept.nr_connections);
+}
 
+static void
+__int_ts_resume_accept (tcp_reactor_t reactor)
+{
+  /* once there's room again, and not before the backoff is over; never
+   * while draining
+   */
+  if (!reactor->accept.paused || reactor->drain.active
+      || timerwheel_is_armed (&reactor->accept.backoff)
+      || (reactor->accept.max_connections
+          && reactor->accept.nr_connections
+             >= reactor->accept.max_connections))
+    return;
+  reactor->accept.paused = false;
+  reactor->backend->set_accepting (reactor, true);
+  debug ("reactor #%zu resumed accepting", reactor->id);
+}
+
+static void
+__int_ts_accept_backoff_expired (void* data)
+{
+  __int_ts_resume_accept (data);
+}
+
+void
+__int_ts_shed_connections (tcp_reactor_t reactor, bool back_off)
+{
+  /* out of descriptors: the reserve is given up to take each pending
+   * connection off the accept queue and close it at once, rather than
+   * leaving the listener to report the same connections forever; without
+   * a reserve to give up (or when asked to), the listener backs off for a
+   * while, or until one of the reactor's connections closes
+   */
+  if (reactor->accept.reserve_fd != -1)
+    {
+      close (reactor->accept.reserve_fd);
+      for (size_t i = 0; i < reactor->nr_listeners; ++i)
+        for (;;)
+          {
+            tcp_sockfd_t sockfd = accept4 (reactor->listeners[i].sockfd,
+                                           NULL, NULL, SOCK_CLOEXEC);
+            if (sockfd == -1 && errno == EINTR)
+              continue;
+            if (sockfd == -1)
+              break;
+            close (sockfd);
+            ++reactor->stats.nr_shed;
+          }
+      reactor->accept.reserve_fd = open ("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+  if (back_off || reactor->accept.reserve_fd == -1)
+    __int_ts_pause_accept (reactor, TCP_ACCEPT_BACKOFF_MS);
+  debug ("reactor #%zu shed pending connections, %" PRIu64 " so far",
+         reactor->id, reactor->stats.nr_shed);
+}
+
+static void
+__int_ts_drain_expired (void* data)
+{
+  /* whatever is still open is treated as having missed a deadline */
+  tcp_reactor_t reactor = data;
+  debug ("reactor #%zu ran out of time draining, closing %zu connection(s)",
+         reactor->id, reactor->accept.nr_connections);
+  for (size_t sockfd = 0; sockfd < reactor->clients.capacity; ++sockfd)
+    if (reactor->clients.by_fd[sockfd] != NULL)
+      __int_ts_deadline_expired (reactor->clients.by_fd[sockfd]);
+}
+
+static void
+__int_ts_shorten_idle (tcp_reactor_t reactor)
+{
+  /* a connection yet to send anything may be about to, so it isn't closed
+   * outright, but it doesn't get to hold the drain up for long either
+   */
+  for (size_t sockfd = 0; sockfd < reactor->clients.capacity; ++sockfd)
+    {
+      tcp_client_t client = reactor->clients.by_fd[sockfd];
+      if (client == NULL || client->deadlines.read_kind != TCP_DEADLINE_IDLE)
+        continue;
+      client->deadlines.read_kind = TCP_DEADLINE_NONE;
+      __int_ts_set_deadline (client, TCP_DEADLINE_IDLE);
+    }
+}
+
+void
+__int_ts_begin_drain (tcp_reactor_t reactor)
+{
+  /* connections already accepted are seen through, new ones are left in
+   * the listen backlog for whoever holds the listener next
+   */
+  reactor->drain.active = true;
+  reactor->timers->cancel (&reactor->accept.backoff);
+  __int_ts_pause_accept (reactor, 0);
+  if (reactor->server->config.timeouts.drain_ms)
+    reactor->timers->arm (&reactor->drain.deadline,
+                          reactor->server->config.timeouts.drain_ms);
+  __int_ts_shorten_idle (reactor);
+  debug ("reactor #%zu draining %zu connection(s)", reactor->id,
+         reactor->accept.nr_connections);
+}
+
+static void
+__int_ts_run_completions (tcp_reactor_t reactor)
+{
+  /* taken off in one go, and called back in the order they were pushed */
+  tcp_completion_t *completion = __atomic_exchange_n (
+    &reactor->completions, NULL, __ATOMIC_ACQUIRE
+  ), *in_order = NULL;
+  while (completion != NULL)
+    {
+      tcp_completion_t* next = completion->next;
+      completion->next = in_order;
+      in_order = completion;
+      completion = next;
+    }
+  while ((completion = in_order) != NULL)
+    {
+      in_order = completion->next;
+      completion->on_complete (completion->data);
+    }
+}
+
+void
+__int_ts_on_wake (tcp_reactor_t reactor)
+{
+  /* the counter is reset before the completions are taken off, so one
+   * pushed in between wakes the reactor up again rather than being missed
+   */
+  uint64_t nr_wakeups;
+  while (read (reactor->wake_fd, &nr_wakeups, sizeof (nr_wakeups)) == -1
+         && errno == EINTR)
+    ;
+  __int_ts_run_completions (reactor);
+  if (!reactor->drain.active
+      && __atomic_load_n (&reactor->drain.requested, __ATOMIC_ACQUIRE))
+    __int_ts_begin_drain (reactor);
+}
+
+bool
+__int_ts_drained (tcp_reactor_t reactor)
+{
+  /* clients that are closed but still referenced by the backend count
+   * too, they're only done with once back in the pool, and so do watches
+   * yet to be called back
+   */
+  return reactor->drain.active && !reactor->pool.nr_live
+         && !reactor->watches.nr_watches;
+}
+
+void
+__int_ts_on_signals (tcp_reactor_t reactor)
+{
+  tcpserver_t server = reactor->server;
+  struct signalfd_siginfo info;
+  ssize_t nr_read;
+  while ((nr_read = read (server->signals.fd, &info, sizeof (info)))
+         == sizeof (info))
+    {
+      __auto_type handler = &server->signals.handlers[info.ssi_signo];
+      debug ("reactor #%zu caught signal %u", reactor->id, info.ssi_signo);
+      if (handler->fn != NULL)
+        handler->fn (handler->data, &info);
+    }
+  if (nr_read == -1 && errno != EAGAIN && errno != EINTR)
+    warn ("failed to read from signalfd (fd=%d): %s", server->signals.fd,
+          strerror (errno));
+}
+
+static void
+__int_ts_ready_unlink (tcp_client_t client)
+{
+  tcp_reactor_t reactor = client->reactor;
+  if (!client->budget.queued)
+    return;
+  if (client->budget.prev != NULL)
+    client->budget.prev->budget.next = client->budget.next;
+  else
+    reactor->ready.head = client->budget.next;
+  if (client->budget.next != NULL)
+    client->budget.next->budget.prev = client->budget.prev;
+  else
+    reactor->ready.tail = client->budget.prev;
+  client->budget.prev = client->budget.next = NULL;
+  client->budget.queued = false;
+}
+
+__THUNK_DECL void
+__int_ts_socket_close (tcp_client_t self)
+{
+  if (self->connection.closed)
+    return;
+  __int_ts_ready_unlink (self);
+  if (self->connection.tx.nr_segments && !self->connection.peer_closed)
+    {
+      /* let the output queue drain first, the event loop finishes the close
+       * once it's empty
+       */
+      debug ("deferring close of TCP socket (fd=%d), %zu byte(s) pending",
+             self->connection.sockfd, self->connection.tx.nr_pending);
+      self->connection.closing = true;
+      if (self->reactor->backend->flush (self)
+          && self->connection.tx.nr_segments)
+        return;
+    }
+  debug ("closing TCP socket (fd=%d)", self->connection.sockfd);
+  __int_ts_tx_discard (self);
+  self->reactor->timers->cancel (&self->deadlines.read);
+  __int_ts_clients_set (self->reactor, self->connection.sockfd, NULL);
+  --self->reactor->accept.nr_connections;
+  if (!self->reactor->backend->socketless)
+    {
+      shutdown (self->connection.sockfd, SHUT_RDWR);
+      /* the descriptor is released even when close() fails, i.e. EINTR */
+      if (close (self->connection.sockfd) == -1)
+        {
+          __int_ts_count_error (self->reactor, errno);
+          debug ("failed to close TCP socket (fd=%d): %s",
+                 self->connection.sockfd, strerror (errno));
+        }
+    }
+  self->connection.closed = true;
+  tcp_reactor_t reactor = self->reactor;
+  if (reactor->backend->release != NULL)
+    reactor->backend->release (self);
+  else
+    self->connection.__int.free ();
+  /* a descriptor just came free, there's no need to wait out a backoff */
+  reactor->timers->cancel (&reactor->accept.backoff);
+  __int_ts_resume_accept (reactor);
+}
+
+static tcp_client_t
+__int_ts_accept (tcp_listener_t listener)
+{
+  tcp_reactor_t reactor = listener->reactor;
+  struct sockaddr_storage peer;
+  socklen_t peer_len;
+  tcp_sockfd_t sockfd;
+  do
+    {
+      peer_len = sizeof (peer);
+      sockfd = accept4 (
+        listener->sockfd,
+        (struct sockaddr*)&peer, &peer_len,
+        SOCK_NONBLOCK | SOCK_CLOEXEC
+      );
+    }
+  while (sockfd == -1 && (errno == EINTR || errno == ECONNABORTED));
+  if (sockfd == -1)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+          /* the connection is lost, the listener carries on */
+          __int_ts_count_error (reactor, errno);
+          debug ("failed to accept on socket (fd=%d): %s",
+                 listener->sockfd, strerror (errno));
+          if (errno == EMFILE || errno == ENFILE)
+            __int_ts_shed_connections (reactor, false);
+        }
+      return NULL;  /* accept queue drained, or given up on for now */
+    }
+  return __int_ts_new_client (listener, sockfd, &peer, peer_len);
+}
+
+tcp_client_t
+__int_ts_new_client (tcp_listener_t listener, tcp_sockfd_t sockfd,
+  const struct sockaddr_storage* peer, socklen_t peer_len)
+{
+  /* `peer_len` may be zero, the address is then looked up on demand */
+  tcp_reactor_t reactor = listener->reactor;
+  tcp_client_t client = __int_ts_pool_get (reactor);
+  client->connection.sockfd = sockfd;
+  client->info.address = NULL;
+  client->info.peer_len = peer_len;
+  client->info.port = 0;
+  if (peer_len)
+    {
+      memcpy (&client->info.peer, peer, peer_len);
+      client->info.port = __int_ts_peer_port (peer);
+    }
+  client->reactor = reactor;
+  client->listener = listener;
+  client->connection.closed = false;
+  client->connection.closing = false;
+  client->connection.read_closed = false;
+  client->connection.answering = false;
+  client->connection.peer_closed = false;
+  client->connection.is_blocking = false;
+  client->connection.rx->consume (client->connection.rx->readable ());
+  client->connection.tx.offset = 0;
+  client->connection.tx.nr_pending = 0;
+  client->connection.tx.want_writable = false;
+  client->connection.uring.nr_stashed = 0;
+  client->connection.uring.nr_inflight = 0;
+  client->connection.uring.nr_sends = 0;
+  client->connection.uring.recv_armed = false;
+  client->connection.uring.starved = false;
+  client->deadlines.read_kind = TCP_DEADLINE_NONE;
+  client->budget.iteration = 0;
+  client->budget.queued = false;
+  client->budget.prev = client->budget.next = NULL;
+  client->data = NULL;
+  if (++reactor->accept.nr_connections == reactor->accept.max_connections)
+    __int_ts_pause_accept (reactor, 0);
+  __int_ts_clients_set (reactor, sockfd, client);
+
+  return client;
+}
+
+tcp_client_t
+__int_ts_configure_client (tcp_reactor_t reactor, tcp_client_t self)
+{
+  /* non-blocking mode and the peer address already come from accept4() */
+  unsigned int busy_poll_us = reactor->server->config.wait.busy_poll_us;
+  if (busy_poll_us && !__int_set_busy_poll (self->connection.sockfd,
+                                            busy_poll_us))
+    debug ("failed to set SO_BUSY_POLL on client TCP socket (fd=%d)",
+           self->connection.sockfd);
+  __int_ts_tune_socket (reactor->server, self->connection.sockfd,
+                        self->listener->config->family, false);
+  debug (
+    "configured client TCP socket (fd=%d) from port %hu",
+    self->connection.sockfd, self->info.port
+  );
+  return self;
+}
+
+void
+__int_ts_pin_reactor (tcp_reactor_t reactor)
+{
+  if (reactor->cpu == TCP_REACTOR_UNPINNED)
+    return;
+  cpu_set_t cpus;
+  CPU_ZERO (&cpus);
+  CPU_SET (reactor->cpu, &cpus);
+  int err = pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+  if (err)
+    warn ("failed to pin reactor #%zu to CPU %d: %s",
+          reactor->id, reactor->cpu, strerror (err));
+  else
+    debug ("pinned reactor #%zu to CPU %d", reactor->id, reactor->cpu);
+}
+
+uint64_t
+__int_ts_monotonic_us (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void
+__int_ts_dispatch_connected (tcp_client_t client)
+{
+  tcpserver_t server = client->reactor->server;
+  if (server->callbacks.client_connected != NULL)
+    server->callbacks.client_connected (client);
+  else
+    warn ("no client connection callback registered");
+}
+
+void
+__int_ts_dispatch_disconnected (tcp_client_t client)
+{
+  tcpserver_t server = client->reactor->server;
+  if (server->callbacks.client_disconnected != NULL)
+    server->callbacks.client_disconnected (client);
+  else
+    warn ("no client disconnection callback registered");
+  client->connection.op.close ();
+}
+
+void
+__int_ts_dispatch_writable (tcp_client_t client)
+{
+  /* only called once the output queue has drained, so the writable
+   * callback means "drained, send more if you have any"; a peer that has
+   * stopped sending is done with once what it was owed has gone out
+   */
+  if (client->connection.read_closed && !client->connection.answering)
+    {
+      __int_ts_dispatch_disconnected (client);
+      return;
+    }
+  tcpserver_t server = client->reactor->server;
+  if (server->callbacks.client_writable != NULL)
+    server->callbacks.client_writable (client);
+  else
+    warn ("no client writable callback registered");
+}
+
+static void
+__int_ts_ready_push (tcp_client_t client)
+{
+  /* to the back of the ready list, for another turn next iteration */
+  tcp_reactor_t reactor = client->reactor;
+  client->budget.queued = true;
+  client->budget.queued_at = reactor->iteration;
+  client->budget.prev = reactor->ready.tail;
+  client->budget.next = NULL;
+  if (reactor->ready.tail != NULL)
+    reactor->ready.tail->budget.next = client;
+  else
+    reactor->ready.head = client;
+  reactor->ready.tail = client;
+  debug ("held back TCP socket (fd=%d) for the next iteration",
+         client->connection.sockfd);
+}
+
+static void
+__int_ts_hold_back (tcp_client_t client)
+{
+  if (client->budget.queued)
+    return;
+  ++client->reactor->stats.nr_budget_hits;
+  __int_ts_ready_push (client);
+}
+
+void
+__int_ts_resume_reading (tcp_client_t client)
+{
+  if (!client->budget.queued && !client->connection.closed
+      && !client->connection.closing)
+    __int_ts_ready_push (client);
+}
+
+static void
+__int_ts_renew_budget (tcp_client_t client)
+{
+  tcp_reactor_t reactor = client->reactor;
+  __auto_type budget = &reactor->server->config.budget;
+  if (client->budget.iteration == reactor->iteration)
+    return;
+  client->budget.iteration = reactor->iteration;
+  client->budget.nr_bytes = budget->nr_bytes? budget->nr_bytes: SIZE_MAX;
+  client->budget.nr_callbacks = budget->nr_callbacks? budget->nr_callbacks
+                                                     : UINT_MAX;
+}
+
+void
+__int_ts_dispatch_readable (tcp_client_t client,
+  bool (*refill)(tcp_client_t client, size_t limit))
+{
+  /* `refill` moves up to `limit` bytes of whatever the backend received
+   * into the receive ring, and reports whether more input may be held back,
+   * for lack of room or of budget
+   */
+  tcpserver_t server = client->reactor->server;
+  ringbuf_t rx = client->connection.rx;
+  size_t nr_buffered;
+  bool more_pending;
+  __int_ts_renew_budget (client);
+  do
+    {
+      if (!client->budget.nr_callbacks)
+        {
+          more_pending = true;
+          break;
+        }
+      size_t nr_before = rx->readable ();
+      more_pending = refill (client, client->budget.nr_bytes);
+      client->budget.nr_bytes -= rx->readable () - nr_before;
+      if (!(nr_buffered = rx->readable ()))
+        break;
+      --client->budget.nr_callbacks;
+      if (server->callbacks.client_readable != NULL)
+        server->callbacks.client_readable (client);
+      else
+        warn ("no client readable callback registered");
+      if (client->connection.closed || client->connection.closing)
+        return;
+    }
+  /* keep going for as long as the callback makes room */
+  while (more_pending && rx->readable () < nr_buffered);
+
+  /* a full ring that the callback won't drain is left as it is */
+  if (more_pending && rx->writable ()
+      && (!client->budget.nr_bytes || !client->budget.nr_callbacks))
+    __int_ts_hold_back (client);
+  /* after EOF, not before the output queue has drained and nothing more
+   * is to be sent
+   */
+  else if (__builtin_expect (client->connection.peer_closed, 0)
+           || (client->connection.read_closed
+               && !client->connection.tx.nr_segments
+               && !client->connection.answering))
+    __int_ts_dispatch_disconnected (client);
+}
+
+void
+__int_ts_run_ready (tcp_reactor_t reactor,
+  bool (*refill)(tcp_client_t client, size_t limit))
+{
+  /* everyone held back in an earlier iteration gets a turn, in order, and
+   * anyone held back again waits for the next iteration
+   */
+  tcp_client_t client;
+  while ((client = reactor->ready.head) != NULL
+         && client->budget.queued_at != reactor->iteration)
+    {
+      __int_ts_ready_unlink (client);
+      __int_ts_dispatch_readable (client, refill);
+    }
+}
+
+int
+__int_ts_block_timeout (tcp_reactor_t reactor)
+{
+  /* the configured block timeout, cut short by the next deadline due, or
+   * not blocking at all while there are connections held back
+   */
+  if (reactor->ready.head != NULL)
+    return 0;
+  int block_timeout_ms = reactor->server->config.wait.block_timeout_ms,
+      deadline_ms = reactor->timers->next_timeout ();
+  if (deadline_ms < 0)
+    return block_timeout_ms;
+  if (block_timeout_ms < 0 || deadline_ms < block_timeout_ms)
+    return deadline_ms;
+  return block_timeout_ms;
+}
+
+void
+__int_ts_expire_deadlines (tcp_reactor_t reactor)
+{
+  /* done straight after waking up, so that deadlines set while handling
+   * the events are counted from a fresh clock
+   */
+  reactor->timers->advance (__int_ts_monotonic_us () / 1000);
+}
+
+static int
+__int_ts_wait (tcp_reactor_t reactor, struct epoll_event* events,
+  int max_events)
+{
+  /* spinning keeps latency low while traffic is flowing, blocking keeps an
+   * idle reactor from burning its core; the spin budget is only paid when
+   * the reactor has nothing to do
+   */
+  unsigned long spin_us = reactor->server->config.wait.spin_us;
+  int nr_events;
+  if (spin_us && reactor->ready.head == NULL)
+    {
+      uint64_t deadline = __int_ts_monotonic_us () + spin_us;
+      do
+        {
+          nr_events = epoll_wait (reactor->poller, events, max_events, 0);
+          if (nr_events > 0)
+            {
+              ++reactor->stats.spin_hits;
+              reactor->stats.nr_events += nr_events;
+              return nr_events;
+            }
+          if (__builtin_expect (nr_events == -1 && errno != EINTR, 0))
+            return -1;
+        }
+      while (__int_ts_monotonic_us () < deadline);
+    }
+  nr_events = epoll_wait (
+    reactor->poller, events, max_events, __int_ts_block_timeout (reactor)
+  );
+  if (nr_events > 0)
+    {
+      ++reactor->stats.block_wakeups;
+      reactor->stats.nr_events += nr_events;
+    }
+  else if (!nr_events)
+    ++reactor->stats.block_timeouts;
+  else if (errno == EINTR)
+    return 0;
+  return nr_events;
+}
+
+static void
+__int_ts_client_event (tcp_reactor_t reactor, tcp_client_t client,
+  uint32_t events)
+{
+  debug ("got TCP socket (fd=%d) event on epoll instance (fd=%d)",
+         client->connection.sockfd, reactor->poller);
+  if (client->connection.closing)
+    {
+      /* closed by the application, only the output queue is left */
+      if (!__int_ts_epoll_flush (client) || !client->connection.tx.nr_segments)
+        client->connection.op.close ();
+      return;
+    }
+
+  __int_ts_dispatch_readable (client, __int_ts_fill);
+  if (client->connection.closed || client->connection.closing)
+    return;
+
+  if (events & EPOLLOUT)
+    {
+      if (!__int_ts_epoll_flush (client))
+        __int_ts_dispatch_disconnected (client);
+      else if (!client->connection.tx.nr_segments)
+        __int_ts_dispatch_writable (client);
+    }
+}
+
+static void
+__int_ts_register_client (tcp_reactor_t reactor, tcp_client_t client)
+{
   struct epoll_event event = {
-    .data = {.fd = self_sockfd},
-    .events = EPOLLIN
-  }, events[self_backlog];
-  poller_t poller = epoll_create1 (0);
+    .data = {.fd = client->connection.sockfd},
+    .events = EPOLLIN | EPOLLET
+  };
+  if (epoll_ctl (
+      reactor->poller, EPOLL_CTL_ADD, client->connection.sockfd,
+      &event
+      ) == -1)
+    {
+      /* the application never got to see it, so it's just dropped */
+      __int_ts_count_error (reactor, errno);
+      debug ("failed to add TCP socket (fd=%d) to epoll instance (fd=%d): %s",
+             client->connection.sockfd, reactor->poller, strerror (errno));
+      client->connection.op.close ();
+      return;
+    }
+
+  debug ("added TCP socket (fd=%d) to epoll instance (fd=%d)",
+         client->connection.sockfd, reactor->poller);
+  __int_ts_dispatch_connected (client);
+
+  if (reactor->server->config.accept.eager_read
+      && !client->connection.closed && !client->connection.closing)
+    {
+      /* a request that arrived along with the handshake (always the case
+       * with TCP_DEFER_ACCEPT) can be served now rather than after another
+       * trip through epoll_wait(); an empty socket costs a single EAGAIN
+       */
+      __int_ts_client_event (reactor, client, EPOLLIN);
+    }
+}
+
+static bool
+__int_ts_epoll_watch_listener (tcp_listener_t listener, bool watch)
+{
+  /* pre-forked workers, and reactors sharing a Unix socket, all wait on
+   * the same listener, a new connection only needs to wake one of them
+   */
+  tcp_reactor_t reactor = listener->reactor;
+  struct epoll_event event = {
+    .data = {.fd = listener->sockfd},
+    .events = EPOLLIN | EPOLLEXCLUSIVE
+  };
+  return epoll_ctl (
+    reactor->poller, watch? EPOLL_CTL_ADD: EPOLL_CTL_DEL,
+    listener->sockfd, &event
+  ) != -1;
+}
+
+static void
+__int_ts_epoll_set_accepting (tcp_reactor_t reactor, bool accepting)
+{
+  /* the listeners are level-triggered, so whatever queued up meanwhile is
+   * reported as soon as they're back in the set
+   */
+  for (size_t i = 0; i < reactor->nr_listeners; ++i)
+    if (!__int_ts_epoll_watch_listener (&reactor->listeners[i], accepting))
+      {
+        __int_ts_count_error (reactor, errno);
+        warn ("failed to %s socket (fd=%d) %s epoll instance (fd=%d): %s",
+              accepting? "add": "remove", reactor->listeners[i].sockfd,
+              accepting? "to": "from", reactor->poller, strerror (errno));
+      }
+}
+
+static tcp_listener_t
+__int_ts_epoll_listener (tcp_reactor_t reactor, int fd)
+{
+  for (size_t i = 0; i < reactor->nr_listeners; ++i)
+    if (reactor->listeners[i].sockfd == fd)
+      return &reactor->listeners[i];
+  return NULL;
+}
+
+static bool
+__int_ts_epoll_watch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  __auto_type watches = &reactor->watches;
+  if (watch->fd < 0)
+    return false;
+  if ((size_t)watch->fd >= watches->capacity)
+    {
+      size_t capacity = watches->capacity? watches->capacity: 64;
+      while (capacity <= (size_t)watch->fd)
+        capacity <<= 1;
+      tcp_watch_t** by_fd = realloc (watches->by_fd,
+                                     capacity * sizeof (*by_fd));
+      if (by_fd == NULL)
+        panic ("failed to grow watch table to %zu entries", capacity);
+      memset (by_fd + watches->capacity, 0,
+              (capacity - watches->capacity) * sizeof (*by_fd));
+      watches->by_fd = by_fd;
+      watches->capacity = capacity;
+    }
+  struct epoll_event event = {
+    .data = {.fd = watch->fd},
+    .events = (watch->writable? EPOLLOUT: EPOLLIN) | EPOLLONESHOT
+  };
+  if (watches->by_fd[watch->fd] != NULL
+      || epoll_ctl (reactor->poller, EPOLL_CTL_ADD, watch->fd, &event) == -1)
+    {
+      debug ("failed to watch descriptor (fd=%d) on epoll instance (fd=%d): "
+             "%s", watch->fd, reactor->poller,
+             watches->by_fd[watch->fd] != NULL? "watched already"
+                                              : strerror (errno));
+      return false;
+    }
+  watches->by_fd[watch->fd] = watch;
+  ++watches->nr_watches;
+  return true;
+}
+
+static void
+__int_ts_epoll_watch_done (tcp_reactor_t reactor, tcp_watch_t* watch,
+  bool ready)
+{
+  reactor->watches.by_fd[watch->fd] = NULL;
+  --reactor->watches.nr_watches;
+  epoll_ctl (reactor->poller, EPOLL_CTL_DEL, watch->fd, NULL);
+  watch->on_ready (watch->data, ready);
+}
+
+static void
+__int_ts_epoll_unwatch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  if (watch->fd >= 0 && (size_t)watch->fd < reactor->watches.capacity
+      && reactor->watches.by_fd[watch->fd] == watch)
+    __int_ts_epoll_watch_done (reactor, watch, false);
+}
+
+static tcp_watch_t*
+__int_ts_epoll_watched (tcp_reactor_t reactor, int fd)
+{
+  if (fd < 0 || (size_t)fd >= reactor->watches.capacity)
+    return NULL;
+  return reactor->watches.by_fd[fd];
+}
+
+static void*
+__int_ts_epoll_run (tcp_reactor_t reactor)
+{
+  tcpserver_t server = reactor->server;
+  int max_events = server->config.wait.max_events;
+
+  __int_ts_pin_reactor (reactor);
+
+  struct epoll_event event, events[max_events];
+  poller_t poller = reactor->poller = epoll_create1 (EPOLL_CLOEXEC);
   
   if (poller == -1)
     panic ("failed to create epoll instance");
-  debug ("created epoll instance (fd=%d)", poller);
+  debug ("created epoll instance (fd=%d) for reactor #%zu",
+         poller, reactor->id);
   
-  if (epoll_ctl (
-      poller, EPOLL_CTL_ADD, self_sockfd, &event
-     ) == -1)
-    panic (
-      "failed to add TCP socket (fd=%d) to epoll instance (fd=%d)",
-      self_sockfd, poller
-    );
+  for (size_t i = 0; i < reactor->nr_listeners; ++i)
+    if (!__int_ts_epoll_watch_listener (&reactor->listeners[i], true))
+      panic (
+        "failed to add listening socket (fd=%d) to epoll instance (fd=%d)",
+        reactor->listeners[i].sockfd, poller
+      );
+  event = (struct epoll_event){
+    .data = {.fd = reactor->wake_fd},
+    .events = EPOLLIN
+  };
+  if (epoll_ctl (poller, EPOLL_CTL_ADD, reactor->wake_fd, &event) == -1)
+    panic ("failed to add eventfd (fd=%d) to epoll instance (fd=%d)",
+           reactor->wake_fd, poller);
+  int signal_fd = reactor->id? -1: server->signals.fd;
+  event = (struct epoll_event){
+    .data = {.fd = signal_fd},
+    .events = EPOLLIN
+  };
+  if (signal_fd != -1
+      && epoll_ctl (poller, EPOLL_CTL_ADD, signal_fd, &event) == -1)
+    panic ("failed to add signalfd (fd=%d) to epoll instance (fd=%d)",
+           signal_fd, poller);
 
-  for (;;)
+  while (!__int_ts_drained (reactor))
     {
-      int nr_fds = epoll_wait (poller, events, self_backlog, 0);
+      int nr_fds = __int_ts_wait (reactor, events, max_events);
       if (__builtin_expect (nr_fds == -1, 0))
         panic ("failed to epoll_wait() on epoll instance (fd=%d)",
                poller);
+      ++reactor->iteration;
+      __int_ts_expire_deadlines (reactor);
       for (size_t i = 0; i < nr_fds; ++i)
-        if (events[i].data.fd == self_sockfd)
-          {
-            tcp_client_t client = __int_configure_client(
-              __int_ts_accept (server)
-            );
-            event.data.fd = client->connection.sockfd;
-            event.data.ptr = client;
-            event.events = EPOLLIN | EPOLLOUT | EPOLLET;
-
-            if (epoll_ctl (
-                poller, EPOLL_CTL_ADD, client->connection.sockfd,
-                &event
-                ) == -1)
-              panic (
-                "failed to add TCP socket (fd=%d) to epoll instance (fd=%d)",
-                client->connection.sockfd, poller
-              );
-
-            debug ("added TCP socket (fd=%d) to epoll instance (fd=%d)",
-                   client->connection.sockfd, poller);
-            if (server->callbacks.client_connected != NULL)
-              server->callbacks.client_connected (client);
-            else
-              warn ("no client connection callback registered");
-          }
-        else  /* if not server socket */
-          {
-            tcp_client_t client = events[i].data.ptr;
-            debug ("got TCP socket (fd=%d) event on epoll instance (fd=%d)",
-                   client->connection.sockfd, poller);
-            /* this is preemptive; works if there is no user data in the
-             * buffer, otherwise closing is handled at application level
-             */
-            recv_ret_t nr_read = __int_ts_peek (
-              client, NULL, 1
-            );
-            if (__builtin_expect (nr_read <= 0, 0))
-              {
-                debug ("TCP socket (fd=%d) closed by peer, reason: %s",
-                       client->connection.sockfd, strerror (errno));
-                if (server->callbacks.client_disconnected != NULL)
-                  server->callbacks.client_disconnected (client);
-                else
-                  warn ("no client disconnection callback registered");
-                if (epoll_ctl (
-                    poller, EPOLL_CTL_DEL, client->connection.sockfd,
-                    NULL
-                   ) == -1)
-                  panic ("failed to remove TCP socket (fd=%d) from epoll "
-                         "instance (fd=%d)", client->connection.sockfd, poller);
-                client->connection.op.close ();
-                continue;
-              }
-            
-            if (events[i].events | EPOLLIN)
-              {
-                if (server->callbacks.client_readable != NULL)
-                  server->callbacks.client_readable (client);
-                else
-                  warn ("no client readable callback registered");
-              }
-            
-            if (events[i].events | EPOLLOUT)
-              {
-                if (server->callbacks.client_writable != NULL)
-                  server->callbacks.client_writable (client);
-                else
-                  warn ("no client writable callback registered");
-              }
-          }
+        {
+          int fd = events[i].data.fd;
+          /* an earlier event in this batch may have closed the client */
+          tcp_client_t client = __int_ts_clients_get (reactor, fd);
+          tcp_listener_t listener;
+          tcp_watch_t* watch;
+          if (client != NULL)
+            __int_ts_client_event (reactor, client, events[i].events);
+          else if (fd == reactor->wake_fd)
+            __int_ts_on_wake (reactor);
+          else if (fd == signal_fd)
+            __int_ts_on_signals (reactor);
+          else if ((watch = __int_ts_epoll_watched (reactor, fd)) != NULL)
+            __int_ts_epoll_watch_done (reactor, watch, true);
+          else if ((listener = __int_ts_epoll_listener (reactor, fd)) != NULL)
+            {
+              /* drain the whole accept queue, a single wakeup on the
+               * listener may stand for any number of pending connections
+               */
+              while (!reactor->accept.paused
+                     && (client = __int_ts_accept (listener)) != NULL)
+                __int_ts_register_client (
+                  reactor, __int_ts_configure_client (reactor, client)
+                );
+            }
+        }
+      __int_ts_run_ready (reactor, __int_ts_fill);
+    }
+  return NULL;
+}
+
+const struct __int_tcp_backend __int_ts_epoll_backend = {
+  .name = "epoll",
+  .run = __int_ts_epoll_run,
+  .flush = __int_ts_epoll_flush,
+  .set_accepting = __int_ts_epoll_set_accepting,
+  .release = NULL,  /* close() already drops the socket from the epoll set */
+  .watch = __int_ts_epoll_watch,
+  .unwatch = __int_ts_epoll_unwatch
+};
+
+__THUNK_DECL void
+__int_ts_start_event_loop (tcpserver_t server)
+{
+  size_t nr_reactors = server->__int_stream.nr_reactors;
+  for (size_t i = 0; i < nr_reactors; ++i)
+    {
+      /* an eventfd from before a fork() would be shared with the other
+       * workers, each taking wakeups meant for the others; the new one is
+       * swapped in under the same descriptor, and starts out signalled in
+       * case a drain was requested already
+       */
+      tcp_reactor_t reactor = &server->__int_stream.reactors[i];
+      int wake_fd = eventfd (1, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (wake_fd == -1
+          || dup3 (wake_fd, reactor->wake_fd, O_CLOEXEC) == -1)
+        panic ("failed to create eventfd for reactor #%zu: %s", i,
+               strerror (errno));
+      close (wake_fd);
+      __int_start_listening (reactor);
+    }
+
+  /* blocked before any reactor thread exists, so that the signals are only
+   * ever taken off the signalfd
+   */
+  sigset_t saved_mask;
+  bool has_signals = !sigisemptyset (&server->signals.mask);
+  if (has_signals)
+    {
+      pthread_sigmask (SIG_BLOCK, &server->signals.mask, &saved_mask);
+      server->signals.fd = signalfd (-1, &server->signals.mask,
+                                     SFD_NONBLOCK | SFD_CLOEXEC);
+      if (server->signals.fd == -1)
+        panic ("failed to create signalfd: %s", strerror (errno));
+    }
+
+  /* the calling thread doubles as reactor #0 so that the event loop keeps
+   * blocking its caller, the rest each get a thread of their own
+   */
+  for (size_t i = 1; i < nr_reactors; ++i)
+    {
+      tcp_reactor_t reactor = &server->__int_stream.reactors[i];
+      int err = pthread_create (
+        &reactor->thread, NULL,
+        (void* (*)(void*))reactor->backend->run, reactor
+      );
+      if (err)
+        panic ("failed to spawn thread for reactor #%zu: %s",
+               i, strerror (err));
+      debug ("spawned thread for reactor #%zu", i);
+    }
+  server->__int_stream.reactors[0].thread = pthread_self ();
+  server->__int_stream.reactors[0].backend->run (
+    &server->__int_stream.reactors[0]
+  );
+
+  for (size_t i = 1; i < nr_reactors; ++i)
+    pthread_join (server->__int_stream.reactors[i].thread, NULL);
+  if (has_signals)
+    {
+      close (server->signals.fd);
+      server->signals.fd = -1;
+      pthread_sigmask (SIG_SETMASK, &saved_mask, NULL);
     }
+  debug ("all reactors have drained");
 }
 
 static void
@@ -397,21 +2034,278 @@ __int_allocate_thunks (tcpserver_t server)
   );
 }
 
+static const struct __int_tcp_backend*
+__int_ts_select_backend (enum tcp_backend_type type)
+{
+  switch (type)
+    {
+    case TCP_BACKEND_EPOLL:
+      return &__int_ts_epoll_backend;
+    case TCP_BACKEND_IO_URING:
+#ifdef TCP_HAVE_IO_URING
+      return &__int_ts_uring_backend;
+#else
+      panic ("built without io_uring support");
+#endif
+    case TCP_BACKEND_MEMORY:
+      return &__int_ts_memory_backend;
+    }
+  panic ("unknown TCP backend (type=%d)", type);
+}
+
+static size_t
+__int_ts_nr_online_cpus (void)
+{
+  long nr_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  return nr_cpus > 0? (size_t)nr_cpus: 1;
+}
+
+static size_t
+__int_ts_nr_sockets (tcpserver_t server, size_t nr_reactors)
+{
+  /* as laid out in a handoff: listener by listener, one socket per reactor
+   * for TCP listeners, and a single one for Unix listeners
+   */
+  size_t nr_sockets = 0;
+  for (size_t i = 0; i < server->__int_bind_info.nr_listeners; ++i)
+    nr_sockets += server->__int_bind_info.listeners[i].family
+                  == TCP_LISTENER_UNIX? 1: nr_reactors;
+  return nr_sockets;
+}
+
+static size_t
+__int_ts_take_over (tcpserver_t server, int* sockets)
+{
+  /* the previous instance ran the same command line, so its listeners are
+   * expected to be the same as ours, only its reactor count may differ
+   */
+  int sockfd = server->config.handoff_fd;
+  uint32_t layout[2];  /* reactors, listeners */
+  struct iovec iov = {.iov_base = layout, .iov_len = sizeof (layout)};
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (TCP_HANDOFF_MAX_LISTENERS * sizeof (int))];
+  } control;
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buf,
+    .msg_controllen = sizeof (control.buf)
+  };
+  ssize_t nr_read;
+  do
+    nr_read = recvmsg (sockfd, &msg, MSG_CMSG_CLOEXEC);
+  while (nr_read == -1 && errno == EINTR);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR (&msg);
+  if (nr_read != sizeof (layout) || cmsg == NULL
+      || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+      || msg.msg_flags & MSG_CTRUNC)
+    panic ("failed to take over listening sockets on handoff socket (fd=%d)",
+           sockfd);
+  size_t nr_received = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+  if (layout[1] != server->__int_bind_info.nr_listeners)
+    panic ("%" PRIu32 " listeners were handed over, but %zu are configured",
+           layout[1], server->__int_bind_info.nr_listeners);
+  if (!layout[0] || nr_received != __int_ts_nr_sockets (server, layout[0]))
+    panic ("expected listening sockets for %" PRIu32 " reactors to be "
+           "handed over, got %zu sockets", layout[0], nr_received);
+  memcpy (sockets, CMSG_DATA (cmsg), nr_received * sizeof (int));
+  for (size_t i = 0, next = 0; i < layout[1]; ++i)
+    {
+      /* a handed over socket has to be what it's taken up as */
+      const struct tcp_listener_config* listener =
+        &server->__int_bind_info.listeners[i];
+      struct sockaddr_storage addr;
+      socklen_t addr_len = sizeof (addr);
+      if (getsockname (sockets[next], (struct sockaddr*)&addr, &addr_len)
+          == -1 || addr.ss_family != __int_ts_listener_domain (listener))
+        panic ("listening socket (fd=%d) handed over for listener #%zu "
+               "isn't of its family", sockets[next], i);
+      next += listener->family == TCP_LISTENER_UNIX? 1: layout[0];
+    }
+  return layout[0];
+}
+
+static void
+__int_ts_create_listeners (tcpserver_t server, const int* sockets)
+{
+  /* either handed over, in the order of `__int_ts_nr_sockets`, or new */
+  size_t nr_reactors = server->__int_stream.nr_reactors,
+         nr_listeners = server->__int_bind_info.nr_listeners;
+  for (size_t j = 0; j < nr_reactors; ++j)
+    {
+      tcp_reactor_t reactor = &server->__int_stream.reactors[j];
+      reactor->nr_listeners = nr_listeners;
+      reactor->listeners = calloc (nr_listeners, sizeof (*reactor->listeners));
+      if (reactor->listeners == NULL)
+        panic ("failed to allocate %zu listeners for reactor #%zu",
+               nr_listeners, j);
+    }
+  for (size_t i = 0, next = 0; i < nr_listeners; ++i)
+    {
+      const struct tcp_listener_config* config =
+        &server->__int_bind_info.listeners[i];
+      bool shared = config->family == TCP_LISTENER_UNIX;
+      for (size_t j = 0; j < nr_reactors; ++j)
+        {
+          tcp_listener_t listener = &server->__int_stream.reactors[j]
+                                      .listeners[i];
+          listener->reactor = &server->__int_stream.reactors[j];
+          listener->config = config;
+          if (shared && j)
+            {
+              listener->sockfd = server->__int_stream.reactors[0]
+                                   .listeners[i].sockfd;
+              continue;
+            }
+          if (sockets != NULL)
+            {
+              listener->sockfd = sockets[next++];
+              if (!__int_set_nonblocking (listener->sockfd))
+                panic ("failed to set listening socket (fd=%d) to "
+                       "non-blocking mode", listener->sockfd);
+            }
+          else
+            listener->sockfd = __int_create_listen_socket (config,
+                                                           nr_reactors > 1);
+          if (server->config.wait.busy_poll_us
+              && !__int_set_busy_poll (listener->sockfd,
+                                       server->config.wait.busy_poll_us))
+            warn ("failed to set SO_BUSY_POLL on socket (fd=%d): %s",
+                  listener->sockfd, strerror (errno));
+          __int_ts_tune_socket (server, listener->sockfd, config->family,
+                                true);
+        }
+    }
+}
+
+static void
+__int_ts_create_reactors (tcpserver_t server)
+{
+  size_t nr_cpus = __int_ts_nr_online_cpus (),
+         nr_reactors = server->config.reactors.nr_reactors;
+  if (!nr_reactors)
+    nr_reactors = nr_cpus;
+  /* every TCP socket handed over needs a reactor, or the connections the
+   * kernel steers to it would never be accepted
+   */
+  int sockets[TCP_HANDOFF_MAX_LISTENERS];
+  if (server->config.handoff_fd != -1)
+    {
+      size_t nr_handed_over = __int_ts_take_over (server, sockets);
+      if (nr_handed_over != nr_reactors)
+        {
+          warn ("listening sockets for %zu reactors were handed over, "
+                "running as many instead of %zu", nr_handed_over,
+                nr_reactors);
+          /* the affinity list was checked against the reactors asked for */
+          if (server->config.reactors.cpu_affinity != NULL)
+            server->config.reactors.pin_to_cpus = false;
+        }
+      nr_reactors = nr_handed_over;
+    }
+  server->__int_stream.reactors = calloc (
+    nr_reactors, sizeof (*server->__int_stream.reactors)
+  );
+  if (server->__int_stream.reactors == NULL)
+    panic ("failed to allocate %zu reactors", nr_reactors);
+  server->__int_stream.nr_reactors = nr_reactors;
+
+  for (size_t i = 0; i < nr_reactors; ++i)
+    {
+      tcp_reactor_t reactor = &server->__int_stream.reactors[i];
+      reactor->server = server;
+      reactor->id = i;
+      reactor->poller = -1;
+      reactor->backend = __int_ts_select_backend (server->config.backend);
+      reactor->timers = g_timerwheel.new (DEFAULT_TIMERWHEEL_TICK_MS,
+                                          __int_ts_monotonic_us () / 1000);
+      reactor->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (reactor->wake_fd == -1)
+        panic ("failed to create eventfd for reactor #%zu", i);
+      reactor->drain.deadline = (timerwheel_timer_t){
+        .on_expiry = __int_ts_drain_expired,
+        .data = reactor
+      };
+      reactor->accept.max_connections =
+        (server->config.limits.max_connections + nr_reactors - 1)
+        / nr_reactors;
+      reactor->accept.reserve_fd = open ("/dev/null", O_RDONLY | O_CLOEXEC);
+      if (reactor->accept.reserve_fd == -1)
+        panic ("failed to open reserve descriptor for reactor #%zu", i);
+      reactor->accept.backoff = (timerwheel_timer_t){
+        .on_expiry = __int_ts_accept_backoff_expired,
+        .data = reactor
+      };
+      reactor->cpu = TCP_REACTOR_UNPINNED;
+      if (server->config.reactors.pin_to_cpus)
+        reactor->cpu = server->config.reactors.cpu_affinity != NULL
+          ? server->config.reactors.cpu_affinity[i]
+          : (int)(i % nr_cpus);
+    }
+  __int_ts_create_listeners (
+    server, server->config.handoff_fd != -1? sockets: NULL
+  );
+  debug ("created %zu %s reactor(s)", nr_reactors,
+         server->__int_stream.reactors[0].backend->name);
+}
+
 static tcpserver_t
-__int_ts_create_tcpserver (tcp_address_t address, tcp_port_t port)
+__int_ts_create_tcpserver (tcp_address_t address, tcp_port_t port,
+  const struct tcp_server_config* config)
 {
   tcpserver_t server = malloc (sizeof (*server));
   if (server == NULL)
     panic ("failed to allocate memory for server");
   debug ("allocated memory for TCP server");
 
-  server->__int_bind_info.address = address;
-  server->__int_bind_info.port = port;
-  server->__int_bind_info.backlog = DEFAULT_TCP_BACKLOG;
+  /* sendfile() and splice() have no MSG_NOSIGNAL, a peer resetting the
+   * connection mid-file would otherwise kill the whole server
+   */
+  signal (SIGPIPE, SIG_IGN);
+
+  /* the address the server is created with is an IPv4 listener like any
+   * other, and goes first
+   */
+  size_t nr_listeners = (address != NULL) + config->nr_listeners;
+  if (config->backend == TCP_BACKEND_MEMORY)
+    {
+      if (nr_listeners)
+        panic ("the memory backend doesn't listen, it takes no addresses");
+    }
+  else if (!nr_listeners)
+    panic ("a server needs at least one address to listen on");
+  server->__int_bind_info.listeners = calloc (
+    nr_listeners, sizeof (*server->__int_bind_info.listeners)
+  );
+  if (server->__int_bind_info.listeners == NULL)
+    panic ("failed to allocate %zu listeners", nr_listeners);
+  if (address != NULL)
+    server->__int_bind_info.listeners[0] = (struct tcp_listener_config){
+      .family = TCP_LISTENER_INET,
+      .address = address,
+      .port = port
+    };
+  if (config->nr_listeners)
+    memcpy (&server->__int_bind_info.listeners[address != NULL],
+            config->listeners,
+            config->nr_listeners * sizeof (*config->listeners));
+  server->__int_bind_info.nr_listeners = nr_listeners;
+  server->__int_bind_info.backlog = config->sockets.backlog;
+  server->__int_bind_info.handed_over = false;
+
+  server->config = *config;
+  if (server->config.wait.max_events <= 0)
+    panic ("epoll batch size must be positive, not %d",
+           server->config.wait.max_events);
 
   server->__int_stream.clients = NULL;
   server->__int_stream.nr_clients = 0;
-  server->__int_stream.self = __int_create_tcp_socket ();
+  server->signals.fd = -1;
+  sigemptyset (&server->signals.mask);
+  memset (server->signals.handlers, 0, sizeof (server->signals.handlers));
+  __int_ts_create_reactors (server);
 
   debug ("allocating thunks for TCP server");
   __int_allocate_thunks (server);
@@ -420,23 +2314,233 @@ __int_ts_create_tcpserver (tcp_address_t address, tcp_port_t port)
 }
 
 tcpserver_t
-__int_ts_create_with_bind (tcp_address_t address, tcp_port_t port)
+__int_ts_create_with_config (tcp_address_t address, tcp_port_t port,
+  const struct tcp_server_config* config)
 {
   return __int_ts_bind_server (
-    __int_ts_create_tcpserver (address, port)
+    __int_ts_create_tcpserver (address, port, config)
   ); /* +1 for chaining calls :) */
 }
 
+tcpserver_t
+__int_ts_create_with_bind (tcp_address_t address, tcp_port_t port)
+{
+  return __int_ts_create_with_config (address, port, &tcp_default_config);
+}
+
+struct tcp_loop_stats
+__int_ts_loop_stats (tcpserver_t server)
+{
+  /* the counters are owned by each reactor's thread, a slightly stale
+   * snapshot is fine for reporting
+   */
+  struct tcp_loop_stats total = { 0 };
+  for (size_t i = 0; i < server->__int_stream.nr_reactors; ++i)
+    {
+      struct tcp_loop_stats* stats = &server->__int_stream.reactors[i].stats;
+      total.spin_hits += __atomic_load_n (&stats->spin_hits, __ATOMIC_RELAXED);
+      total.block_wakeups += __atomic_load_n (
+        &stats->block_wakeups, __ATOMIC_RELAXED
+      );
+      total.block_timeouts += __atomic_load_n (
+        &stats->block_timeouts, __ATOMIC_RELAXED
+      );
+      total.nr_events += __atomic_load_n (&stats->nr_events, __ATOMIC_RELAXED);
+      total.nr_expired += __atomic_load_n (
+        &stats->nr_expired, __ATOMIC_RELAXED
+      );
+      total.nr_budget_hits += __atomic_load_n (
+        &stats->nr_budget_hits, __ATOMIC_RELAXED
+      );
+      total.nr_accept_pauses += __atomic_load_n (
+        &stats->nr_accept_pauses, __ATOMIC_RELAXED
+      );
+      total.nr_shed += __atomic_load_n (&stats->nr_shed, __ATOMIC_RELAXED);
+      for (size_t class = 0; class < TCP_NR_ERROR_CLASSES; ++class)
+        total.nr_errors[class] += __atomic_load_n (
+          &stats->nr_errors[class], __ATOMIC_RELAXED
+        );
+    }
+  uint64_t nr_wakeups = total.spin_hits + total.block_wakeups;
+  total.avg_batch = nr_wakeups? (double)total.nr_events / nr_wakeups: 0.0;
+  return total;
+}
+
+void
+__int_ts_on_signal (tcpserver_t server, int signum, tcp_signal_fn fn,
+  void* data)
+{
+  if (signum <= 0 || signum >= NSIG)
+    panic ("can't handle signal %d", signum);
+  server->signals.handlers[signum].fn = fn;
+  server->signals.handlers[signum].data = data;
+  sigaddset (&server->signals.mask, signum);
+}
+
+void
+__int_ts_drain (tcpserver_t server)
+{
+  /* no more than an atomic store and a write() per reactor, each reactor
+   * starts draining on its own thread once woken up
+   */
+  uint64_t one = 1;
+  for (size_t i = 0; i < server->__int_stream.nr_reactors; ++i)
+    {
+      tcp_reactor_t reactor = &server->__int_stream.reactors[i];
+      __atomic_store_n (&reactor->drain.requested, true, __ATOMIC_RELEASE);
+      /* fails only if the counter is saturated, i.e. woken already */
+      if (write (reactor->wake_fd, &one, sizeof (one)) == -1)
+        debug ("failed to wake reactor #%zu: %s", i, strerror (errno));
+    }
+}
+
+bool
+__int_ts_watch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  return reactor->backend->watch (reactor, watch);
+}
+
+void
+__int_ts_unwatch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  reactor->backend->unwatch (reactor, watch);
+}
+
+void
+__int_ts_complete (tcp_reactor_t reactor, tcp_completion_t* completion)
+{
+  /* only the push onto an empty stack has to wake the reactor, anything
+   * pushed after it is taken off along with it
+   */
+  tcp_completion_t* head = __atomic_load_n (&reactor->completions,
+                                            __ATOMIC_RELAXED);
+  do
+    completion->next = head;
+  while (!__atomic_compare_exchange_n (&reactor->completions, &head,
+                                       completion, true, __ATOMIC_RELEASE,
+                                       __ATOMIC_RELAXED));
+  uint64_t one = 1;
+  if (head == NULL && write (reactor->wake_fd, &one, sizeof (one)) == -1)
+    debug ("failed to wake reactor #%zu: %s", reactor->id, strerror (errno));
+}
+
+bool
+__int_ts_hand_over (tcpserver_t server, int sockfd)
+{
+  size_t nr_reactors = server->__int_stream.nr_reactors,
+         nr_sockets = __int_ts_nr_sockets (server, nr_reactors);
+  if (nr_sockets > TCP_HANDOFF_MAX_LISTENERS)
+    {
+      warn ("can't hand over more than %d listening sockets, not %zu",
+            TCP_HANDOFF_MAX_LISTENERS, nr_sockets);
+      return false;
+    }
+  uint32_t layout[2] = {nr_reactors, server->__int_bind_info.nr_listeners};
+  struct iovec iov = {.iov_base = layout, .iov_len = sizeof (layout)};
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (TCP_HANDOFF_MAX_LISTENERS * sizeof (int))];
+  } control;
+  memset (&control, 0, sizeof (control));
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buf,
+    .msg_controllen = CMSG_SPACE (nr_sockets * sizeof (int))
+  };
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (nr_sockets * sizeof (int));
+  int* sockets = (int*)CMSG_DATA (cmsg);
+  for (size_t i = 0, next = 0; i < server->__int_bind_info.nr_listeners; ++i)
+    for (size_t j = 0; j < nr_reactors; ++j)
+      {
+        tcp_listener_t listener = &server->__int_stream.reactors[j]
+                                    .listeners[i];
+        if (listener->config->family == TCP_LISTENER_UNIX && j)
+          break;
+        sockets[next++] = listener->sockfd;
+      }
+
+  ssize_t ret;
+  do
+    ret = sendmsg (sockfd, &msg, MSG_NOSIGNAL);
+  while (ret == -1 && errno == EINTR);
+  if (ret != sizeof (layout))
+    {
+      warn ("failed to hand over listening sockets on socket (fd=%d): %s",
+            sockfd, strerror (errno));
+      return false;
+    }
+
+  /* the listeners are only given up on once the other side has them */
+  struct timeval timeout = {
+    .tv_sec = TCP_HANDOFF_TIMEOUT_MS / 1000,
+    .tv_usec = (TCP_HANDOFF_TIMEOUT_MS % 1000) * 1000
+  };
+  setsockopt (sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  char ack;
+  do
+    ret = recv (sockfd, &ack, sizeof (ack), 0);
+  while (ret == -1 && errno == EINTR);
+  if (ret != sizeof (ack))
+    {
+      warn ("listening sockets handed over on socket (fd=%d) weren't taken "
+            "up: %s", sockfd, ret? strerror (errno): "closed");
+      return false;
+    }
+  debug ("handed over %zu listening socket(s)", nr_sockets);
+  server->__int_bind_info.handed_over = true;
+  return true;
+}
+
 void
 __int_ts_free (tcpserver_t server)
 {
   debug ("free()ing TCP server");
-  if (server->__int_stream.self.sockfd != -1)
-    close (server->__int_stream.self.sockfd);
+  for (size_t i = 0; i < server->__int_stream.nr_reactors; ++i)
+    {
+      tcp_reactor_t reactor = &server->__int_stream.reactors[i];
+      /* pushed once the event loop had returned, their clients are closed */
+      __int_ts_run_completions (reactor);
+      for (size_t j = 0; j < reactor->nr_listeners; ++j)
+        if (reactor->listeners[j].config->family != TCP_LISTENER_UNIX || !i)
+          close (reactor->listeners[j].sockfd);
+      free (reactor->listeners);
+      if (reactor->poller != -1)
+        close (reactor->poller);
+      if (reactor->accept.reserve_fd != -1)
+        close (reactor->accept.reserve_fd);
+      close (reactor->wake_fd);
+      free (reactor->watches.by_fd);
+      __int_ts_pool_destroy (reactor);
+      reactor->timers->free ();
+    }
+  /* a Unix socket's path outlives it, unless another instance has it */
+  for (size_t i = 0; i < server->__int_bind_info.nr_listeners; ++i)
+    {
+      const char* path = server->__int_bind_info.listeners[i].address;
+      if (server->__int_bind_info.listeners[i].family == TCP_LISTENER_UNIX
+          && path[0] != '@' && !server->__int_bind_info.handed_over)
+        unlink (path);
+    }
+  free (server->__int_bind_info.listeners);
+  free (server->__int_stream.reactors);
   free (server);
 }
 
 struct __g_tcpserver g_tcpserver = {
   .create_and_bind_to = __int_ts_create_with_bind,
+  .create_and_bind_with = __int_ts_create_with_config,
+  .loop_stats = __int_ts_loop_stats,
+  .on_signal = __int_ts_on_signal,
+  .drain = __int_ts_drain,
+  .hand_over = __int_ts_hand_over,
+  .complete = __int_ts_complete,
+  .watch = __int_ts_watch,
+  .unwatch = __int_ts_unwatch,
+  .resume_reading = __int_ts_resume_reading,
   .free = __int_ts_free
 };
\ No newline at end of file
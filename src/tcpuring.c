@@ -0,0 +1,852 @@
+#define _GNU_SOURCE
+#include "../include/tcpuring.h"
+
+#ifdef TCP_HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+/* completions are routed by their `user_data`, which is the object the
+ * operation belongs to, tagged with the operation in its low bits
+ */
+enum __int_tcp_uring_op
+{
+  URING_OP_NONE = 0,  /* nobody waits on the completion, i.e. cancels */
+  URING_OP_ACCEPT,    /* on a listener, multishot */
+  URING_OP_RECV,      /* on a client, multishot */
+  URING_OP_SEND,      /* on a client, one per linked segment */
+  URING_OP_WRITABLE,  /* on a client, waiting to carry on with a file */
+  URING_OP_WAKE,      /* on a reactor, multishot poll of its eventfd */
+  URING_OP_SIGNAL,    /* on a reactor, multishot poll of the signalfd */
+  URING_OP_WATCH      /* on a watch, single-shot poll */
+};
+#define URING_OP_MASK (7)
+
+struct __int_tcp_uring
+{
+  int fd;
+  unsigned int features;
+  void* rings;
+  size_t rings_len;
+  struct
+  {
+    unsigned int *khead, *ktail, *kmask;
+    struct io_uring_sqe* sqes;
+    unsigned int entries, tail, nr_unsubmitted;
+  } sq;
+  struct
+  {
+    unsigned int *khead, *ktail, *kmask;
+    struct io_uring_cqe* cqes;
+  } cq;
+  struct
+  {
+    struct io_uring_buf_ring* ring;
+    char* base;
+    uint16_t tail;
+    unsigned int nr_free;
+  } buffers;
+  tcp_client_t starved;  /* waiting on provided buffers to come back */
+  size_t nr_accepts_armed;  /* listeners with an accept in flight */
+};
+
+static inline struct __int_tcp_uring*
+__int_uring_of (tcp_reactor_t reactor)
+{
+  return reactor->backend_state;
+}
+
+static inline uint64_t
+__int_uring_tag (void* object, enum __int_tcp_uring_op op)
+{
+  return (uint64_t)(uintptr_t)object | op;
+}
+
+static void
+__int_uring_recycle (struct __int_tcp_uring* uring, uint16_t bid)
+{
+  /* only the entry's own fields are written, the first entry's `resv`
+   * doubles as the ring's tail
+   */
+  struct io_uring_buf* buf = &uring->buffers.ring->bufs[
+    uring->buffers.tail & (TCP_URING_NR_BUFFERS - 1)
+  ];
+  buf->addr = (uintptr_t)(uring->buffers.base
+                          + (size_t)bid * TCP_URING_BUFFER_SIZE);
+  buf->len = TCP_URING_BUFFER_SIZE;
+  buf->bid = bid;
+  __atomic_store_n (&uring->buffers.ring->tail, ++uring->buffers.tail,
+                    __ATOMIC_RELEASE);
+  ++uring->buffers.nr_free;
+}
+
+static void
+__int_uring_setup_buffers (struct __int_tcp_uring* uring)
+{
+  uring->buffers.ring = mmap (
+    NULL, TCP_URING_NR_BUFFERS * sizeof (struct io_uring_buf),
+    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+  );
+  uring->buffers.base = mmap (
+    NULL, (size_t)TCP_URING_NR_BUFFERS * TCP_URING_BUFFER_SIZE,
+    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+  );
+  if (uring->buffers.ring == MAP_FAILED || uring->buffers.base == MAP_FAILED)
+    panic ("failed to allocate %d provided buffers", TCP_URING_NR_BUFFERS);
+
+  struct io_uring_buf_reg reg = {
+    .ring_addr = (uintptr_t)uring->buffers.ring,
+    .ring_entries = TCP_URING_NR_BUFFERS,
+    .bgid = TCP_URING_BUFFER_GROUP
+  };
+  if (syscall (__NR_io_uring_register, uring->fd,
+               IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    panic ("failed to register provided buffer ring: %s", strerror (errno));
+  for (uint16_t bid = 0; bid < TCP_URING_NR_BUFFERS; ++bid)
+    __int_uring_recycle (uring, bid);
+}
+
+static struct __int_tcp_uring*
+__int_uring_create (void)
+{
+  struct __int_tcp_uring* uring = calloc (1, sizeof (*uring));
+  if (uring == NULL)
+    panic ("failed to allocate io_uring state");
+
+  /* each ring is only ever driven by its reactor's thread, so completions
+   * may wait for it to enter the kernel rather than interrupt it
+   */
+  struct io_uring_params params = {
+    .flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN
+             | IORING_SETUP_SINGLE_ISSUER
+  };
+  uring->fd = syscall (__NR_io_uring_setup, TCP_URING_SQ_ENTRIES, &params);
+  if (uring->fd == -1 && errno == EINVAL)
+    {
+      memset (&params, 0, sizeof (params));
+      uring->fd = syscall (__NR_io_uring_setup, TCP_URING_SQ_ENTRIES,
+                           &params);
+    }
+  if (uring->fd == -1)
+    panic ("failed to set up io_uring instance: %s", strerror (errno));
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+      || !(params.features & IORING_FEAT_NODROP))
+    panic ("io_uring instance (fd=%d) is missing required features",
+           uring->fd);
+  uring->features = params.features;
+
+  size_t sq_len = params.sq_off.array
+                  + params.sq_entries * sizeof (unsigned int),
+         cq_len = params.cq_off.cqes
+                  + params.cq_entries * sizeof (struct io_uring_cqe);
+  uring->rings_len = sq_len > cq_len? sq_len: cq_len;
+  char* rings = uring->rings = mmap (
+    NULL, uring->rings_len, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING
+  );
+  uring->sq.sqes = mmap (
+    NULL, params.sq_entries * sizeof (struct io_uring_sqe),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+    IORING_OFF_SQES
+  );
+  if (rings == MAP_FAILED || uring->sq.sqes == MAP_FAILED)
+    panic ("failed to map io_uring instance (fd=%d)", uring->fd);
+
+  uring->sq.khead = (unsigned int*)(rings + params.sq_off.head);
+  uring->sq.ktail = (unsigned int*)(rings + params.sq_off.tail);
+  uring->sq.kmask = (unsigned int*)(rings + params.sq_off.ring_mask);
+  uring->sq.entries = params.sq_entries;
+  uring->sq.tail = *uring->sq.ktail;
+  unsigned int* array = (unsigned int*)(rings + params.sq_off.array);
+  for (unsigned int i = 0; i < params.sq_entries; ++i)
+    array[i] = i;  /* entries are always submitted in order */
+
+  uring->cq.khead = (unsigned int*)(rings + params.cq_off.head);
+  uring->cq.ktail = (unsigned int*)(rings + params.cq_off.tail);
+  uring->cq.kmask = (unsigned int*)(rings + params.cq_off.ring_mask);
+  uring->cq.cqes = (struct io_uring_cqe*)(rings + params.cq_off.cqes);
+
+  __int_uring_setup_buffers (uring);
+  return uring;
+}
+
+static void
+__int_uring_destroy (tcp_reactor_t reactor)
+{
+  /* only once the reactor has drained, so no client is left for the kernel
+   * to write into; the ring itself is closed along with the reactor
+   */
+  struct __int_tcp_uring* uring = __int_uring_of (reactor);
+  munmap (uring->buffers.ring,
+          TCP_URING_NR_BUFFERS * sizeof (struct io_uring_buf));
+  munmap (uring->buffers.base,
+          (size_t)TCP_URING_NR_BUFFERS * TCP_URING_BUFFER_SIZE);
+  munmap (uring->sq.sqes, uring->sq.entries * sizeof (struct io_uring_sqe));
+  munmap (uring->rings, uring->rings_len);
+  free (uring);
+  reactor->backend_state = NULL;
+}
+
+static int
+__int_uring_enter (struct __int_tcp_uring* uring, unsigned int min_complete,
+  unsigned int flags, const void* arg, size_t sz_arg)
+{
+  /* submits whatever was queued along the way */
+  __atomic_store_n (uring->sq.ktail, uring->sq.tail, __ATOMIC_RELEASE);
+  int nr_submitted = syscall (
+    __NR_io_uring_enter, uring->fd, uring->sq.nr_unsubmitted, min_complete,
+    flags, arg, sz_arg
+  );
+  if (nr_submitted > 0)
+    uring->sq.nr_unsubmitted -= nr_submitted;
+  return nr_submitted;
+}
+
+static void
+__int_uring_reserve (struct __int_tcp_uring* uring, unsigned int nr_sqes)
+{
+  /* linked entries have to go in with the same submission */
+  while (uring->sq.entries - (uring->sq.tail
+         - __atomic_load_n (uring->sq.khead, __ATOMIC_ACQUIRE)) < nr_sqes)
+    if (__int_uring_enter (uring, 0, 0, NULL, 0) == -1
+        && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+      panic ("failed to submit to io_uring instance (fd=%d): %s",
+             uring->fd, strerror (errno));
+}
+
+static struct io_uring_sqe*
+__int_uring_get_sqe (struct __int_tcp_uring* uring)
+{
+  __int_uring_reserve (uring, 1);
+  struct io_uring_sqe* sqe = &uring->sq.sqes[
+    uring->sq.tail++ & *uring->sq.kmask
+  ];
+  ++uring->sq.nr_unsubmitted;
+  memset (sqe, 0, sizeof (*sqe));
+  return sqe;
+}
+
+static inline unsigned int
+__int_uring_nr_ready (struct __int_tcp_uring* uring)
+{
+  return __atomic_load_n (uring->cq.ktail, __ATOMIC_ACQUIRE)
+         - *uring->cq.khead;
+}
+
+static int
+__int_uring_wait (tcp_reactor_t reactor)
+{
+  /* same spin-then-block policy as the epoll backend; entering the kernel
+   * without waiting is what runs the ring's deferred completions
+   */
+  struct __int_tcp_uring* uring = __int_uring_of (reactor);
+  unsigned long spin_us = reactor->server->config.wait.spin_us;
+  unsigned int nr_ready;
+  if (spin_us && reactor->ready.head == NULL)
+    {
+      uint64_t deadline = __int_ts_monotonic_us () + spin_us;
+      do
+        {
+          if (__builtin_expect (__int_uring_enter (
+                uring, 0, IORING_ENTER_GETEVENTS, NULL, 0
+              ) == -1 && errno != EINTR && errno != EBUSY, 0))
+            return -1;
+          if ((nr_ready = __int_uring_nr_ready (uring)))
+            {
+              ++reactor->stats.spin_hits;
+              reactor->stats.nr_events += nr_ready;
+              return nr_ready;
+            }
+        }
+      while (__int_ts_monotonic_us () < deadline);
+    }
+
+  int ret, block_timeout_ms = __int_ts_block_timeout (reactor);
+  if (block_timeout_ms < 0)
+    ret = __int_uring_enter (uring, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+  else
+    {
+      if (!(uring->features & IORING_FEAT_EXT_ARG))
+        panic ("io_uring instance (fd=%d) can't wait with a timeout",
+               uring->fd);
+      struct __kernel_timespec timeout = {
+        .tv_sec = block_timeout_ms / 1000,
+        .tv_nsec = (block_timeout_ms % 1000) * 1000000L
+      };
+      struct io_uring_getevents_arg arg = {
+        .ts = (uintptr_t)&timeout
+      };
+      ret = __int_uring_enter (
+        uring, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+        &arg, sizeof (arg)
+      );
+    }
+  if (ret == -1 && errno != EINTR && errno != ETIME && errno != EBUSY)
+    return -1;
+  if ((nr_ready = __int_uring_nr_ready (uring)))
+    {
+      ++reactor->stats.block_wakeups;
+      reactor->stats.nr_events += nr_ready;
+    }
+  else if (ret != -1 || errno == ETIME)
+    ++reactor->stats.block_timeouts;
+  return nr_ready;
+}
+
+static void
+__int_uring_put (tcp_client_t client)
+{
+  /* a closed client lingers until its last operation has completed */
+  if (!--client->connection.uring.nr_inflight && client->connection.closed)
+    client->connection.__int.free ();
+}
+
+static void
+__int_uring_arm_accept (tcp_listener_t listener)
+{
+  /* multishot accept can't report peer addresses, those are looked up
+   * with getpeername() if ever asked for. under a connection cap it would
+   * run past the cap before a cancel caught up with it, so it's armed for
+   * one connection at a time instead
+   */
+  tcp_reactor_t reactor = listener->reactor;
+  bool multishot = !reactor->accept.max_connections;
+  struct io_uring_sqe* sqe = __int_uring_get_sqe (__int_uring_of (reactor));
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listener->sockfd;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->ioprio = multishot? IORING_ACCEPT_MULTISHOT: 0;
+  sqe->user_data = __int_uring_tag (listener, URING_OP_ACCEPT);
+  listener->uring.accept_armed = true;
+  ++__int_uring_of (reactor)->nr_accepts_armed;
+  debug ("armed %s accept on listening socket (fd=%d)",
+         multishot? "multishot": "single-shot", listener->sockfd);
+}
+
+static void
+__int_uring_arm_poll (tcp_reactor_t reactor, int fd,
+  enum __int_tcp_uring_op op)
+{
+  struct io_uring_sqe* sqe = __int_uring_get_sqe (__int_uring_of (reactor));
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = __int_uring_tag (reactor, op);
+}
+
+static void
+__int_uring_on_poll (tcp_reactor_t reactor, enum __int_tcp_uring_op op,
+  int res, uint32_t flags)
+{
+  int fd = op == URING_OP_WAKE? reactor->wake_fd
+                              : reactor->server->signals.fd;
+  if (res >= 0 || res == -EINTR)
+    {
+      if (op == URING_OP_WAKE)
+        __int_ts_on_wake (reactor);
+      else
+        __int_ts_on_signals (reactor);
+    }
+  else if (res != -ECANCELED)
+    warn ("failed to poll descriptor (fd=%d) on io_uring instance "
+          "(fd=%d): %s", fd, __int_uring_of (reactor)->fd, strerror (-res));
+  if (!(flags & IORING_CQE_F_MORE))
+    __int_uring_arm_poll (reactor, fd, op);
+}
+
+static bool
+__int_uring_watch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  if (watch->fd < 0)
+    return false;
+  struct io_uring_sqe* sqe = __int_uring_get_sqe (__int_uring_of (reactor));
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = watch->fd;
+  sqe->poll32_events = watch->writable? POLLOUT: POLLIN;
+  sqe->user_data = __int_uring_tag (watch, URING_OP_WATCH);
+  ++reactor->watches.nr_watches;
+  return true;
+}
+
+static void
+__int_uring_unwatch (tcp_reactor_t reactor, tcp_watch_t* watch)
+{
+  /* the poll then completes with -ECANCELED, if it hasn't already */
+  struct io_uring_sqe* sqe = __int_uring_get_sqe (__int_uring_of (reactor));
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->addr = __int_uring_tag (watch, URING_OP_WATCH);
+  sqe->user_data = __int_uring_tag (NULL, URING_OP_NONE);
+}
+
+static void
+__int_uring_on_watch (tcp_reactor_t reactor, tcp_watch_t* watch, int res)
+{
+  --reactor->watches.nr_watches;
+  if (res < 0 && res != -ECANCELED)
+    warn ("failed to poll descriptor (fd=%d) on io_uring instance "
+          "(fd=%d): %s", watch->fd, __int_uring_of (reactor)->fd,
+          strerror (-res));
+  watch->on_ready (watch->data, res >= 0);
+}
+
+static void
+__int_uring_arm_recv (tcp_client_t client)
+{
+  /* a receive that can't get a buffer parks its client on the starved
+   * list, rather than retrying straight away
+   */
+  struct __int_tcp_uring* uring = __int_uring_of (client->reactor);
+  __auto_type state = &client->connection.uring;
+  if (state->recv_armed || state->starved || state->nr_stashed)
+    return;
+  if (!uring->buffers.nr_free)
+    {
+      state->starved = true;
+      ++state->nr_inflight;
+      state->next_starved = uring->starved;
+      uring->starved = client;
+      debug ("TCP socket (fd=%d) is starved of receive buffers",
+             client->connection.sockfd);
+      return;
+    }
+  struct io_uring_sqe* sqe = __int_uring_get_sqe (uring);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = client->connection.sockfd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = TCP_URING_BUFFER_GROUP;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = __int_uring_tag (client, URING_OP_RECV);
+  state->recv_armed = true;
+  ++state->nr_inflight;
+}
+
+static void
+__int_uring_wake_starved (struct __int_tcp_uring* uring)
+{
+  tcp_client_t client = uring->starved;
+  uring->starved = NULL;
+  while (client != NULL)
+    {
+      tcp_client_t next = client->connection.uring.next_starved;
+      client->connection.uring.starved = false;
+      if (!client->connection.closed && !client->connection.closing
+          && !client->connection.read_closed
+          && !client->connection.peer_closed)
+        __int_uring_arm_recv (client);
+      __int_uring_put (client);
+      client = next;
+    }
+}
+
+static bool
+__int_uring_flush_file (tcp_client_t self)
+{
+  /* io_uring has no sendfile, file segments are sent in place until the
+   * socket fills up, and then resumed once a poll reports it writable
+   */
+  __auto_type tx = &self->connection.tx;
+  while (tx->nr_segments && __int_ts_tx_segment_at (self, 0)->is_file)
+    {
+      send_ret_t nr_sent = __int_ts_tx_send_file (self);
+      if (nr_sent == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+              struct io_uring_sqe* sqe = __int_uring_get_sqe (
+                __int_uring_of (self->reactor)
+              );
+              sqe->opcode = IORING_OP_POLL_ADD;
+              sqe->fd = self->connection.sockfd;
+              sqe->poll32_events = POLLOUT;
+              sqe->user_data = __int_uring_tag (self, URING_OP_WRITABLE);
+              ++self->connection.uring.nr_sends;
+              ++self->connection.uring.nr_inflight;
+              return true;
+            }
+          __int_ts_count_error (self->reactor, errno);
+          debug ("failed to send file to TCP socket (fd=%d), reason: %s",
+                 self->connection.sockfd, strerror (errno));
+          self->connection.peer_closed = true;
+          __int_ts_tx_discard (self);
+          return false;
+        }
+      __int_ts_tx_advance (self, nr_sent);
+    }
+  return true;
+}
+
+static bool
+__int_uring_flush (tcp_client_t self)
+{
+  /* memory segments go out as one chain of linked sends, MSG_WAITALL makes
+   * a short send fail the rest of the chain instead of leaving a gap; the
+   * chain ends at the next file segment, and once it completes whatever is
+   * left is sent with the next one
+   */
+  __auto_type tx = &self->connection.tx;
+  __auto_type state = &self->connection.uring;
+  struct __int_tcp_uring* uring = __int_uring_of (self->reactor);
+  if (self->connection.peer_closed)
+    return false;
+  if (state->nr_sends)
+    return true;
+  __int_ts_tx_advance (self, 0);  /* leading zero-length segments */
+  if (!__int_uring_flush_file (self))
+    return false;
+  if (state->nr_sends)
+    return true;
+
+  struct io_uring_sqe* last = NULL;
+  __int_uring_reserve (uring, TCP_TX_IOV_BATCH);
+  for (size_t i = 0; i < tx->nr_segments && state->nr_sends < TCP_TX_IOV_BATCH;
+       ++i)
+    {
+      __auto_type segment = __int_ts_tx_segment_at (self, i);
+      size_t skip = i? 0: tx->offset;
+      if (segment->is_file)
+        break;
+      if (segment->len == skip)
+        continue;
+      struct io_uring_sqe* sqe = last = __int_uring_get_sqe (uring);
+      sqe->opcode = IORING_OP_SEND;
+      sqe->fd = self->connection.sockfd;
+      sqe->addr = (uintptr_t)(segment->base + skip);
+      sqe->len = segment->len - skip;
+      sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+      sqe->flags = IOSQE_IO_LINK;
+      sqe->user_data = __int_uring_tag (self, URING_OP_SEND);
+      ++state->nr_sends;
+      ++state->nr_inflight;
+    }
+  if (last != NULL)
+    last->flags &= ~IOSQE_IO_LINK;
+  debug ("queued %u linked send(s) of %zu pending byte(s) (fd=%d)",
+         state->nr_sends, tx->nr_pending, self->connection.sockfd);
+  return true;
+}
+
+static bool
+__int_uring_refill (tcp_client_t client, size_t limit)
+{
+  /* copies up to `limit` stashed bytes into the receive ring, handing each
+   * buffer back to the kernel as soon as it's been emptied
+   */
+  struct __int_tcp_uring* uring = __int_uring_of (client->reactor);
+  __auto_type state = &client->connection.uring;
+  ringbuf_t rx = client->connection.rx;
+  size_t nr_drained = 0;
+  while (nr_drained < state->nr_stashed && rx->writable () && limit)
+    {
+      struct __int_tcp_uring_chunk* chunk = &state->stash[nr_drained];
+      size_t nr_copied = chunk->len < rx->writable ()? chunk->len
+                                                      : rx->writable ();
+      if (nr_copied > limit)
+        nr_copied = limit;
+      limit -= nr_copied;
+      memcpy (rx->write_ptr (),
+              uring->buffers.base + (size_t)chunk->bid * TCP_URING_BUFFER_SIZE
+                + chunk->offset,
+              nr_copied);
+      rx->produce (nr_copied);
+      chunk->offset += nr_copied;
+      chunk->len -= nr_copied;
+      if (chunk->len)
+        break;
+      __int_uring_recycle (uring, chunk->bid);
+      ++nr_drained;
+    }
+  if (nr_drained)
+    memmove (state->stash, state->stash + nr_drained,
+             (state->nr_stashed - nr_drained) * sizeof (*state->stash));
+  state->nr_stashed -= nr_drained;
+  return state->nr_stashed > 0;
+}
+
+static void
+__int_uring_stash (tcp_client_t client, uint16_t bid, uint32_t len)
+{
+  __auto_type state = &client->connection.uring;
+  if (state->nr_stashed == state->stash_capacity)
+    {
+      size_t capacity = state->stash_capacity? state->stash_capacity << 1: 4;
+      struct __int_tcp_uring_chunk* stash = realloc (
+        state->stash, capacity * sizeof (*stash)
+      );
+      if (stash == NULL)
+        panic ("failed to grow receive stash to %zu buffers", capacity);
+      state->stash = stash;
+      state->stash_capacity = capacity;
+    }
+  state->stash[state->nr_stashed++] = (struct __int_tcp_uring_chunk){
+    .bid = bid, .offset = 0, .len = len
+  };
+}
+
+static void
+__int_uring_set_accepting (tcp_reactor_t reactor, bool accepting)
+{
+  /* a cancelled accept is only re-armed once its last completion is in */
+  struct __int_tcp_uring* uring = __int_uring_of (reactor);
+  for (size_t i = 0; i < reactor->nr_listeners; ++i)
+    {
+      tcp_listener_t listener = &reactor->listeners[i];
+      if (accepting && !listener->uring.accept_armed)
+        __int_uring_arm_accept (listener);
+      else if (!accepting && listener->uring.accept_armed)
+        {
+          struct io_uring_sqe* sqe = __int_uring_get_sqe (uring);
+          sqe->opcode = IORING_OP_ASYNC_CANCEL;
+          sqe->addr = __int_uring_tag (listener, URING_OP_ACCEPT);
+          sqe->user_data = __int_uring_tag (NULL, URING_OP_NONE);
+        }
+    }
+}
+
+static void
+__int_uring_on_accept (tcp_listener_t listener, int res, uint32_t flags)
+{
+  /* disarmed up front, so that pausing from within doesn't cancel an
+   * accept that has already finished
+   */
+  tcp_reactor_t reactor = listener->reactor;
+  if (!(flags & IORING_CQE_F_MORE))
+    {
+      listener->uring.accept_armed = false;
+      --__int_uring_of (reactor)->nr_accepts_armed;
+    }
+  if (res >= 0)
+    {
+      tcp_client_t client = __int_ts_configure_client (
+        reactor, __int_ts_new_client (listener, res, NULL, 0)
+      );
+      __int_ts_dispatch_connected (client);
+      if (!client->connection.closed && !client->connection.closing)
+        __int_uring_arm_recv (client);
+    }
+  else if (res != -EINTR && res != -ECANCELED)
+    {
+      /* the connection is lost, the listener carries on */
+      __int_ts_count_error (reactor, -res);
+      debug ("failed to accept on listening socket (fd=%d): %s",
+             listener->sockfd, strerror (-res));
+      /* an accept fails for want of a descriptor before it even looks at
+       * the queue, so re-arming straight away would only spin
+       */
+      if (res == -EMFILE || res == -ENFILE)
+        __int_ts_shed_connections (reactor, true);
+    }
+  if (!listener->uring.accept_armed && !reactor->accept.paused)
+    __int_uring_arm_accept (listener);
+}
+
+static void
+__int_uring_on_recv (tcp_client_t client, int res, uint32_t flags)
+{
+  struct __int_tcp_uring* uring = __int_uring_of (client->reactor);
+  __auto_type state = &client->connection.uring;
+  bool more = flags & IORING_CQE_F_MORE;
+  if (!more)
+    state->recv_armed = false;
+  if (flags & IORING_CQE_F_BUFFER)
+    --uring->buffers.nr_free;
+
+  if (client->connection.closed || client->connection.closing)
+    {
+      /* nobody's reading any more */
+      if (flags & IORING_CQE_F_BUFFER)
+        __int_uring_recycle (uring, flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+  else
+    {
+      if (res > 0)
+        __int_uring_stash (client, flags >> IORING_CQE_BUFFER_SHIFT, res);
+      else if (res != -ENOBUFS)
+        {
+          if (res)
+            {
+              __int_ts_count_error (client->reactor, -res);
+              client->connection.peer_closed = true;
+            }
+          debug ("TCP socket (fd=%d) closed by peer, reason: %s",
+                 client->connection.sockfd, res? strerror (-res): "EOF");
+          client->connection.read_closed = true;
+        }
+      __int_ts_dispatch_readable (client, __int_uring_refill);
+      if (!client->connection.closed && !client->connection.closing
+          && !client->connection.read_closed
+          && !client->connection.peer_closed)
+        __int_uring_arm_recv (client);
+    }
+  if (!more)
+    __int_uring_put (client);
+}
+
+static void
+__int_uring_sends_settled (tcp_client_t client)
+{
+  /* nothing is in flight any more, carry on with whatever is queued */
+  if (client->connection.peer_closed)
+    {
+      if (client->connection.closing)
+        client->connection.op.close ();
+      else
+        __int_ts_dispatch_disconnected (client);
+    }
+  else if (client->connection.tx.nr_segments)
+    {
+      /* a flush may well finish a file without anything left in flight */
+      if (!__int_uring_flush (client) || !client->connection.uring.nr_sends)
+        __int_uring_sends_settled (client);
+    }
+  else if (client->connection.closing)
+    client->connection.op.close ();
+  else
+    __int_ts_dispatch_writable (client);
+}
+
+static void
+__int_uring_on_send (tcp_client_t client, int res)
+{
+  __auto_type state = &client->connection.uring;
+  --state->nr_sends;
+  if (!client->connection.closed)
+    {
+      if (res > 0)
+        __int_ts_tx_advance (client, res);
+      if (res < 0 && res != -ECANCELED)
+        {
+          __int_ts_count_error (client->reactor, -res);
+          debug ("failed to send to TCP socket (fd=%d), reason: %s",
+                 client->connection.sockfd, strerror (-res));
+          client->connection.peer_closed = true;
+        }
+      /* otherwise the rest of the chain is still to come */
+      if (!state->nr_sends && !client->connection.closed)
+        __int_uring_sends_settled (client);
+    }
+  __int_uring_put (client);
+}
+
+static void
+__int_uring_on_writable (tcp_client_t client, int res)
+{
+  --client->connection.uring.nr_sends;
+  if (!client->connection.closed)
+    {
+      if (res < 0)
+        __int_ts_count_error (client->reactor, -res);
+      if (res < 0 || res & (POLLERR | POLLHUP))
+        client->connection.peer_closed = true;
+      __int_uring_sends_settled (client);
+    }
+  __int_uring_put (client);
+}
+
+static void
+__int_uring_complete (tcp_reactor_t reactor, const struct io_uring_cqe* cqe)
+{
+  void* object = (void*)(uintptr_t)(cqe->user_data & ~(uint64_t)URING_OP_MASK);
+  switch (cqe->user_data & URING_OP_MASK)
+    {
+    case URING_OP_ACCEPT:
+      __int_uring_on_accept (object, cqe->res, cqe->flags);
+      break;
+    case URING_OP_RECV:
+      __int_uring_on_recv (object, cqe->res, cqe->flags);
+      break;
+    case URING_OP_SEND:
+      __int_uring_on_send (object, cqe->res);
+      break;
+    case URING_OP_WRITABLE:
+      __int_uring_on_writable (object, cqe->res);
+      break;
+    case URING_OP_WAKE:
+    case URING_OP_SIGNAL:
+      __int_uring_on_poll (object, cqe->user_data & URING_OP_MASK, cqe->res,
+                           cqe->flags);
+      break;
+    case URING_OP_WATCH:
+      __int_uring_on_watch (reactor, object, cqe->res);
+      break;
+    }
+}
+
+static void
+__int_uring_release (tcp_client_t client)
+{
+  /* close() has already shut the socket down, which ends the receive; the
+   * cancel only covers a receive that hasn't been issued yet
+   */
+  struct __int_tcp_uring* uring = __int_uring_of (client->reactor);
+  __auto_type state = &client->connection.uring;
+  for (size_t i = 0; i < state->nr_stashed; ++i)
+    __int_uring_recycle (uring, state->stash[i].bid);
+  state->nr_stashed = 0;
+  if (state->recv_armed)
+    {
+      struct io_uring_sqe* sqe = __int_uring_get_sqe (uring);
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = __int_uring_tag (client, URING_OP_RECV);
+      sqe->user_data = __int_uring_tag (NULL, URING_OP_NONE);
+    }
+  if (!state->nr_inflight)
+    client->connection.__int.free ();
+}
+
+static void*
+__int_uring_run (tcp_reactor_t reactor)
+{
+  __int_ts_pin_reactor (reactor);
+
+  struct __int_tcp_uring* uring = __int_uring_create ();
+  reactor->backend_state = uring;
+  reactor->poller = uring->fd;
+  debug ("created io_uring instance (fd=%d) for reactor #%zu",
+         uring->fd, reactor->id);
+
+  for (size_t i = 0; i < reactor->nr_listeners; ++i)
+    __int_uring_arm_accept (&reactor->listeners[i]);
+  __int_uring_arm_poll (reactor, reactor->wake_fd, URING_OP_WAKE);
+  if (!reactor->id && reactor->server->signals.fd != -1)
+    __int_uring_arm_poll (reactor, reactor->server->signals.fd,
+                          URING_OP_SIGNAL);
+  /* a connection an accept takes before its cancel goes through is seen
+   * through like any other
+   */
+  while (!__int_ts_drained (reactor) || uring->nr_accepts_armed)
+    {
+      int nr_ready = __int_uring_wait (reactor);
+      if (__builtin_expect (nr_ready == -1, 0))
+        panic ("failed to wait on io_uring instance (fd=%d): %s",
+               uring->fd, strerror (errno));
+      ++reactor->iteration;
+      __int_ts_expire_deadlines (reactor);
+      unsigned int head = *uring->cq.khead;
+      for (; nr_ready--; ++head)
+        {
+          /* the slot is handed back before the completion is handled */
+          struct io_uring_cqe cqe = uring->cq.cqes[head & *uring->cq.kmask];
+          __atomic_store_n (uring->cq.khead, head + 1, __ATOMIC_RELEASE);
+          __int_uring_complete (reactor, &cqe);
+        }
+      __int_ts_run_ready (reactor, __int_uring_refill);
+      if (uring->starved != NULL && uring->buffers.nr_free)
+        __int_uring_wake_starved (uring);
+    }
+  __int_uring_destroy (reactor);
+  return NULL;
+}
+
+const struct __int_tcp_backend __int_ts_uring_backend = {
+  .name = "io_uring",
+  .run = __int_uring_run,
+  .flush = __int_uring_flush,
+  .set_accepting = __int_uring_set_accepting,
+  .release = __int_uring_release,
+  .watch = __int_uring_watch,
+  .unwatch = __int_uring_unwatch
+};
+#endif /* TCP_HAVE_IO_URING */
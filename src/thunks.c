@@ -1,4 +1,5 @@
 #include "../include/thunks.h"
+#include <pthread.h>
 
 static struct __thunk_tag
 {
@@ -24,6 +25,11 @@ static struct
   .nr_gaps = 0
 };
 
+/* reactors allocate & deallocate thunks concurrently (i.e. per accepted
+ * client, per parse result), so the table bookkeeping is serialized
+ */
+static pthread_mutex_t __int_thunk_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
 __attribute__((section("int_thunk"), naked, noinline))
 static void*
 __int_thunk () { asm volatile (
@@ -63,6 +69,7 @@ __int_deallocate_thunk (void* thunk)
 
   struct __thunk_tag* tag
     = (void *)( (unsigned char*)thunk - sizeof (struct __thunk_tag) );
+  pthread_mutex_lock (&__int_thunk_table_lock);
   __int_thunk_table.thunks[tag->thunk_idx] = NULL;
   ++__int_thunk_table.nr_gaps;
   --__int_thunk_table.nr_inuse_thunks;
@@ -70,6 +77,15 @@ __int_deallocate_thunk (void* thunk)
              "(in use: %zu, gaps: %zu, total: %zu)",
          tag->thunk_idx, tag->ident, __int_thunk_table.nr_inuse_thunks,
          __int_thunk_table.nr_gaps, __int_thunk_table.nr_total_thunks);
+  pthread_mutex_unlock (&__int_thunk_table_lock);
+  /* handed back as it was given, else the executable pages split the heap's
+   * mapping further with every thunk until mprotect() runs out of them
+   */
+  extern unsigned char  __start_int_thunk[];
+  extern unsigned char __stop_int_thunk[];
+  if (mprotect (tag, __stop_int_thunk - __start_int_thunk,
+                PROT_READ | PROT_WRITE) < 0)
+    panic ("failed to reset page privileges on thunk");
   free (tag);
 }
 
@@ -113,6 +129,7 @@ __int_set_thunk_rwx (void* thunk, size_t size)
 void*
 __int_allocate_thunk (const char* ident, void* from, void* thisptr)
 {
+  pthread_mutex_lock (&__int_thunk_table_lock);
   size_t nr_inuse_thunks = __int_thunk_table.nr_inuse_thunks,
          nr_total_thunks = __int_thunk_table.nr_total_thunks,
          capacity = __int_thunk_table.capacity,
@@ -177,6 +194,7 @@ __int_allocate_thunk (const char* ident, void* from, void* thisptr)
   };
   memcpy (to, &thunk_tag, sizeof (struct __thunk_tag));
   memcpy (to + sizeof (struct __thunk_tag), __int_thunk, size);
+  pthread_mutex_unlock (&__int_thunk_table_lock);
   return (void*)( ((struct __thunk_tag*)to)->code );
 }
 
@@ -0,0 +1,245 @@
+#include "../include/timerwheel.h"
+#include <limits.h>
+
+#define SLOT_MASK (TIMERWHEEL_SLOTS - 1)
+#define HORIZON (1ULL << (TIMERWHEEL_SLOT_BITS * TIMERWHEEL_LEVELS))
+
+static void
+timerwheel_link (timerwheel_t wheel, timerwheel_timer_t* timer)
+{
+  /* a timer goes on the lowest level whose turn still covers its expiry,
+   * into the slot that level reaches it in
+   */
+  uint64_t now = wheel->__int.now;
+  if (timer->expires < now)
+    timer->expires = now;
+  if (timer->expires - now >= HORIZON)
+    timer->expires = now + HORIZON - 1;
+  uint64_t delta = timer->expires - now;
+  size_t level = 0;
+  while (level < TIMERWHEEL_LEVELS - 1
+         && delta >= 1ULL << (TIMERWHEEL_SLOT_BITS * (level + 1)))
+    ++level;
+  size_t slot = (timer->expires >> (TIMERWHEEL_SLOT_BITS * level))
+                & SLOT_MASK;
+
+  timerwheel_timer_t** head = &wheel->__int.slots[level][slot];
+  timer->next = *head;
+  if (timer->next != NULL)
+    timer->next->pprev = &timer->next;
+  timer->pprev = head;
+  *head = timer;
+  timer->level = level;
+  timer->slot = slot;
+  wheel->__int.occupied[level] |= 1ULL << slot;
+  ++wheel->__int.nr_timers;
+}
+
+static void
+timerwheel_unlink (timerwheel_t wheel, timerwheel_timer_t* timer)
+{
+  *timer->pprev = timer->next;
+  if (timer->next != NULL)
+    timer->next->pprev = timer->pprev;
+  timer->next = NULL;
+  timer->pprev = NULL;
+  if (wheel->__int.slots[timer->level][timer->slot] == NULL)
+    wheel->__int.occupied[timer->level] &= ~(1ULL << timer->slot);
+  --wheel->__int.nr_timers;
+}
+
+static timerwheel_timer_t*
+timerwheel_detach_slot (timerwheel_t wheel, size_t level, size_t slot)
+{
+  /* the list is moved out wholesale, so the slot can take new timers while
+   * the old ones are being handled
+   */
+  timerwheel_timer_t* head = wheel->__int.slots[level][slot];
+  wheel->__int.slots[level][slot] = NULL;
+  wheel->__int.occupied[level] &= ~(1ULL << slot);
+  return head;
+}
+
+static void
+timerwheel_cascade (timerwheel_t wheel, size_t level, size_t slot)
+{
+  timerwheel_timer_t* timer = timerwheel_detach_slot (wheel, level, slot);
+  while (timer != NULL)
+    {
+      timerwheel_timer_t* next = timer->next;
+      --wheel->__int.nr_timers;
+      timerwheel_link (wheel, timer);
+      timer = next;
+    }
+}
+
+static size_t
+timerwheel_tick (timerwheel_t wheel)
+{
+  uint64_t tick = wheel->__int.now;
+  size_t index = tick & SLOT_MASK;
+  if (!index)
+    for (size_t level = 1; level < TIMERWHEEL_LEVELS; ++level)
+      {
+        size_t slot = (tick >> (TIMERWHEEL_SLOT_BITS * level)) & SLOT_MASK;
+        timerwheel_cascade (wheel, level, slot);
+        if (slot)
+          break;
+      }
+
+  /* timers armed from an expiry callback must land on a later tick */
+  timerwheel_timer_t* expired = timerwheel_detach_slot (wheel, 0, index);
+  wheel->__int.now = tick + 1;
+  if (expired != NULL)
+    expired->pprev = &expired;
+  size_t nr_expired = 0;
+  while (expired != NULL)
+    {
+      /* callbacks may cancel timers further down this list */
+      timerwheel_timer_t* timer = expired;
+      timerwheel_unlink (wheel, timer);
+      timer->on_expiry (timer->data);
+      ++nr_expired;
+    }
+  return nr_expired;
+}
+
+void
+timerwheel_arm (timerwheel_t wheel, timerwheel_timer_t* timer,
+  uint64_t timeout_ms)
+{
+  if (timerwheel_is_armed (timer))
+    timerwheel_unlink (wheel, timer);
+  /* the first tick due no earlier than `timeout_ms` past the last advance */
+  timer->expires = (wheel->__int.last_ms - wheel->__int.base_ms + timeout_ms
+                    + wheel->__int.tick_ms - 1) / wheel->__int.tick_ms;
+  timerwheel_link (wheel, timer);
+}
+
+void
+timerwheel_cancel (timerwheel_t wheel, timerwheel_timer_t* timer)
+{
+  if (timerwheel_is_armed (timer))
+    timerwheel_unlink (wheel, timer);
+}
+
+size_t
+timerwheel_advance (timerwheel_t wheel, uint64_t now_ms)
+{
+  if (now_ms < wheel->__int.base_ms)
+    return 0;
+  wheel->__int.last_ms = now_ms;
+  uint64_t target = (now_ms - wheel->__int.base_ms) / wheel->__int.tick_ms;
+  size_t nr_expired = 0;
+  while (wheel->__int.now <= target)
+    {
+      uint64_t now = wheel->__int.now;
+      if (!wheel->__int.nr_timers)
+        {
+          wheel->__int.now = target + 1;
+          break;
+        }
+      if ((now & SLOT_MASK) && !wheel->__int.occupied[0])
+        {
+          /* nothing can expire before the next cascade */
+          uint64_t cascade = (now | SLOT_MASK) + 1;
+          wheel->__int.now = cascade < target + 1? cascade: target + 1;
+          continue;
+        }
+      nr_expired += timerwheel_tick (wheel);
+    }
+  return nr_expired;
+}
+
+int
+timerwheel_next_timeout (timerwheel_t wheel)
+{
+  /* the nearest level-0 slot is exact, higher levels only tell when their
+   * next occupied slot cascades, which is early enough
+   */
+  if (!wheel->__int.nr_timers)
+    return -1;
+  uint64_t now = wheel->__int.now, next = UINT64_MAX;
+  for (size_t level = 0; level < TIMERWHEEL_LEVELS; ++level)
+    {
+      uint64_t occupied = wheel->__int.occupied[level];
+      if (!occupied)
+        continue;
+      size_t shift = TIMERWHEEL_SLOT_BITS * level,
+             current = (now >> shift) & SLOT_MASK;
+      /* rotate so that bit 0 is the current slot */
+      uint64_t rotated = current? occupied >> current
+                                  | occupied << (TIMERWHEEL_SLOTS - current)
+                                : occupied;
+      uint64_t distance = __builtin_ctzll (rotated), at;
+      if (!level)
+        at = now + distance;
+      else
+        {
+          /* a higher level's current slot has already been cascaded this
+           * turn, unless the turn starts with the very next tick
+           */
+          if (!distance && (now & ((1ULL << shift) - 1)))
+            distance = TIMERWHEEL_SLOTS;
+          at = ((now >> shift) + distance) << shift;
+        }
+      if (at < next)
+        next = at;
+    }
+  uint64_t due_ms = wheel->__int.base_ms + next * wheel->__int.tick_ms;
+  if (due_ms <= wheel->__int.last_ms)
+    return 0;
+  return due_ms - wheel->__int.last_ms > INT_MAX
+    ? INT_MAX
+    : (int)(due_ms - wheel->__int.last_ms);
+}
+
+void
+timerwheel_free (timerwheel_t wheel)
+{
+  /* armed timers are owned by their embedders, they're just forgotten */
+  g_thunks.deallocate_thunk (wheel->arm);
+  g_thunks.deallocate_thunk (wheel->cancel);
+  g_thunks.deallocate_thunk (wheel->advance);
+  g_thunks.deallocate_thunk (wheel->next_timeout);
+  g_thunks.deallocate_thunk (wheel->free);
+  free (wheel);
+}
+
+timerwheel_t
+timerwheel_new (uint64_t tick_ms, uint64_t now_ms)
+{
+  timerwheel_t wheel = calloc_ptr_type (timerwheel_t);
+  { /* initialize wheel structure */
+    wheel->__int.tick_ms = tick_ms? tick_ms: DEFAULT_TIMERWHEEL_TICK_MS;
+    wheel->__int.base_ms = wheel->__int.last_ms = now_ms;
+    wheel->__int.now = 1;  /* tick 0 is in the past by the first advance */
+  }
+  { /* allocate wheel thunks */
+    wheel->arm = g_thunks.allocate_thunk (
+      "timerwheel_arm",
+      timerwheel_arm, wheel
+    );
+    wheel->cancel = g_thunks.allocate_thunk (
+      "timerwheel_cancel",
+      timerwheel_cancel, wheel
+    );
+    wheel->advance = g_thunks.allocate_thunk (
+      "timerwheel_advance",
+      timerwheel_advance, wheel
+    );
+    wheel->next_timeout = g_thunks.allocate_thunk (
+      "timerwheel_next_timeout",
+      timerwheel_next_timeout, wheel
+    );
+    wheel->free = g_thunks.allocate_thunk (
+      "timerwheel_free",
+      timerwheel_free, wheel
+    );
+  }
+  return wheel;
+}
+
+struct __g_timerwheel g_timerwheel = {
+  .new = timerwheel_new
+};
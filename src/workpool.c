@@ -0,0 +1,148 @@
+#include "../include/workpool.h"
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t
+workpool_monotonic_us (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void*
+workpool_thread (void* data)
+{
+  workpool_t pool = data;
+  pthread_mutex_lock (&pool->__int.lock);
+  for (;;)
+    {
+      while (pool->__int.head == NULL && !pool->__int.stopping)
+        pthread_cond_wait (&pool->__int.not_empty, &pool->__int.lock);
+      /* a stopping pool still works through what it has queued */
+      workpool_job_t* job = pool->__int.head;
+      if (job == NULL)
+        break;
+      if ((pool->__int.head = job->next) == NULL)
+        pool->__int.tail = NULL;
+      --pool->__int.stats.nr_queued;
+      uint64_t wait_us = workpool_monotonic_us () - job->queued_us;
+      pool->__int.stats.total_wait_us += wait_us;
+      if (wait_us > pool->__int.stats.max_wait_us)
+        pool->__int.stats.max_wait_us = wait_us;
+      pthread_mutex_unlock (&pool->__int.lock);
+
+      /* the job may be done with, and reused, by the time this returns */
+      job->run (job->data);
+
+      pthread_mutex_lock (&pool->__int.lock);
+      ++pool->__int.stats.nr_completed;
+    }
+  pthread_mutex_unlock (&pool->__int.lock);
+  return NULL;
+}
+
+bool
+workpool_submit (workpool_t pool, workpool_job_t* job)
+{
+  pthread_mutex_lock (&pool->__int.lock);
+  if (pool->__int.stopping
+      || pool->__int.stats.nr_queued >= pool->__int.max_queued)
+    {
+      ++pool->__int.stats.nr_rejected;
+      pthread_mutex_unlock (&pool->__int.lock);
+      return false;
+    }
+  job->next = NULL;
+  job->queued_us = workpool_monotonic_us ();
+  if (pool->__int.tail != NULL)
+    pool->__int.tail->next = job;
+  else
+    pool->__int.head = job;
+  pool->__int.tail = job;
+  ++pool->__int.stats.nr_submitted;
+  if (++pool->__int.stats.nr_queued > pool->__int.stats.max_queued)
+    pool->__int.stats.max_queued = pool->__int.stats.nr_queued;
+  pthread_cond_signal (&pool->__int.not_empty);
+  pthread_mutex_unlock (&pool->__int.lock);
+  return true;
+}
+
+struct workpool_stats
+workpool_stats (workpool_t pool)
+{
+  pthread_mutex_lock (&pool->__int.lock);
+  struct workpool_stats stats = pool->__int.stats;
+  pthread_mutex_unlock (&pool->__int.lock);
+  uint64_t nr_started = stats.nr_submitted - stats.nr_queued;
+  stats.avg_wait_us = nr_started? (double)stats.total_wait_us / nr_started
+                                : 0.0;
+  return stats;
+}
+
+void
+workpool_free (workpool_t pool)
+{
+  /* whatever is still queued is run before the threads exit */
+  pthread_mutex_lock (&pool->__int.lock);
+  pool->__int.stopping = true;
+  pthread_cond_broadcast (&pool->__int.not_empty);
+  pthread_mutex_unlock (&pool->__int.lock);
+  for (size_t i = 0; i < pool->__int.nr_threads; ++i)
+    pthread_join (pool->__int.threads[i], NULL);
+  pthread_cond_destroy (&pool->__int.not_empty);
+  pthread_mutex_destroy (&pool->__int.lock);
+  g_thunks.deallocate_thunk (pool->submit);
+  g_thunks.deallocate_thunk (pool->free);
+  free (pool->__int.threads);
+  free (pool);
+}
+
+workpool_t
+workpool_new (size_t nr_threads, size_t max_queued)
+{
+  workpool_t pool = calloc_ptr_type (workpool_t);
+  { /* initialize pool structure */
+    pool->__int.nr_threads = nr_threads? nr_threads: DEFAULT_WORKPOOL_THREADS;
+    pool->__int.max_queued = max_queued? max_queued
+                                       : DEFAULT_WORKPOOL_MAX_QUEUED;
+    pthread_mutex_init (&pool->__int.lock, NULL);
+    pthread_cond_init (&pool->__int.not_empty, NULL);
+    pool->__int.threads = calloc (pool->__int.nr_threads,
+                                  sizeof (*pool->__int.threads));
+    if (pool->__int.threads == NULL)
+      panic ("failed to allocate %zu work pool threads",
+             pool->__int.nr_threads);
+  }
+  { /* allocate pool thunks */
+    pool->submit = g_thunks.allocate_thunk (
+      "workpool_submit",
+      workpool_submit, pool
+    );
+    pool->free = g_thunks.allocate_thunk (
+      "workpool_free",
+      workpool_free, pool
+    );
+  }
+  { /* start the threads, inheriting a mask with every signal blocked */
+    sigset_t all, saved_mask;
+    sigfillset (&all);
+    pthread_sigmask (SIG_SETMASK, &all, &saved_mask);
+    for (size_t i = 0; i < pool->__int.nr_threads; ++i)
+      {
+        int err = pthread_create (&pool->__int.threads[i], NULL,
+                                  workpool_thread, pool);
+        if (err)
+          panic ("failed to start work pool thread #%zu: %s", i,
+                 strerror (err));
+      }
+    pthread_sigmask (SIG_SETMASK, &saved_mask, NULL);
+  }
+  return pool;
+}
+
+struct __g_workpool g_workpool = {
+  .new = workpool_new,
+  .stats = workpool_stats
+};
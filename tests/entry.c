@@ -36,6 +36,52 @@ main (void)
     try (t_list_free ());
     try (t_list_hashmap_entry ());
   }
+  { /* ring buffer test cases */
+    puts ("Testing ring buffer test suite");
+    try (t_ringbuf_create ());
+    try (t_ringbuf_produce_consume ());
+    try (t_ringbuf_wraparound ());
+  }
+  { /* timer wheel test cases */
+    puts ("Testing timer wheel test suite");
+    try (t_timerwheel_create ());
+    try (t_timerwheel_expiry ());
+    try (t_timerwheel_cancel ());
+    try (t_timerwheel_cascade ());
+    try (t_timerwheel_many ());
+  }
+  { /* work pool test cases */
+    puts ("Testing work pool test suite");
+    try (t_workpool_create ());
+    try (t_workpool_run ());
+    try (t_workpool_reject ());
+  }
+  { /* coroutine test cases */
+    puts ("Testing coroutine test suite");
+    try (t_coroutine_create ());
+    try (t_coroutine_yield ());
+    try (t_coroutine_pool ());
+  }
+  { /* HTTP parser test cases */
+    puts ("Testing HTTP parser test suite");
+    try (t_httpparse_request ());
+    try (t_httpparse_partial ());
+    try (t_httpparse_resume ());
+    try (t_httpparse_malformed ());
+    try (t_httpparse_too_many_headers ());
+  }
+  { /* HTTP scanning kernel test cases */
+    puts ("Testing HTTP scanning kernel test suite");
+    try (t_httpscan_scalar ());
+    try (t_httpscan_kernels ());
+  }
+  { /* HTTP header name test cases */
+    puts ("Testing HTTP header name test suite");
+    try (t_httpheaders_lookup ());
+    try (t_httpheaders_unknown ());
+    try (t_httpheaders_list ());
+    try (t_httpheaders_list_params ());
+  }
   puts ("Test suite completed successfully :)");
   return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -53,4 +53,21 @@ testcase_fn t_list_create, t_list_append, t_list_remove, t_list_insert,
             t_list_get, t_list_free, t_list_nested, t_list_set,
             t_list_contains, t_list_hashmap_entry;
 
+testcase_fn t_ringbuf_create, t_ringbuf_produce_consume, t_ringbuf_wraparound;
+
+testcase_fn t_timerwheel_create, t_timerwheel_expiry, t_timerwheel_cancel,
+            t_timerwheel_cascade, t_timerwheel_many;
+
+testcase_fn t_workpool_create, t_workpool_run, t_workpool_reject;
+
+testcase_fn t_coroutine_create, t_coroutine_yield, t_coroutine_pool;
+
+testcase_fn t_httpparse_request, t_httpparse_partial, t_httpparse_resume,
+            t_httpparse_malformed, t_httpparse_too_many_headers;
+
+testcase_fn t_httpscan_scalar, t_httpscan_kernels;
+
+testcase_fn t_httpheaders_lookup, t_httpheaders_unknown, t_httpheaders_list,
+            t_httpheaders_list_params;
+
 #endif /* __TESTS_H */
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "tests.h"
+#include "../include/coroutine.h"
+#include <stdio.h>
+
+#define NR_YIELDS (3)
+
+struct t_counter
+{
+  size_t nr_steps;
+  size_t nr_finished;
+};
+
+static void
+t_coroutine_count (void* data)
+{
+  struct t_counter* counter = data;
+  for (size_t i = 0; i < NR_YIELDS; ++i)
+    {
+      ++counter->nr_steps;
+      g_coroutine.yield ();
+    }
+  ++counter->nr_finished;
+}
+
+static void
+t_coroutine_deep (void* data)
+{
+  /* most of a 64KiB stack, which mustn't reach the guard page */
+  volatile char frame[48 * 1024];
+  memset ((char*)frame, 0xa5, sizeof (frame));
+  *(size_t*)data = frame[sizeof (frame) - 1] == (char)0xa5;
+}
+
+bool
+t_coroutine_create (void)
+{
+  coropool_t pool = g_coroutine.new_pool (0, 0);
+  assert_nonnull ("Pool `spawn` thunk not allocated", pool->spawn);
+  assert_nonnull ("Pool `free` thunk not allocated", pool->free);
+  assert_equals ("Pool should fall back to the default stack size",
+                 pool->__int.stack_size, DEFAULT_COROUTINE_STACK_SIZE);
+  assert_equals ("Pool should start out empty", pool->__int.nr_pooled, 0);
+  assert_equals ("No coroutine should be running outside of one",
+                 g_coroutine.current (), NULL);
+  pool->free ();
+  return true;
+}
+
+bool
+t_coroutine_yield (void)
+{
+  struct t_counter counter = {0};
+  coropool_t pool = g_coroutine.new_pool (0, 0);
+  coroutine_t coroutine = pool->spawn (t_coroutine_count, &counter);
+  assert_equals ("Spawned coroutine should be live", pool->__int.nr_live, 1);
+  assert_equals ("Spawned coroutine shouldn't run before being resumed",
+                 counter.nr_steps, 0);
+  size_t nr_resumes = 0;
+  while (g_coroutine.resume (coroutine))
+    {
+      ++nr_resumes;
+      assert_equals ("Coroutine should take a step per resume",
+                     counter.nr_steps, nr_resumes);
+    }
+  assert_equals ("Coroutine should yield once per step", nr_resumes,
+                 NR_YIELDS);
+  assert_equals ("Coroutine should run to completion", counter.nr_finished, 1);
+  assert_equals ("Returned coroutine shouldn't be live", pool->__int.nr_live,
+                 0);
+  assert_equals ("Returned coroutine's stack should be pooled",
+                 pool->__int.nr_pooled, 1);
+  pool->free ();
+  return true;
+}
+
+bool
+t_coroutine_pool (void)
+{
+  struct t_counter counters[2] = {0};
+  coropool_t pool = g_coroutine.new_pool (0, 1);
+  coroutine_t first = pool->spawn (t_coroutine_count, &counters[0]),
+              second = pool->spawn (t_coroutine_count, &counters[1]);
+  assert_equals ("Both coroutines should be live", pool->__int.nr_live, 2);
+  /* interleaved, each on a stack of its own */
+  while (g_coroutine.resume (first) | g_coroutine.resume (second))
+    ;
+  assert_equals ("First coroutine should finish", counters[0].nr_finished, 1);
+  assert_equals ("Second coroutine should finish", counters[1].nr_finished, 1);
+  assert_equals ("Most live at once should be counted",
+                 pool->__int.max_live, 2);
+  assert_equals ("Stacks beyond the pool's size should be unmapped",
+                 pool->__int.nr_pooled, 1);
+  coroutine_t reused = pool->spawn (t_coroutine_count, &counters[0]);
+  assert_true ("Pooled stack should be reused",
+               (reused == first || reused == second));
+  while (g_coroutine.resume (reused))
+    ;
+  size_t deep = 0;
+  coroutine_t coroutine = pool->spawn (t_coroutine_deep, &deep);
+  assert_false ("Deep coroutine should return", g_coroutine.resume (coroutine));
+  assert_equals ("Deep coroutine should have its stack to itself", deep, 1);
+  pool->free ();
+  return true;
+}
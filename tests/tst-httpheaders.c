@@ -0,0 +1,119 @@
+#include "tests.h"
+#include "../include/httpheaders.h"
+#include <stdio.h>
+#include <ctype.h>
+
+bool
+t_httpheaders_lookup (void)
+{
+  /* every name should land on its own slot, by either case */
+  bool found = true;
+  for (enum httpheader_value_type ty = 0; ty < HTTPHEADER_OTHER; ++ty)
+    {
+      char upper[64];
+      const char* name = header_name (ty);
+      size_t len = strlen (name);
+      for (size_t i = 0; i <= len; ++i)
+        upper[i] = toupper (name[i]);
+      if (g_httpheaders.lookup (name, len) != ty
+          || g_httpheaders.lookup (upper, len) != ty)
+        {
+          fprintf (stderr, "'%s' wasn't found\n", name);
+          found = false;
+        }
+    }
+  assert_true ("Every known name should be found", found);
+  assert_equals ("Mixed case should be found",
+                 g_httpheaders.lookup ("Content-Length", 14),
+                 HTTPHEADER_CONTENT_LENGTH);
+  return true;
+}
+
+bool
+t_httpheaders_unknown (void)
+{
+  const char* const names[] = {
+    "X-Custom", "Content-Lengths", "Content-Lengt", "Hots", "T", "TE1",
+    "If-None-Matches", "Acceptt", "Accept_Encoding", "X-Forwarded-Fo"
+  };
+  for (size_t i = 0; i < sizeof (names) / sizeof (*names); ++i)
+    {
+      enum httpheader_value_type ty
+        = g_httpheaders.lookup (names[i], strlen (names[i]));
+      if (ty != HTTPHEADER_OTHER)
+        fprintf (stderr, "'%s' was taken for '%s'\n", names[i],
+                 header_name (ty));
+      assert_equals ("Unknown name should be no known one",
+                     ty, HTTPHEADER_OTHER);
+    }
+  assert_equals ("Name should only be looked up as far as its length",
+                 g_httpheaders.lookup ("Hostname", 4), HTTPHEADER_HOST);
+  return true;
+}
+
+#define item_equals(list, span, str) \
+  ((span).length == strlen (str) \
+   && !memcmp ((list).value + (span).offset, (str), (span).length))
+
+bool
+t_httpheaders_list (void)
+{
+  struct httplist list;
+  struct httplistitem item;
+  g_httpheaders.list_begin (&list,
+                            " gzip, deflate;q=0.5 ,,br;Q=0 , x;q=1.000");
+  assert_true ("First item should be read",
+               g_httpheaders.list_next (&list, &item));
+  assert_true ("Token should be stripped",
+               item_equals (list, item.token, "gzip"));
+  assert_equals ("Item without a weight should weigh 1", item.q, 1000);
+  assert_equals ("Item without parameters should have none",
+                 item.params.length, 0);
+  g_httpheaders.list_next (&list, &item);
+  assert_true ("Token should end at its parameters",
+               item_equals (list, item.token, "deflate"));
+  assert_equals ("Weight should be read", item.q, 500);
+  assert_true ("Parameters should be stripped",
+               item_equals (list, item.params, "q=0.5"));
+  g_httpheaders.list_next (&list, &item);
+  assert_true ("Empty items should be skipped",
+               item_equals (list, item.token, "br"));
+  assert_equals ("Weight should be read by either case", item.q, 0);
+  g_httpheaders.list_next (&list, &item);
+  assert_equals ("Weight of 1 should have up to three zeros", item.q, 1000);
+  assert_false ("List should end after the last item",
+                g_httpheaders.list_next (&list, &item));
+  assert_false ("List should stay ended",
+                g_httpheaders.list_next (&list, &item));
+  return true;
+}
+
+bool
+t_httpheaders_list_params (void)
+{
+  struct httplist list;
+  struct httplistitem item;
+  g_httpheaders.list_begin (
+    &list, "text/html;level=1;q=0.7, a;x=\"1,\\\"2;\";q=0.125, b;q=2, c;q=0.1x"
+  );
+  g_httpheaders.list_next (&list, &item);
+  assert_true ("Token should be the media type",
+               item_equals (list, item.token, "text/html"));
+  assert_true ("Every parameter should be kept",
+               item_equals (list, item.params, "level=1;q=0.7"));
+  assert_equals ("Weight should be found among parameters", item.q, 700);
+  g_httpheaders.list_next (&list, &item);
+  assert_true ("Quoted strings shouldn't delimit",
+               item_equals (list, item.params, "x=\"1,\\\"2;\";q=0.125"));
+  assert_equals ("Weight should have up to three decimals", item.q, 125);
+  g_httpheaders.list_next (&list, &item);
+  assert_equals ("Weight above 1 should be ignored", item.q, 1000);
+  g_httpheaders.list_next (&list, &item);
+  assert_equals ("Malformed weight should be ignored", item.q, 1000);
+  assert_false ("List should end after the last item",
+                g_httpheaders.list_next (&list, &item));
+  g_httpheaders.list_begin (&list, " , ;q=1,");
+  assert_false ("List of only empty items should have none",
+                g_httpheaders.list_next (&list, &item));
+  return true;
+}
@@ -0,0 +1,165 @@
+#include "tests.h"
+#include "../include/httpparse.h"
+#include <stdio.h>
+
+#define span_equals(buf, span, str) \
+  ((span).length == strlen (str) \
+   && !memcmp ((buf) + (span).offset, (str), (span).length))
+
+bool
+t_httpparse_request (void)
+{
+  char request[] = "GET /index.html HTTP/1.1\r\n"
+                   "Host: example.com\r\n"
+                   "Accept:*/*  \r\n"
+                   "X-Empty: \r\n"
+                   "\r\n"
+                   "body";
+  struct httphead head;
+  g_httpparse.begin (&head);
+  assert_equals (
+    "Whole head should parse",
+    g_httpparse.head (&head, request, strlen (request)), HTTPPARSE_DONE
+  );
+  assert_equals (
+    "Head should end after the blank line",
+    head.length, strlen (request) - strlen ("body")
+  );
+  assert_true ("Method should be spanned",
+               span_equals (request, head.method, "GET"));
+  assert_true ("Path should be spanned",
+               span_equals (request, head.path, "/index.html"));
+  assert_equals ("Major version should be parsed", head.version.major, 1);
+  assert_equals ("Minor version should be parsed", head.version.minor, 1);
+  assert_equals ("Every header should be parsed", head.nr_headers, 3);
+  assert_true ("Header name should be spanned",
+               span_equals (request, head.headers[0].name, "Host"));
+  assert_true ("Header value should be spanned",
+               span_equals (request, head.headers[0].value, "example.com"));
+  assert_true ("Header value should be stripped of whitespace",
+               span_equals (request, head.headers[1].value, "*/*"));
+  assert_equals ("Empty header value should be empty",
+                 head.headers[2].value.length, 0);
+  g_httpparse.terminate (&head, request);
+  assert_string_equal ("Terminated path should be a string",
+                       "/index.html", request + head.path.offset);
+  assert_string_equal ("Terminated header name should be a string",
+                       "Accept", request + head.headers[1].name.offset);
+  assert_string_equal ("Terminated header value should be a string",
+                       "*/*", request + head.headers[1].value.offset);
+  return true;
+}
+
+bool
+t_httpparse_partial (void)
+{
+  const char request[] = "POST /upload HTTP/1.0\r\n"
+                         "Content-Length:  4 \r\n"
+                         "X-Empty:\r\n"
+                         "\r\n";
+  struct httphead head;
+  g_httpparse.begin (&head);
+  for (size_t len = 0; len < strlen (request); ++len)
+    if (g_httpparse.head (&head, request, len) != HTTPPARSE_NEED_MORE)
+      {
+        fprintf (stderr, "prefix of %zu byte(s) didn't need more\n", len);
+        assert_true ("Every prefix of a head should need more", false);
+      }
+  assert_equals (
+    "Head should parse once whole",
+    g_httpparse.head (&head, request, strlen (request)), HTTPPARSE_DONE
+  );
+  assert_equals ("Head should end after the blank line",
+                 head.length, strlen (request));
+  assert_true ("Path should be spanned across resumptions",
+               span_equals (request, head.path, "/upload"));
+  assert_equals ("Minor version should be parsed", head.version.minor, 0);
+  assert_equals ("Every header should be parsed", head.nr_headers, 2);
+  assert_true ("Header name should be spanned across resumptions",
+               span_equals (request, head.headers[0].name,
+                            "Content-Length"));
+  assert_true ("Header value should be spanned across resumptions",
+               span_equals (request, head.headers[0].value, "4"));
+  assert_equals ("Empty header value should be empty",
+                 head.headers[1].value.length, 0);
+  return true;
+}
+
+bool
+t_httpparse_resume (void)
+{
+  /* the position parsing picks up from is where it last ran out */
+  const char request[] = "GET /a HTTP/1.1\r\nHost: example.com\r\n\r\n";
+  struct httphead head;
+  g_httpparse.begin (&head);
+  assert_equals (
+    "Head cut mid-header should need more",
+    g_httpparse.head (&head, request, strlen ("GET /a HTTP/1.1\r\nHo")),
+    HTTPPARSE_NEED_MORE
+  );
+  assert_equals ("Parsing should stop where the bytes ran out",
+                 head.__int.position, strlen ("GET /a HTTP/1.1\r\nHo"));
+  assert_equals ("Cut header shouldn't be counted yet", head.nr_headers, 0);
+  assert_equals (
+    "Head should parse once the rest arrives",
+    g_httpparse.head (&head, request, strlen (request)), HTTPPARSE_DONE
+  );
+  assert_true ("Header cut in two should be spanned whole",
+               span_equals (request, head.headers[0].name, "Host"));
+  g_httpparse.begin (&head);
+  assert_equals (
+    "Head should parse again from the start once begun anew",
+    g_httpparse.head (&head, request, strlen (request)), HTTPPARSE_DONE
+  );
+  assert_equals ("Begun anew, headers should be counted from none",
+                 head.nr_headers, 1);
+  return true;
+}
+
+bool
+t_httpparse_malformed (void)
+{
+  const char* const requests[] = {
+    " / HTTP/1.1\r\n\r\n",
+    "G(T / HTTP/1.1\r\n\r\n",
+    "GET  HTTP/1.1\r\n\r\n",
+    "GET /\r\n\r\n",
+    "GET / HTTP/x.1\r\n\r\n",
+    "GET / HTTP/1.1\n\r\n",
+    "GET / HTTP/1.1\r\nHost\r\n\r\n",
+    "GET / HTTP/1.1\r\n: value\r\n\r\n",
+    "GET / HTTP/1.1\r\nHo st: x\r\n\r\n",
+    "GET / HTTP/1.1\r\nHost: x\r\n folded\r\n\r\n",
+    "GET / HTTP/1.1\r\nHost: \x01\r\n\r\n",
+    "GET / HTTP/1.1\r\nHost: x\r\r\n\r\n"
+  };
+  struct httphead head;
+  for (size_t i = 0; i < sizeof (requests) / sizeof (*requests); ++i)
+    {
+      g_httpparse.begin (&head);
+      enum httpparse_status status
+        = g_httpparse.head (&head, requests[i], strlen (requests[i]));
+      if (status != HTTPPARSE_ERROR)
+        fprintf (stderr, "request #%zu wasn't rejected\n", i);
+      assert_equals ("Malformed head should be rejected",
+                     status, HTTPPARSE_ERROR);
+      assert_nonnull ("Rejected head should say why", head.error);
+    }
+  return true;
+}
+
+bool
+t_httpparse_too_many_headers (void)
+{
+  char request[32 + (HTTP_MAX_HEADERS + 1) * 8] = "GET / HTTP/1.1\r\n";
+  for (size_t i = 0; i <= HTTP_MAX_HEADERS; ++i)
+    strcat (request, "A: b\r\n");
+  strcat (request, "\r\n");
+  struct httphead head;
+  g_httpparse.begin (&head);
+  assert_equals (
+    "Head with too many headers should be rejected",
+    g_httpparse.head (&head, request, strlen (request)), HTTPPARSE_ERROR
+  );
+  return true;
+}
@@ -0,0 +1,105 @@
+#include "tests.h"
+#include "../include/httpscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_SCAN_BYTES (512)
+
+static void
+fill_scan_buffer (char* buf, size_t len, unsigned int seed)
+{
+  /* mostly runs of plain characters, for the vector loops to get through,
+   * with every byte value turning up now and then
+   */
+  srand (seed);
+  for (size_t i = 0; i < len; ++i)
+    buf[i] = rand () % 8? "abcXYZ019-_.~|/ "[rand () % 16]: rand () % 256;
+}
+
+static bool
+compare_kernels (const char* buf, size_t len)
+{
+  for (size_t from = 0; from <= len; ++from)
+    {
+      size_t expected[] = {
+        httpscan_scalar_token (buf, from, len),
+        httpscan_scalar_target (buf, from, len),
+        httpscan_scalar_field (buf, from, len),
+        httpscan_scalar_any (buf, from, len, ",;")
+      };
+      size_t actual[] = {
+        g_httpscan.token (buf, from, len),
+        g_httpscan.target (buf, from, len),
+        g_httpscan.field (buf, from, len),
+        g_httpscan.any (buf, from, len, ",;")
+      };
+      for (size_t i = 0; i < sizeof (expected) / sizeof (*expected); ++i)
+        if (expected[i] != actual[i])
+          {
+            fprintf (stderr, "%s kernel #%zu from %zu/%zu: %zu != %zu\n",
+                     g_httpscan.isa, i, from, len, expected[i], actual[i]);
+            return false;
+          }
+    }
+  return true;
+}
+
+bool
+t_httpscan_scalar (void)
+{
+  const char line[] = "GET /a|b~c HTTP/1.1\r\nX-Tab:\tv,w;q=1\r\n";
+  size_t len = strlen (line);
+  assert_equals ("Token should stop at the space",
+                 httpscan_scalar_token (line, 0, len), 3);
+  assert_equals ("Target should run through '|' and '~'",
+                 httpscan_scalar_target (line, 4, len), 10);
+  assert_equals ("Token should stop at the colon",
+                 httpscan_scalar_token (line, 21, len), 26);
+  assert_equals ("Field should run through a tab and stop at CR",
+                 httpscan_scalar_field (line, 27, len), len - 2);
+  assert_equals ("Any should stop at the first of the set",
+                 httpscan_scalar_any (line, 27, len, ";,"), 29);
+  assert_equals ("Scans should stop at the end",
+                 httpscan_scalar_any (line, 0, len, "#"), len);
+  return true;
+}
+
+bool
+t_httpscan_kernels (void)
+{
+  char buf[NR_SCAN_BYTES];
+  const char* best = g_httpscan.isa;
+  enum httpscan_isa chosen = HTTPSCAN_SCALAR;
+  for (enum httpscan_isa isa = HTTPSCAN_SCALAR; isa < HTTPSCAN_NR_ISAS; ++isa)
+    {
+      if (!g_httpscan.select (isa))
+        {
+          printf ("skipping kernels the CPU doesn't support (#%d)\n", isa);
+          continue;
+        }
+      if (!strcmp (g_httpscan.isa, best))
+        chosen = isa;
+      bool agree = true;
+      for (unsigned int seed = 0; agree && seed < 32; ++seed)
+        {
+          fill_scan_buffer (buf, sizeof (buf), seed);
+          agree = compare_kernels (buf, sizeof (buf));
+        }
+      assert_true ("Kernels should agree with the scalar ones", agree);
+      memset (buf, 'a', 64);
+      for (size_t value = 0; agree && value < 256; ++value)
+        for (size_t at = 0; agree && at < 64; ++at)
+          {
+            /* every byte value at every position of a vector */
+            buf[at] = value;
+            agree = compare_kernels (buf, 64);
+            buf[at] = 'a';
+          }
+      assert_true ("Kernels should classify every byte", agree);
+    }
+  assert_true ("Best kernels should be picked back",
+               g_httpscan.select (chosen));
+  assert_string_equal ("Best kernels should be picked at startup",
+                       best, g_httpscan.isa);
+  return true;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+# replays scripted connections over the in-memory transport, and checks
+# every one is answered, byte for byte, however the client feeds its
+# request in, takes its response or hangs up afterwards
+#
+# usage: tst-memory.sh <server binary> <routes>, the routes answering
+# "GET /" with a 2xx
+bin=${1:-./build/main}
+routes=${2:-./routes}
+request=$(dirname "$0")/memory-request.txt
+nr_connections=200
+failed=0
+
+# "<2xx> <unanswered> <bytes out>" of a run over `-M $1`
+run () {
+  "$bin" -b memory -M "$1" "$routes" 2>&1 \
+    | sed 's/\x1b\[[0-9;]*m//g' \
+    | sed -n 's/.* \([0-9]*\) 2xx, .* \([0-9]*\) unanswered; \([0-9]*\) bytes out.*/\1 \2 \3/p'
+}
+
+expect () {
+  actual=$(run "$2")
+  if [ "$actual" = "$3" ]; then
+    echo "memory transport, $1: ok"
+  else
+    echo "memory transport, $1: expected '$3', got '$actual'"
+    failed=1
+  fi
+}
+
+baseline=$(run "$request,$nr_connections")
+nr_bytes=${baseline##* }
+if [ "${baseline% *}" != "$nr_connections 0" ] || [ -z "$nr_bytes" ] \
+   || [ "$nr_bytes" -eq 0 ]; then
+  echo "memory transport, baseline: every connection should be answered," \
+       "got '$baseline'"
+  exit 1
+fi
+
+# concurrent, chunk, window, hangup
+answered="$nr_connections 0 $nr_bytes"
+expect "hangup" "$request,$nr_connections,16,0,0,1" "$answered"
+expect "chunk" "$request,$nr_connections,16,3,0,0" "$answered"
+expect "chunk, hangup" "$request,$nr_connections,16,3,0,1" "$answered"
+expect "window" "$request,$nr_connections,16,0,7,0" "$answered"
+expect "window, hangup" "$request,$nr_connections,16,0,7,1" "$answered"
+expect "chunk, window, hangup" "$request,$nr_connections,4,5,11,1" \
+  "$answered"
+
+# a head that's cut short and hung up on is never answered
+truncated=$(mktemp)
+head -c 20 "$request" > "$truncated"
+expect "truncated, hangup" "$truncated,$nr_connections,16,0,0,1" \
+  "0 $nr_connections 0"
+rm -f "$truncated"
+
+exit $failed
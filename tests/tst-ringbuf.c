@@ -0,0 +1,82 @@
+#include "tests.h"
+#include "../include/ringbuf.h"
+#include <stdio.h>
+#include <unistd.h>
+
+bool
+t_ringbuf_create (void)
+{
+  ringbuf_t ring = g_ringbuf.new (1);
+  assert_nonnull ("Ring `readable` thunk not allocated", ring->readable);
+  assert_nonnull ("Ring `writable` thunk not allocated", ring->writable);
+  assert_nonnull ("Ring `read_ptr` thunk not allocated", ring->read_ptr);
+  assert_nonnull ("Ring `write_ptr` thunk not allocated", ring->write_ptr);
+  assert_nonnull ("Ring `produce` thunk not allocated", ring->produce);
+  assert_nonnull ("Ring `consume` thunk not allocated", ring->consume);
+  assert_nonnull ("Ring `free` thunk not allocated", ring->free);
+  assert_equals (
+    "Ring capacity should be rounded up to a page",
+    ring->__int.capacity, (size_t)sysconf (_SC_PAGE_SIZE)
+  );
+  assert_equals ("New ring should be empty", ring->readable (), 0);
+  assert_equals (
+    "New ring should be entirely writable",
+    ring->writable (), ring->__int.capacity
+  );
+  ring->free ();
+  return true;
+}
+
+bool
+t_ringbuf_produce_consume (void)
+{
+  ringbuf_t ring = g_ringbuf.new (0);
+  char message[] = "GET / HTTP/1.1\r\n";
+  memcpy (ring->write_ptr (), message, sizeof (message) - 1);
+  ring->produce (sizeof (message) - 1);
+  assert_equals (
+    "Produced bytes should become readable",
+    ring->readable (), sizeof (message) - 1
+  );
+  assert_true (
+    "Readable bytes should match what was written",
+    !memcmp (ring->read_ptr (), message, sizeof (message) - 1)
+  );
+  ring->consume (4);
+  assert_equals (
+    "Consumed bytes should no longer be readable",
+    ring->readable (), sizeof (message) - 5
+  );
+  assert_equals ("Read pointer should advance", *ring->read_ptr (), '/');
+  ring->consume (ring->readable ());
+  assert_equals ("Drained ring should be empty", ring->readable (), 0);
+  ring->free ();
+  return true;
+}
+
+bool
+t_ringbuf_wraparound (void)
+{
+  ringbuf_t ring = g_ringbuf.new (0);
+  size_t capacity = ring->__int.capacity;
+  /* leave a handful of bytes buffered at the very end of the ring */
+  memset (ring->write_ptr (), 'x', capacity);
+  ring->produce (capacity);
+  ring->consume (capacity - 4);
+  assert_equals (
+    "Ring should have room for the consumed bytes",
+    ring->writable (), capacity - 4
+  );
+  memcpy (ring->write_ptr (), "\r\n\r\n", 4);
+  ring->produce (4);
+  assert_true (
+    "Wrapped data should be contiguous through the mirror",
+    !memcmp (ring->read_ptr (), "xxxx\r\n\r\n", 8)
+  );
+  assert_equals (
+    "Mirror should alias the start of the ring",
+    ring->__int.base[0], '\r'
+  );
+  ring->free ();
+  return true;
+}
@@ -0,0 +1,151 @@
+#include "tests.h"
+#include "../include/timerwheel.h"
+#include <stdio.h>
+
+#define NR_MANY_TIMERS (100000)
+
+struct t_timer
+{
+  timerwheel_timer_t timer;
+  uint64_t due_ms;
+  size_t nr_expired;
+  bool expired_early;
+};
+
+static uint64_t t_now_ms;
+
+static void
+t_timer_expired (void* data)
+{
+  struct t_timer* timer = data;
+  ++timer->nr_expired;
+  if (t_now_ms < timer->due_ms)
+    timer->expired_early = true;
+}
+
+static void
+t_timer_init (struct t_timer* timer, uint64_t due_ms)
+{
+  *timer = (struct t_timer){
+    .timer = {.on_expiry = t_timer_expired, .data = timer},
+    .due_ms = due_ms
+  };
+}
+
+bool
+t_timerwheel_create (void)
+{
+  timerwheel_t wheel = g_timerwheel.new (0, 1000);
+  assert_nonnull ("Wheel `arm` thunk not allocated", wheel->arm);
+  assert_nonnull ("Wheel `cancel` thunk not allocated", wheel->cancel);
+  assert_nonnull ("Wheel `advance` thunk not allocated", wheel->advance);
+  assert_nonnull ("Wheel `next_timeout` thunk not allocated",
+                  wheel->next_timeout);
+  assert_nonnull ("Wheel `free` thunk not allocated", wheel->free);
+  assert_equals ("Wheel should fall back to the default tick",
+                 wheel->__int.tick_ms, DEFAULT_TIMERWHEEL_TICK_MS);
+  assert_equals ("Idle wheel should have no timeout",
+                 wheel->next_timeout (), -1);
+  wheel->free ();
+  return true;
+}
+
+bool
+t_timerwheel_expiry (void)
+{
+  struct t_timer timer;
+  timerwheel_t wheel = g_timerwheel.new (1, t_now_ms = 1000);
+  t_timer_init (&timer, 1010);
+  wheel->arm (&timer.timer, 10);
+  assert_true ("Armed timer should report as armed",
+               timerwheel_is_armed (&timer.timer));
+  assert_equals ("Wheel should time out with the timer",
+                 wheel->next_timeout (), 10);
+  assert_equals ("Timer shouldn't expire early",
+                 wheel->advance (t_now_ms = 1009), 0);
+  assert_equals ("Timer should expire when due",
+                 wheel->advance (t_now_ms = 1010), 1);
+  assert_false ("Expired timer should be disarmed",
+                timerwheel_is_armed (&timer.timer));
+  assert_equals ("Timer should expire once",
+                 wheel->advance (t_now_ms = 5000), 0);
+  wheel->free ();
+  return true;
+}
+
+bool
+t_timerwheel_cancel (void)
+{
+  struct t_timer first, second;
+  timerwheel_t wheel = g_timerwheel.new (1, t_now_ms = 0);
+  t_timer_init (&first, 50);
+  t_timer_init (&second, 50);
+  wheel->arm (&first.timer, 50);
+  wheel->arm (&second.timer, 50);
+  wheel->cancel (&first.timer);
+  wheel->cancel (&first.timer);
+  assert_false ("Cancelled timer should be disarmed",
+                timerwheel_is_armed (&first.timer));
+  assert_equals ("Only the remaining timer should expire",
+                 wheel->advance (t_now_ms = 100), 1);
+  assert_equals ("Cancelled timer shouldn't expire", first.nr_expired, 0);
+  assert_equals ("Remaining timer should expire", second.nr_expired, 1);
+  wheel->free ();
+  return true;
+}
+
+bool
+t_timerwheel_cascade (void)
+{
+  /* far enough out to start on the top level */
+  struct t_timer timer;
+  timerwheel_t wheel = g_timerwheel.new (1, t_now_ms = 0);
+  t_timer_init (&timer, 300000);
+  wheel->arm (&timer.timer, 300000);
+  assert_equals ("Timer should start out on the top level",
+                 timer.timer.level, TIMERWHEEL_LEVELS - 1);
+  while (t_now_ms < 299999)
+    {
+      int timeout = wheel->next_timeout ();
+      assert_true ("Wheel should wake up before the timer is due",
+                   timeout > 0 && t_now_ms + timeout <= 300000);
+      wheel->advance (t_now_ms += timeout < 299999 - t_now_ms
+                                  ? timeout : 299999 - t_now_ms);
+    }
+  assert_equals ("Timer shouldn't expire early", timer.nr_expired, 0);
+  assert_equals ("Timer should cascade down to the bottom level",
+                 timer.timer.level, 0);
+  wheel->advance (t_now_ms = 300000);
+  assert_equals ("Timer should expire when due", timer.nr_expired, 1);
+  wheel->free ();
+  return true;
+}
+
+bool
+t_timerwheel_many (void)
+{
+  static struct t_timer timers[NR_MANY_TIMERS];
+  timerwheel_t wheel = g_timerwheel.new (1, t_now_ms = 0);
+  for (size_t i = 0; i < NR_MANY_TIMERS; ++i)
+    {
+      uint64_t timeout = 1 + (i * 7919) % 600000;
+      t_timer_init (&timers[i], timeout);
+      wheel->arm (&timers[i].timer, timeout);
+    }
+  assert_equals ("All timers should be armed",
+                 wheel->__int.nr_timers, NR_MANY_TIMERS);
+  size_t nr_expired = 0;
+  while (t_now_ms < 600000)
+    nr_expired += wheel->advance (t_now_ms += 997);
+  assert_equals ("Every timer should expire", nr_expired, NR_MANY_TIMERS);
+  for (size_t i = 0; i < NR_MANY_TIMERS; ++i)
+    {
+      if (timers[i].nr_expired != 1 || timers[i].expired_early)
+        {
+          assert_true ("Every timer should expire once, and not early",
+                       false);
+        }
+    }
+  wheel->free ();
+  return true;
+}
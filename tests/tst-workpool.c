@@ -0,0 +1,110 @@
+#include "tests.h"
+#include "../include/workpool.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define NR_MANY_JOBS (10000)
+
+struct t_job
+{
+  workpool_job_t job;
+  size_t* nr_run;
+  bool* released;  /* spun on until set, when not NULL */
+  bool started;
+};
+
+static void
+t_job_run (void* data)
+{
+  struct t_job* job = data;
+  __atomic_store_n (&job->started, true, __ATOMIC_RELEASE);
+  if (job->released != NULL)
+    while (!__atomic_load_n (job->released, __ATOMIC_ACQUIRE))
+      usleep (100);
+  __atomic_add_fetch (job->nr_run, 1, __ATOMIC_RELAXED);
+}
+
+static void
+t_job_init (struct t_job* job, size_t* nr_run, bool* released)
+{
+  *job = (struct t_job){
+    .job = {.run = t_job_run, .data = job},
+    .nr_run = nr_run,
+    .released = released
+  };
+}
+
+bool
+t_workpool_create (void)
+{
+  workpool_t pool = g_workpool.new (0, 0);
+  assert_nonnull ("Pool `submit` thunk not allocated", pool->submit);
+  assert_nonnull ("Pool `free` thunk not allocated", pool->free);
+  assert_equals ("Pool should fall back to the default thread count",
+                 pool->__int.nr_threads, DEFAULT_WORKPOOL_THREADS);
+  assert_equals ("Pool should fall back to the default queue size",
+                 pool->__int.max_queued, DEFAULT_WORKPOOL_MAX_QUEUED);
+  struct workpool_stats stats = g_workpool.stats (pool);
+  assert_equals ("Idle pool should have nothing queued", stats.nr_queued, 0);
+  assert_equals ("Idle pool should have no wait time", stats.avg_wait_us, 0.0);
+  pool->free ();
+  return true;
+}
+
+bool
+t_workpool_run (void)
+{
+  static struct t_job jobs[NR_MANY_JOBS];
+  size_t nr_run = 0;
+  workpool_t pool = g_workpool.new (4, NR_MANY_JOBS);
+  for (size_t i = 0; i < NR_MANY_JOBS; ++i)
+    {
+      t_job_init (&jobs[i], &nr_run, NULL);
+      if (!pool->submit (&jobs[i].job))
+        {
+          assert_true ("Every job should fit in the queue", false);
+        }
+    }
+  struct workpool_stats stats;
+  do
+    stats = g_workpool.stats (pool);
+  while (stats.nr_completed < NR_MANY_JOBS);
+  assert_equals ("Every job should run", nr_run, NR_MANY_JOBS);
+  assert_equals ("Every job should be counted", stats.nr_submitted,
+                 NR_MANY_JOBS);
+  assert_equals ("No job should be rejected", stats.nr_rejected, 0);
+  assert_true ("Average wait shouldn't exceed the longest",
+               stats.avg_wait_us <= stats.max_wait_us);
+  pool->free ();
+  return true;
+}
+
+bool
+t_workpool_reject (void)
+{
+  struct t_job blocker, queued[2], rejected;
+  size_t nr_run = 0;
+  bool released = false;
+  workpool_t pool = g_workpool.new (1, 2);
+  t_job_init (&blocker, &nr_run, &released);
+  assert_true ("Job should be taken on", pool->submit (&blocker.job));
+  while (!__atomic_load_n (&blocker.started, __ATOMIC_ACQUIRE))
+    usleep (100);
+  for (size_t i = 0; i < 2; ++i)
+    {
+      t_job_init (&queued[i], &nr_run, NULL);
+      assert_true ("Job should be queued", pool->submit (&queued[i].job));
+    }
+  t_job_init (&rejected, &nr_run, NULL);
+  assert_false ("Job should be rejected by a full queue",
+                pool->submit (&rejected.job));
+  struct workpool_stats stats = g_workpool.stats (pool);
+  assert_equals ("Queue should be full", stats.nr_queued, 2);
+  assert_equals ("Rejection should be counted", stats.nr_rejected, 1);
+  __atomic_store_n (&released, true, __ATOMIC_RELEASE);
+  /* queued jobs still run when the pool is freed */
+  pool->free ();
+  assert_equals ("Queued jobs should run, the rejected one not", nr_run, 3);
+  assert_false ("Rejected job shouldn't run", rejected.started);
+  return true;
+}